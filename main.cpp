@@ -1,600 +1,8262 @@
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <locale.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <exception>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <memory_resource>
 #include <ostream>
+#include <random>
 #include <regex>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
-namespace helper {
-/* --------------------------------------------------------------------------*/
-/**
- * @brief counts all occurences of std::regex expresion in  given string and
- * returns counter of occurences at the end of the function
- *
- * @Param const std::regex reference
- * @Param const std::string reference
- *
- * @Returns  long
- */
-/* ----------------------------------------------------------------------------*/
-auto inline count_all(const std::regex &expression, const std::string &to_check)
-    -> long {
-  long const match_count(std::distance(
-      std::sregex_iterator(to_check.begin(), to_check.end(), expression),
-      std::sregex_iterator()));
-  return match_count;
-}
-/* --------------------------------------------------------------------------*/
-/**
- * @brief function that checks if given string is palindrome
- *
- * @Param const std::string reference
- *
- * @Returns bool
- */
-/* ----------------------------------------------------------------------------*/
-auto inline check_if_palindrome(const std::string &word) -> bool {
-  std::string reversedWord = std::string(word.rbegin(), word.rend());
-  return !word.compare(reversedWord);
-}
-/* --------------------------------------------------------------------------*/
-/**
- * @brief from the given iterator range checks if word is palindrom if yes
- * it's added to the std::unordered_set<std::string> that is returned at the
- * end of function
- *
- * @Param reference to iterator
- * @Param const reference to iterator
- *
- * @Returns std::unordered_set<std::string>
- */
-/* ----------------------------------------------------------------------------*/
-template <class It>
-auto palindroms(It &begin_iterator, const It &end_iterator)
-    -> std::unordered_set<std::string> {
-  std::unordered_set<std::string> palindrom_set;
-  while (begin_iterator != end_iterator) {
-    if (check_if_palindrome(*begin_iterator))
-      palindrom_set.insert(*begin_iterator);
-    ++begin_iterator;
-  }
-  return palindrom_set;
-}
+namespace allocations {
 /* --------------------------------------------------------------------------*/
 /**
- * @brief Optimized for the usecase in this project since using the same
- * std::vector of anagrams
- *
- * @Param std::string argument
- * @Param const std::string reference
- *
- * @Returns
+ * @brief number of allocations made with operator new since counting was
+ * started by the first --stats or --bench. Until then operator new only reads
+ * the flag, after it every allocation costs one relaxed atomic increment
  */
 /* ----------------------------------------------------------------------------*/
-bool inline is_anagram_optimized(std::string word1, const std::string &word2) {
-  std::sort(word1.begin(), word1.end());  // added
-  return !word1.compare(word2);
-}
-auto change_line_to_words(const std::vector<std::string> &lines)
-    -> std::vector<std::string> {
-  for (const auto &line : lines) {
-    std::vector<std::string> all_flags;
-    std::istringstream buffer(line);
-    std::copy(std::istream_iterator<std::string>(buffer),
-              std::istream_iterator<std::string>(),
-              std::back_inserter(all_flags));
-  }
-  // TODO: yield -> create generator so called Input Iterator
-  return lines;
-}
-template <typename T>
-auto print_vector(const std::vector<T> &vec) {
-  for (const auto &e : vec) std::cout << e << std::endl;
+inline std::atomic<std::uint64_t> counter{0};
+inline std::atomic<bool> counting{false};
+auto inline start() -> void { counting.store(true, std::memory_order_relaxed); }
+auto inline count() -> std::uint64_t {
+  return counter.load(std::memory_order_relaxed);
 }
-}  // namespace helper
-namespace file {
-struct file_not_opened_exception : public std::exception {
-  const char *what() const throw() { return "File didn't open"; }
-};
-struct cannot_open_file_exception : public std::exception {
-  const char *what() const throw() {
-    return "Error while trying to process file";
-  }
-};
-
+}  // namespace allocations
+namespace parallel {
 /* --------------------------------------------------------------------------*/
 /**
- * @brief struct that's purpose to keep the state of the file
+ * @brief fixed set of worker threads that execute submitted tasks in the
+ * order they were submitted, threads that wait for their tasks help with the
+ * queue so tasks can be submitted from inside of other tasks
  */
 /* ----------------------------------------------------------------------------*/
-struct manage_file {
+struct thread_pool {
  private:
-  const std::string file_name;
-  std::vector<std::string> my_lines;
-  bool loaded;
+  std::mutex queue_mutex;
+  std::condition_variable task_ready;
+  std::deque<std::function<void()>> tasks;
+  std::vector<std::thread> workers;
+  bool stopping;
 
- public:
-  /* --------------------------------------------------------------------------*/
-  /**
-   * @brief Constructor that creates std::fstream with supplied file_name and
-   * reads each line from file to vector of strings
-   *
-   * @Param const std::string reference
-   */
-  /* ----------------------------------------------------------------------------*/
-  manage_file() : loaded(false){};
-  manage_file(const std::string &file_name) : file_name(file_name) {
-    std::fstream my_file(file_name);
-    try {
-      if (!my_file.is_open()) throw cannot_open_file_exception();
-      while (my_file.peek() != EOF) {
-        std::string row;
-        getline(my_file, row);
-        my_lines.push_back(std::move(row));
+  auto worker_loop() -> void {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        task_ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
       }
-
-      loaded = true;
-    } catch (cannot_open_file_exception &e) {
-      loaded = false;
-      if (my_file.good())
-        std::cerr << "There was an error when reading a file on line "
-                  << my_lines.size() << std::endl;
-      else
-        std::cerr << "Wrong file name was provided" << std::endl;
-      throw e;
+      task();
     }
   }
-  /* --------------------------------------------------------------------------*/
-  /**
-   * @brief returns std::vector<std::string> that contains all of the lines that
-   * are present in the file(including empty ones)
-   *
-   *
-   * @Returns std::vector<std::string>
-   */
-  /* ----------------------------------------------------------------------------*/
-  auto get_all_lines() const -> std::vector<std::string> {
-    if (!loaded) throw file_not_opened_exception();
-    return my_lines;
-  }
 
+ public:
   /* --------------------------------------------------------------------------*/
   /**
-   * @brief returns std::vector<std::string> that contains all of the words that
-   * are present in the file
-   *
+   * @brief creates pool that runs tasks on the given number of threads, the
+   * thread that waits for the tasks counts as one of them
    *
-   * @Returns std::vector<std::strings>
+   * @Param unsigned number of threads
    */
   /* ----------------------------------------------------------------------------*/
-  auto get_all_words() const -> std::vector<std::string> {
-    if (!loaded) throw file_not_opened_exception();
-    std::vector<std::string> all_words;
-    for (const auto &line : my_lines) {
-      std::istringstream buffer(line);
-      std::copy(std::istream_iterator<std::string>(buffer),
-                std::istream_iterator<std::string>(),
-                std::back_inserter(all_words));
+  explicit thread_pool(unsigned threads) : stopping(false) {
+    for (unsigned i = 1; i < threads; ++i)
+      workers.emplace_back([this] { worker_loop(); });
+  }
+  thread_pool(const thread_pool &) = delete;
+  auto operator=(const thread_pool &) -> thread_pool & = delete;
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      stopping = true;
     }
-    return all_words;
+    task_ready.notify_all();
+    for (auto &worker : workers) worker.join();
+  }
+  auto size() const -> unsigned { return workers.size() + 1; }
+  auto submit(std::function<void()> task) -> void {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      tasks.push_back(std::move(task));
+    }
+    task_ready.notify_one();
   }
   /* --------------------------------------------------------------------------*/
   /**
-   * @brief return number of lines
+   * @brief runs one queued task on the calling thread
    *
-   * @Returns long long
+   * @Returns bool false when the queue was empty
    */
   /* ----------------------------------------------------------------------------*/
-  auto get_lines_number() const -> long long {
-    if (!loaded) throw file_not_opened_exception();
-    return my_lines.size();
-  }
-};
-
-}  // namespace file
-namespace command {
-struct parssing_error_exception : public std::exception {
-  const char *what() const throw() { return "Error while parsing commands"; }
-};
-struct input_file_missing_exception : public std::exception {
-  const char *what() const throw() { return "Wrong input file provided"; }
-};
-
-struct input_flag_exception : public std::exception {
-  const char *what() const throw() {
-    return "-i should be the only specified flag";
+  auto run_one() -> bool {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (tasks.empty()) return false;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+    return true;
   }
 };
-auto manage_command(const std::vector<std::string> &command_vector,
-                    bool = false) -> void;
 
 /* --------------------------------------------------------------------------*/
 /**
- * @brief specifies number that is assigned to each flag
+ * @brief calls function(i) for every i in [0, count) on the pool and returns
+ * when all of the calls are finished, without the pool everything runs on the
+ * calling thread. First exception thrown by any of the calls is rethrown
+ *
+ * @Param thread_pool pointer (can be nullptr)
+ * @Param std::size_t count
+ * @Param function called with the index
  */
 /* ----------------------------------------------------------------------------*/
-std::unordered_map<std::string, int> flag_map = {
-    {"", 0},   {"-f", 1}, {"-i", 2}, {"-n", 3}, {"-d", 4},   {"-dd", 5},
-    {"-c", 6}, {"-a", 7}, {"-p", 8}, {"-s", 9}, {"-rs", 10}, {"-o", 11},
-};
+template <typename Function>
+auto for_each_index(thread_pool *pool, std::size_t count, Function function)
+    -> void {
+  if (!pool || pool->size() == 1 || count <= 1) {
+    for (std::size_t i = 0; i < count; ++i) function(i);
+    return;
+  }
+  struct group_state {
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t pending;
+    std::exception_ptr error;
+  } state;
+  state.pending = count;
+  auto run = [&state, &function](std::size_t index) {
+    std::exception_ptr error;
+    try {
+      function(index);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (error && !state.error) state.error = error;
+    if (--state.pending == 0) state.done.notify_all();
+  };
+  for (std::size_t i = 1; i < count; ++i) pool->submit([&run, i] { run(i); });
+  run(0);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(state.mutex);
+      if (state.pending == 0) break;
+    }
+    if (pool->run_one()) continue;
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.done.wait_for(lock, std::chrono::milliseconds(1),
+                        [&state] { return state.pending == 0; });
+  }
+  if (state.error) std::rethrow_exception(state.error);
+}
+
 /* --------------------------------------------------------------------------*/
 /**
- * @brief specifies aliasses for commands
+ * @brief splits text to at most pieces chunks of similar size, every chunk
+ * except the last one ends right after a byte for which is_boundary returns
+ * true so no chunk starts in the middle of a line or a word
+ *
+ * @Param std::string_view
+ * @Param std::size_t number of pieces
+ * @Param predicate that marks the byte after which the chunk can end
+ *
+ * @Returns std::vector<std::string_view>
  */
 /* ----------------------------------------------------------------------------*/
-std::unordered_map<std::string, std::string> alias_map = {
-    {"--help", ""},
-    {"--file", "-f"},
-    {"--input", "-i"},
-    {"--newlines", "-n"},
-    {"--digits", "-d"},
-    {"--numbers", "-dd"},
-    {"--chars", "-c"},
-    {"--angrams", "-a"},
-    {"--palindroms", "-p"},
-    {"--sorted", "-s"},
-    {"--reverse-sorted", "-rs"},
-    {"--output", "-o"},
-};
+template <typename Predicate>
+auto split_chunks(std::string_view text, std::size_t pieces,
+                  Predicate is_boundary) -> std::vector<std::string_view> {
+  std::vector<std::string_view> chunks;
+  std::size_t begin = 0;
+  for (std::size_t i = 1; i <= pieces && begin < text.size(); ++i) {
+    std::size_t end = i == pieces ? text.size() : text.size() / pieces * i;
+    if (end < begin) end = begin;
+    while (end < text.size() && !is_boundary(text[end])) ++end;
+    if (end < text.size()) ++end;
+    chunks.push_back(text.substr(begin, end - begin));
+    begin = end;
+  }
+  return chunks;
+}
+}  // namespace parallel
+namespace unicode {
 /* --------------------------------------------------------------------------*/
 /**
- * @brief prints help text to the console
- *
+ * @brief how words are compared: bytes is the default, utf8 compares
+ * characters made of codepoints and utf8_folded also ignores case of letters
  */
 /* ----------------------------------------------------------------------------*/
-auto print_help() -> void {
-  const char *text =
-      "-----help-------\n"
-      "This program needs to be specified with first flag -f and file name or "
-      "just with the flag -i and name of the input file\n"
-      "flag [||--help] shows this help menu\n"
-      "flag [-f||--file] \"file_name\" specify the file that will be used for "
-      "the rest of the program\n"
-      "flag [-i||--input] \"file_name\" !!!should be the only specified flag "
-      "in program!!! specify the file name that have a file "
-      "with flags for the program \n"
-      "flag [-n||--newlines] will output number of lines that are in the file\n"
-      "flag [-d||--digits] will output number of digits in a file\n"
-      "flag [-dd||--numbers] will output number of numbers in a file\n"
-      "flag [-a||--anagrams] \"words words\" should be the last specified flag "
-      "and after the flag all the words in the file will be checked against "
-      "anagrams and the ones that match will be outputted\n"
-      "flag [-p||--palindroms] \"words words\" should be the last specified "
-      "flag and after the flag all the words that are palindroms and are in "
-      "the file will be outputted\n"
-      "flag [-s||--sorted] outputs all the words that are in the file in "
-      "alphabetical order\n"
-      "flag [-rs||--reverse-sorted] outputs all the words that are in the file "
-      "in reversed alphabetical order\n"
-      "flag [-o||--output] \"output_file_name\" outputs of the command are "
-      "saved in specified file\n";
-  std::cout << text << std::endl;
-}
-/* --------------------------------------------------------------------------*/
-/**
- * @brief opens specified file and returns file::manage_file object that is used
- * for other commands
+enum class text_mode : std::uint8_t { bytes, utf8, utf8_folded };
+using ascii_function = bool (*)(const char *, std::size_t);
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checks 8 bytes at a time if no byte of the text has the highest bit
+ * set, used for short texts and when no vector unit is available
  *
- * @Param const std::string reference
+ * @Param const char pointer
+ * @Param std::size_t size
  *
- * @Returns  file::manage_file
+ * @Returns bool
  */
 /* ----------------------------------------------------------------------------*/
-auto inline file_flag(const std::string &file_name)
-    -> std::unique_ptr<file::manage_file> {
-  return std::make_unique<file::manage_file>(file_name);
+inline auto ascii_scalar(const char *text, std::size_t size) -> bool {
+  std::uint64_t high = 0;
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, text + i, 8);
+    high |= word;
+  }
+  for (; i < size; ++i) high |= static_cast<unsigned char>(text[i]);
+  return !(high & 0x8080808080808080ull);
 }
+#if defined(__x86_64__) || defined(__i386__)
 /* --------------------------------------------------------------------------*/
 /**
- * @brief takes the name of file and treats lines in the file as command with
- * specified flags
+ * @brief checks 64 bytes at a time, the highest bits of all bytes are
+ * collected with one movemask and the check stops at the first block that has
+ * any of them
  *
- * @Param const std::string reference
+ * @Param const char pointer
+ * @Param std::size_t size
  *
- * @Returns
+ * @Returns bool
  */
 /* ----------------------------------------------------------------------------*/
-auto input_flag(const std::string &input_file_name) -> void {
-  std::unique_ptr<file::manage_file> input_file;
-  try {
-    input_file = std::make_unique<file::manage_file>(input_file_name);
-  } catch (std::exception &e) {
-    throw input_file_missing_exception();
+__attribute__((target("sse2"))) inline auto ascii_sse2(const char *text,
+                                                       std::size_t size)
+    -> bool {
+  std::size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    auto load = [text, i](std::size_t at) {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i + at));
+    };
+    __m128i const high = _mm_or_si128(_mm_or_si128(load(0), load(16)),
+                                      _mm_or_si128(load(32), load(48)));
+    if (_mm_movemask_epi8(high)) return false;
   }
-
-  try {
-    auto input_command_vector = (*input_file).get_all_lines();
-    for (const auto &line : input_command_vector) {
-      std::vector<std::string> all_flags;
-      std::istringstream buffer(line);
-      std::copy(std::istream_iterator<std::string>(buffer),
-                std::istream_iterator<std::string>(),
-                std::back_inserter(all_flags));
-      manage_command(all_flags, true);
-    }
-  } catch (std::exception &e) {
-    std::cerr << "Error while using command from input file\n";
+  return ascii_scalar(text + i, size - i);
+}
+__attribute__((target("avx2"))) inline auto ascii_avx2(const char *text,
+                                                       std::size_t size)
+    -> bool {
+  std::size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m256i const high = _mm256_or_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i + 32)));
+    if (_mm256_movemask_epi8(high)) return false;
   }
-};
+  return ascii_scalar(text + i, size - i);
+}
+#endif
 /* --------------------------------------------------------------------------*/
 /**
- * @brief writes number of lines that are in the specified file argument to the
- * specified std::stringstrea output_stream
- *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
+ * @brief picks the widest ascii check that is supported by the cpu
  *
- * @Returns
+ * @Returns unicode::ascii_function
  */
 /* ----------------------------------------------------------------------------*/
-auto newline_flag(std::stringstream &output_stream,
-                  const file::manage_file &file) -> void {
-  output_stream << "Lines in file: " << file.get_lines_number() << "\n";
+inline auto select_ascii_check() -> ascii_function {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return ascii_avx2;
+  if (__builtin_cpu_supports("sse2")) return ascii_sse2;
+#endif
+  return ascii_scalar;
 }
+inline const ascii_function check_ascii = select_ascii_check();
 /* --------------------------------------------------------------------------*/
 /**
- * @brief writes number of digits that are in the specified file argument to the
- * specified std::stringstrea output_stream
+ * @brief checks if every byte of the text is ascii, such text is handled by
+ * the byte functions because every byte is one character
  *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
+ * @Param std::string_view
  *
- * @Returns
+ * @Returns bool
  */
 /* ----------------------------------------------------------------------------*/
-auto digits_flag(std::stringstream &output_stream,
-                 const file::manage_file &file) -> void {
-  long counter = 0;
-  std::regex const digit("(\\d)");
-  for (const auto &line : file.get_all_lines()) {
-    counter += helper::count_all(digit, line);
-  };
-  output_stream << "Digits in file: " << counter << std::endl;
+inline auto is_ascii(std::string_view text) -> bool {
+  if (text.size() < 64) return ascii_scalar(text.data(), text.size());
+  return check_ascii(text.data(), text.size());
 }
 /* --------------------------------------------------------------------------*/
 /**
- * @brief writes number of numbers that are in the specified file argument to
- * the specified std::stringstrea output_stream
+ * @brief value that a byte which is not part of valid UTF-8 decodes to, lone
+ * surrogates are never decoded from valid UTF-8 so invalid bytes stay
+ * different from every character and from each other
  *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
+ * @Param unsigned char
  *
- * @Returns
+ * @Returns char32_t
  */
 /* ----------------------------------------------------------------------------*/
-auto numbers_flag(std::stringstream &output_stream,
-                  const file::manage_file &file) -> void {
-  long counter = 0;
-  std::regex const digit("(^\\d+$)");
-  for (const auto &word : file.get_all_words()) {
-    counter += helper::count_all(digit, word);
-  };
-  output_stream << "Numbers in file: " << counter << std::endl;
-}
+constexpr auto escape(unsigned char byte) -> char32_t { return 0xdc00 | byte; }
 /* --------------------------------------------------------------------------*/
 /**
- * @brief writes number of chars that are in the specified file argument to the
- * specified std::stringstrea output_stream
+ * @brief decodes the codepoint at the position and moves the position after
+ * it. Overlong forms, surrogates and truncated sequences are not valid, their
+ * first byte is decoded with escape and the position moves by one byte
  *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
+ * @Param const char pointer reference
+ * @Param const char pointer to the end of the text
  *
- * @Returns
+ * @Returns char32_t
  */
 /* ----------------------------------------------------------------------------*/
-auto chars_flag(std::stringstream &output_stream, const file::manage_file &file)
-    -> void {
-  long counter = 0;
-  for (const auto &line : file.get_all_lines()) {
-    for (const auto &c : line) counter++;
-    counter++;
+inline auto decode(const char *&position, const char *end) -> char32_t {
+  unsigned char const lead = *position++;
+  if (lead < 0x80) return lead;
+  std::ptrdiff_t length;
+  char32_t value, minimum;
+  if (lead >= 0xc2 && lead <= 0xdf) {
+    length = 1, value = lead & 0x1f, minimum = 0x80;
+  } else if ((lead & 0xf0) == 0xe0) {
+    length = 2, value = lead & 0x0f, minimum = 0x800;
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    length = 3, value = lead & 0x07, minimum = 0x10000;
+  } else {
+    return escape(lead);
+  }
+  if (end - position < length) return escape(lead);
+  for (std::ptrdiff_t i = 0; i < length; ++i) {
+    unsigned char const next = position[i];
+    if ((next & 0xc0) != 0x80) return escape(lead);
+    value = value << 6 | (next & 0x3f);
   }
-  output_stream << "Chars in file: " << counter << std::endl;
+  if (value < minimum || value > 0x10ffff ||
+      (value >= 0xd800 && value <= 0xdfff))
+    return escape(lead);
+  position += length;
+  return value;
 }
 /* --------------------------------------------------------------------------*/
 /**
- * @brief outputs to output_stream words that are found in file and are anagrams
- * in the specified iterator range
- *
- *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
- * @Param iterator reference
- * @Param const iterator reference
+ * @brief appends UTF-8 form of the codepoint to the text, escaped bytes are
+ * written back as they were
  *
- * @Returns
+ * @Param std::string reference
+ * @Param char32_t
  */
 /* ----------------------------------------------------------------------------*/
-template <typename It>
-auto anagrams_flag(std::stringstream &output_stream,
-                   const file::manage_file &file, It &word_iterator,
-                   const It &end_iterator) -> void {
-  output_stream << "Anagrams Found: " << std::endl;
-  word_iterator++;
-  std::vector<std::string> anagrams;
-  while (word_iterator != end_iterator) {
-    std::string anagram(*word_iterator);
-    std::sort(anagram.begin(), anagram.end());
-    anagrams.push_back(anagram);
-    word_iterator++;
-  }
-  for (const auto &word : file.get_all_words()) {
-    for (const auto &anagram : anagrams) {
-      if (helper::is_anagram_optimized(word, anagram))
-        output_stream << word << std::endl;
-    }
+inline auto append(std::string &text, char32_t codepoint) -> void {
+  if (codepoint < 0x80 || (codepoint >= 0xdc80 && codepoint <= 0xdcff)) {
+    text.push_back(static_cast<char>(codepoint & 0xff));
+  } else if (codepoint < 0x800) {
+    text.push_back(static_cast<char>(0xc0 | codepoint >> 6));
+    text.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+  } else if (codepoint < 0x10000) {
+    text.push_back(static_cast<char>(0xe0 | codepoint >> 12));
+    text.push_back(static_cast<char>(0x80 | (codepoint >> 6 & 0x3f)));
+    text.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+  } else {
+    text.push_back(static_cast<char>(0xf0 | codepoint >> 18));
+    text.push_back(static_cast<char>(0x80 | (codepoint >> 12 & 0x3f)));
+    text.push_back(static_cast<char>(0x80 | (codepoint >> 6 & 0x3f)));
+    text.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
   }
 }
 /* --------------------------------------------------------------------------*/
 /**
- * @brief outputs to output_stream words that are found in file and are
- * palindroms in the specified iterator range
- *
+ * @brief checks if the codepoint has the White_Space property of Unicode
  *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
- * @Param iterator reference
- * @Param const iterator reference
+ * @Param char32_t
  *
- * @Returns
+ * @Returns bool
  */
 /* ----------------------------------------------------------------------------*/
-template <typename It>
-auto palindroms_flag(std::stringstream &output_stream,
-                     const file::manage_file &file, It &word_iterator,
-                     const It &end_iterator) -> void {
-  word_iterator++;
-  auto palindrom_set = helper::palindroms(word_iterator, end_iterator);
-  output_stream << "Palindroms found: " << std::endl;
-  for (const auto &word : file.get_all_words()) {
-    if (palindrom_set.contains(word)) output_stream << word << std::endl;
-  }
+constexpr auto is_space(char32_t c) -> bool {
+  return c == ' ' || (c >= '\t' && c <= '\r') || c == 0x85 || c == 0xa0 ||
+         c == 0x1680 || (c >= 0x2000 && c <= 0x200a) || c == 0x2028 ||
+         c == 0x2029 || c == 0x202f || c == 0x205f || c == 0x3000;
 }
-
 /* --------------------------------------------------------------------------*/
 /**
- * @brief outputs to the output_stream sorted words that are present in the file
- * in the alphabetical order
+ * @brief checks if the codepoint belongs to the character before it:
+ * combining marks, variation selectors, joiners and skin tone modifiers
  *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
+ * @Param char32_t
  *
- * @Returns
+ * @Returns bool
  */
 /* ----------------------------------------------------------------------------*/
-auto sorted_flag(std::stringstream &output_stream,
-                 const file::manage_file &file) -> void {
-  std::vector<std::string> sorted = file.get_all_words();
-  std::sort(sorted.begin(), sorted.end());
-  for (const auto &word : sorted) output_stream << word << std::endl;
+constexpr auto is_extending(char32_t c) -> bool {
+  if (c < 0x300) return false;
+  return c <= 0x36f || (c >= 0x483 && c <= 0x489) ||
+         (c >= 0x591 && c <= 0x5bd) || (c >= 0x610 && c <= 0x61a) ||
+         (c >= 0x64b && c <= 0x65f) || c == 0x670 ||
+         (c >= 0x6d6 && c <= 0x6dc) || (c >= 0x900 && c <= 0x903) ||
+         (c >= 0x93a && c <= 0x93c) || (c >= 0x93e && c <= 0x94f) ||
+         (c >= 0x951 && c <= 0x957) || c == 0xe31 ||
+         (c >= 0xe34 && c <= 0xe3a) || (c >= 0xe47 && c <= 0xe4e) ||
+         (c >= 0x1ab0 && c <= 0x1aff) || (c >= 0x1dc0 && c <= 0x1dff) ||
+         c == 0x200c || c == 0x200d || (c >= 0x20d0 && c <= 0x20ff) ||
+         (c >= 0xfe00 && c <= 0xfe0f) || (c >= 0xfe20 && c <= 0xfe2f) ||
+         (c >= 0x1f3fb && c <= 0x1f3ff) || (c >= 0xe0100 && c <= 0xe01ef);
 }
 /* --------------------------------------------------------------------------*/
 /**
- * @brief outputs to the output_stream sorted words that are present in the file
- * in the reversed alphabetical order
+ * @brief simple case folding of Latin, Greek, Cyrillic and Armenian letters
+ * and of fullwidth Latin letters, every other codepoint is returned as it is
  *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
+ * @Param char32_t
  *
- * @Returns
+ * @Returns char32_t lower case form of the codepoint
  */
 /* ----------------------------------------------------------------------------*/
-auto reverse_sorted_flag(std::stringstream &output_stream,
-                         const file::manage_file &file) -> void {
-  std::vector<std::string> sorted = file.get_all_words();
-  std::sort(sorted.rbegin(), sorted.rend());
-  for (const auto &word : sorted) output_stream << word << std::endl;
+constexpr auto fold_case(char32_t c) -> char32_t {
+  if (c < 0x80) return c >= 'A' && c <= 'Z' ? c + 32 : c;
+  if (c < 0x100) return c >= 0xc0 && c <= 0xde && c != 0xd7 ? c + 32 : c;
+  if (c < 0x180) {
+    if (c == 0x130 || c == 0x138 || c == 0x149) return c;
+    if (c == 0x178) return 0xff;
+    bool const odd_upper =
+        (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17e);
+    return c % 2 == (odd_upper ? 1u : 0u) ? c + 1 : c;
+  }
+  if (c >= 0x370 && c < 0x400) {
+    if (c >= 0x391 && c <= 0x3a9 && c != 0x3a2) return c + 0x20;
+    if (c == 0x386) return 0x3ac;
+    if (c >= 0x388 && c <= 0x38a) return c + 0x25;
+    if (c == 0x38c) return 0x3cc;
+    if (c == 0x38e || c == 0x38f) return c + 0x3f;
+    if (c == 0x3c2) return 0x3c3;
+    return c;
+  }
+  if (c >= 0x400 && c < 0x530) {
+    if (c < 0x410) return c + 0x50;
+    if (c < 0x430) return c + 0x20;
+    if (c == 0x4c0) return 0x4cf;
+    if (c >= 0x4c1 && c <= 0x4ce) return c % 2 ? c + 1 : c;
+    if ((c >= 0x460 && c <= 0x481) || (c >= 0x48a && c <= 0x4bf) ||
+        c >= 0x4d0)
+      return c % 2 ? c : c + 1;
+    return c;
+  }
+  if (c >= 0x531 && c <= 0x556) return c + 0x30;
+  if (c >= 0x1e00 && c <= 0x1eff) {
+    if (c == 0x1e9e) return 0xdf;
+    if (c <= 0x1e95 || c >= 0x1ea0) return c % 2 ? c : c + 1;
+    return c;
+  }
+  if (c >= 0xff21 && c <= 0xff3a) return c + 0x20;
+  return c;
 }
 /* --------------------------------------------------------------------------*/
 /**
- * @brief specifies file for the output_stream with the specifed file_name
+ * @brief calls function with every word of the text, words are separated by
+ * Unicode whitespace. Whitespace below 0x80 is one byte so ascii text is
+ * split the same way as by helper::is_space
  *
- * @Param std::stringstream reference
- * @Param const file::manage_file reference
- *
- * @Returns
+ * @Param std::string_view
+ * @Param function callable with std::string_view
  */
 /* ----------------------------------------------------------------------------*/
-auto output_flag(std::ostream *&out, const std::string &file_name) -> void {
-  out = new std::fstream(file_name);
-  if (!out->good())
-    dynamic_cast<std::fstream *>(out)->open(file_name, std::fstream::out);
-};
-
+template <typename Function>
+auto for_each_word(std::string_view text, Function function) -> void {
+  const char *position = text.data();
+  const char *end = text.data() + text.size();
+  const char *word_begin = position;
+  while (position != end) {
+    const char *character = position;
+    if (!is_space(decode(position, end))) continue;
+    if (word_begin != character)
+      function(std::string_view(word_begin, character - word_begin));
+    word_begin = position;
+  }
+  if (word_begin != end)
+    function(std::string_view(word_begin, end - word_begin));
+}
 /* --------------------------------------------------------------------------*/
 /**
- * @brief checks if first argument iterator is not the last item in vector
+ * @brief writes the text with every letter folded to lower case, ascii text
+ * is folded byte by byte without decoding
  *
- * @Param iterator reference
- * @Param const iterator reference
- *
- * @Returns
+ * @Param std::string_view
+ * @Param std::string reference that is overwritten
  */
 /* ----------------------------------------------------------------------------*/
-template <typename It>
-auto increment_iterator(It &increment_iterator, const It &end_iterator)
-    -> void {
-  ++increment_iterator;
-  if (increment_iterator == end_iterator) throw parssing_error_exception();
+inline auto fold_word(std::string_view word, std::string &folded) -> void {
+  folded.clear();
+  if (is_ascii(word)) {
+    for (const char c : word) folded.push_back(char(fold_case(c)));
+    return;
+  }
+  const char *position = word.data();
+  const char *end = word.data() + word.size();
+  while (position != end) append(folded, fold_case(decode(position, end)));
 }
 /* --------------------------------------------------------------------------*/
 /**
- * @brief Command parser per say it manages the flow of the command flags
- *
- * @Param const std::vector<std::string> reference
- *
- * @Returns
+ * @brief user perceived characters of the text: a character is a codepoint
+ * with the combining marks and joined codepoints that follow it. Buffers are
+ * reused between calls so repeated calls don't allocate
  */
 /* ----------------------------------------------------------------------------*/
-auto manage_command(const std::vector<std::string> &command_vector, bool input)
-    -> void {
-  if (command_vector.size() == 0 || command_vector[0].at(0) != '-')
-    print_help();
-  std::unique_ptr<file::manage_file> my_file;
-  std::stringstream flags_output;
-  std::string output_file;
-  std::ostream *out = &std::cout;
-  auto command_iterator = command_vector.begin();
-  auto command_end = command_vector.end();
-  bool output_to_console = true;
-  try {
-    while (command_iterator != command_end) {
-      int flag_number = 0;
-      std::string flag_string = *command_iterator;
-      if (alias_map.contains(flag_string)) flag_string = alias_map[flag_string];
+struct graphemes {
+ private:
+  std::u32string codepoints;
+  std::vector<std::size_t> boundaries;
 
-      if (flag_map.contains(flag_string))
-        flag_number = flag_map[flag_string];
-      else
-        throw parssing_error_exception();
-      switch (flag_number) {
-        case 0:
-          print_help();
-          break;
-        case 1:
-          increment_iterator(command_iterator, command_end);
-          my_file = file_flag(*command_iterator);
-          break;
-        case 2:
-          increment_iterator(command_iterator, command_end);
+ public:
+  std::vector<std::u32string_view> characters;
+  std::vector<std::size_t> offsets;
+
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief splits the text to characters, offsets[i] is the byte where
+   * character i starts in the text and the last offset is size of the text
+   *
+   * @Param std::string_view
+   * @Param bool fold every codepoint to lower case
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto split(std::string_view text, bool fold) -> void {
+    codepoints.clear();
+    boundaries.clear();
+    characters.clear();
+    offsets.clear();
+    const char *position = text.data();
+    const char *end = text.data() + text.size();
+    bool joined = false;
+    while (position != end) {
+      std::size_t const offset = position - text.data();
+      char32_t const codepoint = decode(position, end);
+      if (codepoints.empty() || !(joined || is_extending(codepoint))) {
+        boundaries.push_back(codepoints.size());
+        offsets.push_back(offset);
+      }
+      joined = codepoint == 0x200d;
+      codepoints.push_back(fold ? fold_case(codepoint) : codepoint);
+    }
+    boundaries.push_back(codepoints.size());
+    offsets.push_back(text.size());
+    for (std::size_t i = 0; i + 1 < boundaries.size(); ++i)
+      characters.emplace_back(codepoints.data() + boundaries[i],
+                              boundaries[i + 1] - boundaries[i]);
+  }
+};
+}  // namespace unicode
+namespace helper {
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief counts all occurences of std::regex expresion in  given string and
+ * returns counter of occurences at the end of the function
+ *
+ * @Param const std::regex reference
+ * @Param const std::string reference
+ *
+ * @Returns  long
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline count_all(const std::regex &expression, std::string_view to_check)
+    -> long {
+  long const match_count(
+      std::distance(std::cregex_iterator(to_check.data(),
+                                         to_check.data() + to_check.size(),
+                                         expression),
+                    std::cregex_iterator()));
+  return match_count;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief transparent hash so that sets of std::string can be probed with
+ * std::string_view without building a temporary std::string
+ */
+/* ----------------------------------------------------------------------------*/
+struct string_hash {
+  using is_transparent = void;
+  auto operator()(std::string_view word) const -> std::size_t {
+    return std::hash<std::string_view>{}(word);
+  }
+};
+using string_set =
+    std::unordered_set<std::string, string_hash, std::equal_to<>>;
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief function that checks if given string is palindrome, bytes are
+ * compared in place from both ends
+ *
+ * @Param std::string_view
+ *
+ * @Returns bool
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr auto check_if_palindrome(std::string_view word) -> bool {
+  for (std::size_t i = 0, j = word.size(); i + 1 < j; ++i, --j)
+    if (word[i] != word[j - 1]) return false;
+  return true;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checks if given word is palindrome in the text mode, ascii words are
+ * compared byte by byte and other words character by character
+ *
+ * @Param std::string_view
+ * @Param unicode::text_mode
+ *
+ * @Returns bool
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto check_if_palindrome(std::string_view word, unicode::text_mode mode)
+    -> bool {
+  bool const fold = mode == unicode::text_mode::utf8_folded;
+  if (mode == unicode::text_mode::bytes ||
+      (!fold && unicode::is_ascii(word)))
+    return check_if_palindrome(word);
+  if (unicode::is_ascii(word)) {
+    for (std::size_t i = 0, j = word.size(); i + 1 < j; ++i, --j)
+      if (unicode::fold_case(word[i]) != unicode::fold_case(word[j - 1]))
+        return false;
+    return true;
+  }
+  thread_local unicode::graphemes characters;
+  characters.split(word, fold);
+  return std::equal(characters.characters.begin(),
+                    characters.characters.begin() +
+                        characters.characters.size() / 2,
+                    characters.characters.rbegin());
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief radii of all palindromes of the text found with Manacher's algorithm
+ * in O(n): odd[i] is the number of odd palindromes centered at i (the longest
+ * one has length 2 * odd[i] - 1), even[i] is the number of even palindromes
+ * whose right half starts at i (the longest one has length 2 * even[i]).
+ * Text can be bytes or any other sequence, like characters of
+ * unicode::graphemes. Vectors are reused between calls so repeated calls
+ * don't allocate
+ */
+/* ----------------------------------------------------------------------------*/
+struct palindrome_radii {
+  std::vector<std::uint32_t> odd;
+  std::vector<std::uint32_t> even;
+  unicode::graphemes characters;
+  std::string folded;
+  bool of_characters = false;
+
+  template <typename Text>
+  auto compute(const Text &text) -> void {
+    of_characters = false;
+    std::ptrdiff_t const n = text.size();
+    odd.resize(n);
+    even.resize(n);
+    for (std::ptrdiff_t i = 0, left = 0, right = -1; i < n; ++i) {
+      std::ptrdiff_t k =
+          i > right ? 1
+                    : std::min<std::ptrdiff_t>(odd[left + right - i],
+                                               right - i + 1);
+      while (i - k >= 0 && i + k < n && text[i - k] == text[i + k]) ++k;
+      odd[i] = k;
+      if (i + k - 1 > right) {
+        left = i - k + 1;
+        right = i + k - 1;
+      }
+    }
+    for (std::ptrdiff_t i = 0, left = 0, right = -1; i < n; ++i) {
+      std::ptrdiff_t k =
+          i > right ? 0
+                    : std::min<std::ptrdiff_t>(even[left + right - i + 1],
+                                               right - i + 1);
+      while (i - k - 1 >= 0 && i + k < n && text[i - k - 1] == text[i + k])
+        ++k;
+      even[i] = k;
+      if (i + k - 1 > right) {
+        left = i - k;
+        right = i + k - 1;
+      }
+    }
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief computes radii of the text in the text mode, ascii text is
+   * computed on its bytes (folded to lower case with utf8_folded) and other
+   * text on its characters
+   *
+   * @Param std::string_view
+   * @Param unicode::text_mode
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto compute(std::string_view text, unicode::text_mode mode) -> void {
+    if (mode == unicode::text_mode::bytes) return compute(text);
+    bool const fold = mode == unicode::text_mode::utf8_folded;
+    if (unicode::is_ascii(text)) {
+      if (!fold) return compute(text);
+      unicode::fold_word(text, folded);
+      return compute(folded);
+    }
+    characters.split(text, fold);
+    compute(characters.characters);
+    of_characters = true;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns the longest palindromic substring of the text the radii
+   * were computed for, the first one when there are more of the same length
+   *
+   * @Param std::string_view the same text that was given to compute
+   *
+   * @Returns std::string_view
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto longest(std::string_view text) const -> std::string_view {
+    auto const [begin, length] = longest_range();
+    if (!of_characters) return text.substr(begin, length);
+    return text.substr(characters.offsets[begin],
+                       characters.offsets[begin + length] -
+                           characters.offsets[begin]);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns position and length of the longest palindromic part of the
+   * sequence the radii were computed for
+   *
+   * @Returns std::pair<std::size_t, std::size_t>
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto longest_range() const -> std::pair<std::size_t, std::size_t> {
+    std::size_t begin = 0, length = 0;
+    auto consider = [&begin, &length](std::size_t candidate_begin,
+                                      std::size_t candidate_length) {
+      if (candidate_length > length ||
+          (candidate_length == length && candidate_begin < begin)) {
+        begin = candidate_begin;
+        length = candidate_length;
+      }
+    };
+    for (std::size_t i = 0; i < odd.size(); ++i) {
+      consider(i - even[i], 2 * std::size_t(even[i]));
+      consider(i + 1 - odd[i], 2 * std::size_t(odd[i]) - 1);
+    }
+    return {begin, length};
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns number of palindromic substrings (every position counts)
+   *
+   * @Returns long long
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto count() const -> long long {
+    long long total = 0;
+    for (std::size_t i = 0; i < odd.size(); ++i) total += odd[i] + even[i];
+    return total;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief from the given iterator range checks if word is palindrom if yes
+ * it's added to the helper::string_set that is returned at the end of
+ * function, with unicode::text_mode::utf8_folded words are added folded to
+ * lower case
+ *
+ * @Param reference to iterator
+ * @Param const reference to iterator
+ * @Param unicode::text_mode
+ *
+ * @Returns helper::string_set
+ */
+/* ----------------------------------------------------------------------------*/
+template <class It>
+auto palindroms(It &begin_iterator, const It &end_iterator,
+                unicode::text_mode mode = unicode::text_mode::bytes)
+    -> string_set {
+  string_set palindrom_set;
+  std::string folded;
+  while (begin_iterator != end_iterator) {
+    if (check_if_palindrome(*begin_iterator, mode)) {
+      if (mode == unicode::text_mode::utf8_folded) {
+        unicode::fold_word(*begin_iterator, folded);
+        palindrom_set.insert(folded);
+      } else {
+        palindrom_set.insert(*begin_iterator);
+      }
+    }
+    ++begin_iterator;
+  }
+  return palindrom_set;
+}
+auto change_line_to_words(const std::vector<std::string> &lines)
+    -> std::vector<std::string> {
+  for (const auto &line : lines) {
+    std::vector<std::string> all_flags;
+    std::istringstream buffer(line);
+    std::copy(std::istream_iterator<std::string>(buffer),
+              std::istream_iterator<std::string>(),
+              std::back_inserter(all_flags));
+  }
+  // TODO: yield -> create generator so called Input Iterator
+  return lines;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checks if the byte is whitespace the same way std::istream does it in
+ * the default "C" locale
+ *
+ * @Param char
+ *
+ * @Returns bool
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr auto is_space(char c) -> bool {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+template <typename T>
+auto print_vector(const std::vector<T> &vec) {
+  for (const auto &e : vec) std::cout << e << std::endl;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes to signature canonical form of the word that is the same for
+ * the word and all of its anagrams (bytes of the word in sorted order), long
+ * words are sorted with counting sort
+ *
+ * @Param std::string_view
+ * @Param std::string reference that is overwritten with the signature
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline anagram_signature(std::string_view word, std::string &signature)
+    -> void {
+  signature.assign(word);
+  if (word.size() <= 64) {
+    std::sort(signature.begin(), signature.end());
+    return;
+  }
+  std::size_t histogram[256] = {};
+  for (const char c : word) ++histogram[static_cast<unsigned char>(c)];
+  auto position = signature.begin();
+  for (std::size_t byte = 0; byte < 256; ++byte)
+    position = std::fill_n(position, histogram[byte], static_cast<char>(byte));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief anagram_signature in the text mode. Ascii words have the byte
+ * signature (folded to lower case first with utf8_folded), other words are
+ * split to characters that are sorted and written as codepoints of 4 bytes
+ * with 0xffffffff after every character, so they never have the signature of
+ * an ascii word
+ *
+ * @Param std::string_view
+ * @Param std::string reference that is overwritten with the signature
+ * @Param unicode::text_mode
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline anagram_signature(std::string_view word, std::string &signature,
+                              unicode::text_mode mode) -> void {
+  bool const fold = mode == unicode::text_mode::utf8_folded;
+  if (mode == unicode::text_mode::bytes || unicode::is_ascii(word)) {
+    if (!fold) return anagram_signature(word, signature);
+    thread_local std::string folded;
+    unicode::fold_word(word, folded);
+    return anagram_signature(folded, signature);
+  }
+  thread_local unicode::graphemes characters;
+  characters.split(word, fold);
+  std::sort(characters.characters.begin(), characters.characters.end());
+  signature.clear();
+  char32_t const separator = 0xffffffff;
+  for (const auto character : characters.characters) {
+    signature.append(reinterpret_cast<const char *>(character.data()),
+                     character.size() * sizeof(char32_t));
+    signature.append(reinterpret_cast<const char *>(&separator),
+                     sizeof(char32_t));
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief index of words grouped by anagram_signature, for every signature it
+ * keeps positions of the words with that signature in the order they are in
+ * words. Every word is canonicalized once when the index is built and then
+ * each query is one hash lookup
+ */
+/* ----------------------------------------------------------------------------*/
+struct anagram_index {
+ private:
+  using position_map =
+      std::unordered_map<std::string, std::vector<std::size_t>, string_hash,
+                         std::equal_to<>>;
+  position_map positions;
+
+  template <typename Words>
+  static auto index_range(const Words &words, std::size_t begin,
+                          std::size_t end, unicode::text_mode mode,
+                          position_map &range_positions) -> void {
+    std::string signature;
+    for (std::size_t i = begin; i < end; ++i) {
+      anagram_signature(words[i], signature, mode);
+      auto found = range_positions.find(signature);
+      if (found == range_positions.end())
+        found = range_positions.emplace(signature, 0).first;
+      found->second.push_back(i);
+    }
+  }
+
+ public:
+  anagram_index() = default;
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief builds the index, with the pool ranges of words are indexed in
+   * parallel and merged in order so positions stay sorted
+   *
+   * @Param const reference to random access table of std::string_view words
+   * @Param parallel::thread_pool pointer (can be nullptr)
+   * @Param unicode::text_mode
+   */
+  /* ----------------------------------------------------------------------------*/
+  template <typename Words>
+  anagram_index(const Words &words, parallel::thread_pool *pool = nullptr,
+                unicode::text_mode mode = unicode::text_mode::bytes) {
+    std::size_t const ranges = pool ? pool->size() : 1;
+    if (ranges == 1) {
+      index_range(words, 0, words.size(), mode, positions);
+      return;
+    }
+    std::vector<position_map> range_positions(ranges);
+    parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+      index_range(words, words.size() * range / ranges,
+                  words.size() * (range + 1) / ranges, mode,
+                  range_positions[range]);
+    });
+    for (auto &range : range_positions) {
+      for (auto &[signature, range_list] : range) {
+        auto &list = positions[signature];
+        list.insert(list.end(), range_list.begin(), range_list.end());
+      }
+    }
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns positions of all words with given signature
+   *
+   * @Param std::string_view signature
+   *
+   * @Returns const std::vector<std::size_t> pointer, nullptr if there are none
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto find(std::string_view signature) const
+      -> const std::vector<std::size_t> * {
+    auto const found = positions.find(signature);
+    return found == positions.end() ? nullptr : &found->second;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief anagram signatures of the query words, each signature with the number
+ * of query words that have it
+ */
+/* ----------------------------------------------------------------------------*/
+struct anagram_queries {
+ private:
+  std::unordered_map<std::string, std::size_t, string_hash, std::equal_to<>>
+      signatures;
+  std::size_t longest;
+  unicode::text_mode mode;
+
+ public:
+  template <typename It>
+  anagram_queries(It begin_iterator, const It &end_iterator,
+                  unicode::text_mode mode = unicode::text_mode::bytes)
+      : longest(0), mode(mode) {
+    std::string signature;
+    for (; begin_iterator != end_iterator; ++begin_iterator) {
+      anagram_signature(*begin_iterator, signature, mode);
+      ++signatures[signature];
+      longest = std::max(longest, signature.size());
+    }
+  }
+  auto get_signatures() const -> const auto & { return signatures; }
+  auto get_longest() const -> std::size_t { return longest; }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns number of query words that the word is an anagram of
+   *
+   * @Param std::string_view
+   *
+   * @Returns std::size_t
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto operator()(std::string_view word) const -> std::size_t {
+    if (mode == unicode::text_mode::bytes && word.size() > longest) return 0;
+    thread_local std::string signature;
+    anagram_signature(word, signature, mode);
+    auto const found = signatures.find(signature);
+    return found == signatures.end() ? 0 : found->second;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief query words of --fuzzy with the largest edit distance (insertions,
+ * deletions and substitutions of bytes) that a word can have from one of them.
+ * Words up to 64 bytes are compared with the bit-parallel algorithm of Myers
+ * (global distance version of Hyyro) that keeps the whole column of the
+ * distance matrix in two machine words, so a word costs a few operations per
+ * byte instead of a row of the matrix per byte. Longer query words fall back
+ * to the matrix limited to a band of the width 2 * distance + 1 around the
+ * diagonal. Empty query words are skipped
+ */
+/* ----------------------------------------------------------------------------*/
+struct fuzzy_queries {
+ private:
+  struct query {
+    std::string word;
+    std::array<std::uint64_t, 256> equal;
+  };
+  std::vector<query> queries;
+  std::size_t distance;
+  std::size_t longest;
+
+  auto bit_parallel(const query &searched, std::string_view word) const
+      -> bool {
+    std::uint64_t const last = std::uint64_t(1) << (searched.word.size() - 1);
+    std::uint64_t positive = ~std::uint64_t(0);
+    std::uint64_t negative = 0;
+    std::size_t score = searched.word.size();
+    for (std::size_t i = 0; i < word.size(); ++i) {
+      std::uint64_t const equal =
+          searched.equal[static_cast<unsigned char>(word[i])];
+      std::uint64_t const vertical = equal | negative;
+      std::uint64_t const horizontal =
+          (((equal & positive) + positive) ^ positive) | equal;
+      std::uint64_t horizontal_positive = negative | ~(horizontal | positive);
+      std::uint64_t horizontal_negative = positive & horizontal;
+      if (horizontal_positive & last)
+        ++score;
+      else if (horizontal_negative & last)
+        --score;
+      // every byte that is left can lower the distance by one at most
+      if (score > distance + (word.size() - i - 1)) return false;
+      horizontal_positive = (horizontal_positive << 1) | 1;
+      horizontal_negative <<= 1;
+      positive = horizontal_negative | ~(vertical | horizontal_positive);
+      negative = horizontal_positive & vertical;
+    }
+    return score <= distance;
+  }
+  auto banded(std::string_view searched, std::string_view word) const
+      -> bool {
+    std::size_t const outside = distance + 1;
+    thread_local std::vector<std::size_t> row;
+    row.resize(searched.size() + 1);
+    for (std::size_t j = 0; j <= searched.size(); ++j)
+      row[j] = std::min(j, outside);
+    for (std::size_t i = 1; i <= word.size(); ++i) {
+      std::size_t const from = i > distance ? i - distance : 1;
+      std::size_t const to = std::min(searched.size(), i + distance);
+      std::size_t diagonal = row[from - 1];
+      row[from - 1] = from == 1 ? std::min(i, outside) : outside;
+      std::size_t smallest = row[from - 1];
+      for (std::size_t j = from; j <= to; ++j) {
+        std::size_t const above = row[j];
+        row[j] = std::min({above + 1, row[j - 1] + 1,
+                           diagonal + (word[i - 1] != searched[j - 1])});
+        row[j] = std::min(row[j], outside);
+        diagonal = above;
+        smallest = std::min(smallest, row[j]);
+      }
+      if (to < searched.size()) row[to + 1] = outside;
+      if (smallest > distance) return false;
+    }
+    return row[searched.size()] <= distance;
+  }
+
+ public:
+  template <typename It>
+  fuzzy_queries(It begin_iterator, const It &end_iterator,
+                std::size_t distance)
+      : distance(distance), longest(0) {
+    for (; begin_iterator != end_iterator; ++begin_iterator) {
+      if (std::string_view(*begin_iterator).empty()) continue;
+      query &added = queries.emplace_back();
+      added.word = *begin_iterator;
+      added.equal.fill(0);
+      if (added.word.size() <= 64)
+        for (std::size_t i = 0; i < added.word.size(); ++i)
+          added.equal[static_cast<unsigned char>(added.word[i])] |=
+              std::uint64_t(1) << i;
+      longest = std::max(longest, added.word.size());
+    }
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns length of the longest word that can be matched
+   *
+   * @Returns std::size_t
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_longest() const -> std::size_t { return longest + distance; }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns 1 if the word is within the distance of any query word,
+   * query words whose length differs by more than the distance are skipped
+   *
+   * @Param std::string_view
+   *
+   * @Returns std::size_t
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto operator()(std::string_view word) const -> std::size_t {
+    for (const auto &searched : queries) {
+      std::size_t const size = searched.word.size();
+      if (word.size() > size + distance || size > word.size() + distance)
+        continue;
+      if (size <= 64 ? bit_parallel(searched, word)
+                     : banded(searched.word, word))
+        return 1;
+    }
+    return 0;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief number of occurences of every distinct word, open addressing hash
+ * table with linear probing over views of the words. Slot keeps the view, part
+ * of the hash and the count together so a probe usually touches one cache
+ * line and most mismatches are rejected without comparing the words. Memory
+ * is proportional to the number of distinct words
+ */
+/* ----------------------------------------------------------------------------*/
+struct word_counts {
+ private:
+  struct slot {
+    const char *data;
+    std::uint32_t length;
+    std::uint32_t tag;
+    std::uint64_t count;
+  };
+  std::vector<slot> slots;
+  std::size_t used;
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> copies;
+
+  auto grow() -> void {
+    std::vector<slot> old(std::max<std::size_t>(16, slots.size() * 2),
+                          slot{nullptr, 0, 0, 0});
+    old.swap(slots);
+    used = 0;
+    for (const auto &moved : old)
+      if (moved.count)
+        insert(std::string_view(moved.data, moved.length), moved.count,
+               moved.tag, false);
+  }
+  auto insert(std::string_view word, std::uint64_t times, std::uint32_t tag,
+              bool copy) -> void {
+    std::size_t const mask = slots.size() - 1;
+    for (std::size_t position = tag & mask;; position = (position + 1) & mask) {
+      slot &probed = slots[position];
+      if (!probed.count) {
+        const char *data = word.data();
+        if (copy) {
+          if (!copies)
+            copies = std::make_unique<std::pmr::monotonic_buffer_resource>();
+          char *copied = static_cast<char *>(copies->allocate(word.size(), 1));
+          std::memcpy(copied, word.data(), word.size());
+          data = copied;
+        }
+        probed = {data, std::uint32_t(word.size()), tag, times};
+        ++used;
+        return;
+      }
+      if (probed.tag == tag && probed.length == word.size() &&
+          std::memcmp(probed.data, word.data(), word.size()) == 0) {
+        probed.count += times;
+        return;
+      }
+    }
+  }
+
+ public:
+  word_counts() : used(0){};
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief adds times occurences of the word, the word has to outlive the
+   * table
+   *
+   * @Param std::string_view
+   * @Param std::uint64_t
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto add(std::string_view word, std::uint64_t times = 1) -> void {
+    if ((used + 1) * 10 > slots.size() * 7) grow();
+    std::uint64_t const hash = std::hash<std::string_view>{}(word);
+    insert(word, times, std::uint32_t(hash ^ (hash >> 32)), false);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief adds times occurences of the word, words that are new to the table
+   * are copied to its own memory so the word doesn't have to outlive the table
+   *
+   * @Param std::string_view
+   * @Param std::uint64_t
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto add_copy(std::string_view word, std::uint64_t times = 1) -> void {
+    if ((used + 1) * 10 > slots.size() * 7) grow();
+    std::uint64_t const hash = std::hash<std::string_view>{}(word);
+    insert(word, times, std::uint32_t(hash ^ (hash >> 32)), true);
+  }
+  auto size() const -> std::size_t { return used; }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief calls function with every distinct word and its count
+   *
+   * @Param function callable with std::string_view and std::uint64_t
+   */
+  /* ----------------------------------------------------------------------------*/
+  template <typename Function>
+  auto for_each(Function function) const -> void {
+    for (const auto &counted : slots)
+      if (counted.count)
+        function(std::string_view(counted.data, counted.length), counted.count);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief counts words of the table, with the pool every range of words is
+   * counted to its own table and the tables are merged at the end
+   *
+   * @Param const reference to random access table of std::string_view words
+   * @Param parallel::thread_pool pointer (can be nullptr)
+   *
+   * @Returns helper::word_counts
+   */
+  /* ----------------------------------------------------------------------------*/
+  template <typename Words>
+  static auto count(const Words &words, parallel::thread_pool *pool = nullptr)
+      -> word_counts {
+    std::size_t const ranges = pool ? pool->size() : 1;
+    std::vector<word_counts> range_counts(ranges);
+    parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+      for (std::size_t i = words.size() * range / ranges;
+           i < words.size() * (range + 1) / ranges; ++i)
+        range_counts[range].add(words[i]);
+    });
+    word_counts merged = std::move(range_counts[0]);
+    for (std::size_t range = 1; range < ranges; ++range)
+      range_counts[range].for_each(
+          [&merged](std::string_view word, std::uint64_t times) {
+            merged.add(word, times);
+          });
+    return merged;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief selects k most frequent words with a bounded heap, O(n log k) for n
+ * distinct words. Words are returned from the most frequent, words with the
+ * same count in alphabetical order
+ *
+ * @Param for_each callable that calls its argument with every distinct word
+ * (std::string_view) and its count (std::uint64_t)
+ * @Param std::size_t k
+ *
+ * @Returns std::vector<std::pair<std::string_view, std::uint64_t>>
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename ForEach>
+auto most_frequent(ForEach for_each, std::size_t k)
+    -> std::vector<std::pair<std::string_view, std::uint64_t>> {
+  using counted = std::pair<std::string_view, std::uint64_t>;
+  auto better = [](const counted &left, const counted &right) {
+    if (left.second != right.second) return left.second > right.second;
+    return left.first < right.first;
+  };
+  std::vector<counted> heap;
+  if (k == 0) return heap;
+  for_each([&](std::string_view word, std::uint64_t count) {
+    if (heap.size() < k) {
+      heap.emplace_back(word, count);
+      std::push_heap(heap.begin(), heap.end(), better);
+    } else if (better(counted(word, count), heap.front())) {
+      std::pop_heap(heap.begin(), heap.end(), better);
+      heap.back() = counted(word, count);
+      std::push_heap(heap.begin(), heap.end(), better);
+    }
+  });
+  std::sort_heap(heap.begin(), heap.end(), better);
+  return heap;
+}
+}  // namespace helper
+namespace scan {
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief bits of the counters that can be collected by the scanner, counters
+ * that are not requested are not computed
+ */
+/* ----------------------------------------------------------------------------*/
+enum counter : unsigned {
+  lines = 1u << 0,
+  digits = 1u << 1,
+  numbers = 1u << 2,
+  chars = 1u << 3,
+  words = 1u << 4,
+  all = lines | digits | numbers | chars | words,
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief results of the scan, lines and chars are counted the same way as
+ * std::getline splits the file (last line doesn't need to end with newline)
+ */
+/* ----------------------------------------------------------------------------*/
+struct summary {
+  long long lines = 0;
+  long long digits = 0;
+  long long numbers = 0;
+  long long chars = 0;
+  long long words = 0;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief byte classes of one 64 byte block, bit i describes byte i of the
+ * block
+ */
+/* ----------------------------------------------------------------------------*/
+struct block_masks {
+  std::uint64_t space;
+  std::uint64_t digit;
+  std::uint64_t newline;
+};
+constexpr std::size_t block_size = 64;
+using classify_function = block_masks (*)(const char *);
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief classifies block byte by byte, used when no vector unit is available
+ *
+ * @Param const char pointer to block_size bytes
+ *
+ * @Returns scan::block_masks
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto classify_scalar(const char *block) -> block_masks {
+  block_masks masks{0, 0, 0};
+  for (std::size_t i = 0; i < block_size; ++i) {
+    std::uint64_t const bit = std::uint64_t{1} << i;
+    char const c = block[i];
+    if (helper::is_space(c)) masks.space |= bit;
+    if (c >= '0' && c <= '9') masks.digit |= bit;
+    if (c == '\n') masks.newline |= bit;
+  }
+  return masks;
+}
+#if defined(__x86_64__) || defined(__i386__)
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief classifies block 16 bytes at a time, bytes above 0x7f are negative in
+ * signed comparison so they never fall into any of the ranges
+ *
+ * @Param const char pointer to block_size bytes
+ *
+ * @Returns scan::block_masks
+ */
+/* ----------------------------------------------------------------------------*/
+__attribute__((target("sse2"))) inline auto classify_sse2(const char *block)
+    -> block_masks {
+  block_masks masks{0, 0, 0};
+  __m128i const space = _mm_set1_epi8(' ');
+  __m128i const below_tab = _mm_set1_epi8('\t' - 1);
+  __m128i const above_cr = _mm_set1_epi8('\r' + 1);
+  __m128i const below_zero = _mm_set1_epi8('0' - 1);
+  __m128i const above_nine = _mm_set1_epi8('9' + 1);
+  __m128i const newline = _mm_set1_epi8('\n');
+  for (std::size_t i = 0; i < block_size; i += 16) {
+    __m128i const bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i));
+    __m128i const is_space = _mm_or_si128(
+        _mm_cmpeq_epi8(bytes, space),
+        _mm_and_si128(_mm_cmpgt_epi8(bytes, below_tab),
+                      _mm_cmplt_epi8(bytes, above_cr)));
+    __m128i const is_digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, below_zero),
+                                           _mm_cmplt_epi8(bytes, above_nine));
+    __m128i const is_newline = _mm_cmpeq_epi8(bytes, newline);
+    masks.space |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(is_space)))
+                   << i;
+    masks.digit |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(is_digit)))
+                   << i;
+    masks.newline |=
+        std::uint64_t(std::uint16_t(_mm_movemask_epi8(is_newline))) << i;
+  }
+  return masks;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief classifies block 32 bytes at a time
+ *
+ * @Param const char pointer to block_size bytes
+ *
+ * @Returns scan::block_masks
+ */
+/* ----------------------------------------------------------------------------*/
+__attribute__((target("avx2"))) inline auto classify_avx2(const char *block)
+    -> block_masks {
+  block_masks masks{0, 0, 0};
+  __m256i const space = _mm256_set1_epi8(' ');
+  __m256i const below_tab = _mm256_set1_epi8('\t' - 1);
+  __m256i const above_cr = _mm256_set1_epi8('\r' + 1);
+  __m256i const below_zero = _mm256_set1_epi8('0' - 1);
+  __m256i const above_nine = _mm256_set1_epi8('9' + 1);
+  __m256i const newline = _mm256_set1_epi8('\n');
+  for (std::size_t i = 0; i < block_size; i += 32) {
+    __m256i const bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + i));
+    __m256i const is_space = _mm256_or_si256(
+        _mm256_cmpeq_epi8(bytes, space),
+        _mm256_and_si256(_mm256_cmpgt_epi8(bytes, below_tab),
+                         _mm256_cmpgt_epi8(above_cr, bytes)));
+    __m256i const is_digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(bytes, below_zero),
+                         _mm256_cmpgt_epi8(above_nine, bytes));
+    __m256i const is_newline = _mm256_cmpeq_epi8(bytes, newline);
+    masks.space |= std::uint64_t(std::uint32_t(_mm256_movemask_epi8(is_space)))
+                   << i;
+    masks.digit |= std::uint64_t(std::uint32_t(_mm256_movemask_epi8(is_digit)))
+                   << i;
+    masks.newline |=
+        std::uint64_t(std::uint32_t(_mm256_movemask_epi8(is_newline))) << i;
+  }
+  return masks;
+}
+#endif
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief picks the widest classifier that is supported by the cpu the program
+ * is running on
+ *
+ * @Returns scan::classify_function
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto select_classifier() -> classify_function {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return classify_avx2;
+  if (__builtin_cpu_supports("sse2")) return classify_sse2;
+#endif
+  return classify_scalar;
+}
+inline const classify_function classify = select_classifier();
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief collects all of the requested counters in one pass over the bytes,
+ * bytes can be fed in any number of pieces and words that are split between
+ * two pieces are counted correctly
+ *
+ * Input is processed in blocks of block_size bytes. Digits, newlines and words
+ * (non space bytes right after space) are popcounts of the block masks.
+ * Numbers are runs of digits that start right
+ * after whitespace and end right before whitespace: adding the starts of such
+ * runs to the digit mask carries through each run and leaves one bit right
+ * after it, the carry out of the block continues the run in the next block.
+ */
+/* ----------------------------------------------------------------------------*/
+struct scanner {
+ private:
+  unsigned requested;
+  long long bytes;
+  long long newline_count;
+  long long digit_count;
+  long long number_count;
+  long long word_count;
+  std::uint64_t previous_space;
+  std::uint64_t run_carry;
+  char last;
+  std::size_t tail_size;
+  char tail[block_size];
+
+  auto feed_block(const char *block) -> void {
+    block_masks const masks = classify(block);
+    newline_count += std::popcount(masks.newline);
+    digit_count += std::popcount(masks.digit);
+    std::uint64_t const starts =
+        masks.digit & ((masks.space << 1) | previous_space);
+    std::uint64_t const partial = masks.digit + starts;
+    std::uint64_t const sum = partial + run_carry;
+    std::uint64_t const after_runs = sum & ~masks.digit;
+    number_count += std::popcount(after_runs & masks.space);
+    word_count +=
+        std::popcount(~masks.space & ((masks.space << 1) | previous_space));
+    run_carry = (partial < masks.digit) || (sum < partial);
+    previous_space = masks.space >> (block_size - 1);
+  }
+
+ public:
+  explicit scanner(unsigned requested = all)
+      : requested(requested),
+        bytes(0),
+        newline_count(0),
+        digit_count(0),
+        number_count(0),
+        word_count(0),
+        previous_space(1),
+        run_carry(0),
+        last('\n'),
+        tail_size(0){};
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief scans next piece of the input
+   *
+   * @Param std::string_view
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto feed(std::string_view piece) -> void {
+    if (piece.empty()) return;
+    bytes += piece.size();
+    last = piece.back();
+    if (!(requested & (lines | digits | numbers | words))) return;
+    const char *position = piece.data();
+    const char *end = piece.data() + piece.size();
+    if (tail_size) {
+      std::size_t const taken =
+          std::min<std::size_t>(block_size - tail_size, end - position);
+      std::memcpy(tail + tail_size, position, taken);
+      tail_size += taken;
+      position += taken;
+      if (tail_size < block_size) return;
+      feed_block(tail);
+      tail_size = 0;
+    }
+    for (; end - position >= std::ptrdiff_t(block_size); position += block_size)
+      feed_block(position);
+    std::memcpy(tail, position, end - position);
+    tail_size = end - position;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns counters for everything that was fed so far, the last
+   * incomplete block is padded with spaces which end the last word
+   *
+   * @Returns scan::summary
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto finish() const -> summary {
+    scanner padded(*this);
+    std::memset(padded.tail + tail_size, ' ', block_size - tail_size);
+    padded.feed_block(padded.tail);
+    bool const unterminated_line = bytes > 0 && last != '\n';
+    summary result;
+    result.lines = padded.newline_count + unterminated_line;
+    result.digits = padded.digit_count;
+    result.numbers = padded.number_count;
+    result.chars = bytes + unterminated_line;
+    result.words = padded.word_count;
+    return result;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief scans whole text once and returns requested counters
+ *
+ * @Param std::string_view
+ * @Param unsigned bits of scan::counter
+ *
+ * @Returns scan::summary
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline count(std::string_view text, unsigned requested) -> summary {
+  scanner text_scanner(requested);
+  text_scanner.feed(text);
+  return text_scanner.finish();
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief scans text split to chunks on the pool and sums the counters, chunks
+ * end after whitespace so every word is counted in exactly one chunk. Every
+ * chunk that doesn't end with newline counted one extra line and char, only
+ * the one at the end of the text is kept
+ *
+ * @Param std::string_view
+ * @Param unsigned bits of scan::counter
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns scan::summary
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline count(std::string_view text, unsigned requested,
+                  parallel::thread_pool *pool) -> summary {
+  if (!pool || pool->size() == 1) return count(text, requested);
+  auto const chunks = parallel::split_chunks(
+      text, pool->size() * 4, [](char c) { return helper::is_space(c); });
+  std::vector<summary> partial(chunks.size());
+  parallel::for_each_index(pool, chunks.size(), [&](std::size_t i) {
+    partial[i] = count(chunks[i], requested);
+  });
+  summary total;
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    bool const unterminated = chunks[i].back() != '\n';
+    total.lines += partial[i].lines - unterminated;
+    total.digits += partial[i].digits;
+    total.numbers += partial[i].numbers;
+    total.chars += partial[i].chars - unterminated;
+    total.words += partial[i].words;
+  }
+  bool const unterminated_text = !text.empty() && text.back() != '\n';
+  total.lines += unterminated_text;
+  total.chars += unterminated_text;
+  return total;
+}
+}  // namespace scan
+namespace pattern {
+struct pattern_exception : public std::exception {
+  const char *what() const throw() {
+    return "--count-pattern takes at most 64 patterns made of bytes, ., "
+           "[classes], \\d \\w \\s \\D \\W \\S, groups, | and * + ? {m,n}. "
+           "Anchors, lazy quantifiers, backreferences and patterns that match "
+           "empty text are not supported";
+  }
+};
+struct too_complex_exception : public std::exception {
+  const char *what() const throw() {
+    return "Patterns of --count-pattern are too complex, try fewer patterns "
+           "or smaller repetitions";
+  }
+};
+constexpr std::size_t max_patterns = 64;
+constexpr unsigned max_repeat = 1000;
+constexpr unsigned max_depth = 1000;
+constexpr unsigned unbounded = std::numeric_limits<unsigned>::max();
+constexpr std::size_t max_nfa_states = 1 << 17;
+constexpr std::size_t max_dfa_states = 1 << 14;
+constexpr std::size_t window_size = 1 << 16;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief set of bytes, newline is never in the set so a match never crosses a
+ * line
+ */
+/* ----------------------------------------------------------------------------*/
+struct byte_set {
+  std::array<std::uint64_t, 4> bits{};
+
+  auto add(unsigned char byte) -> void {
+    if (byte != '\n') bits[byte / 64] |= std::uint64_t(1) << (byte % 64);
+  }
+  auto add_range(unsigned char first, unsigned char last) -> void {
+    for (unsigned byte = first; byte <= last; ++byte) add(byte);
+  }
+  auto add(const byte_set &other) -> void {
+    for (std::size_t i = 0; i < bits.size(); ++i) bits[i] |= other.bits[i];
+  }
+  auto negate() -> void {
+    for (auto &word : bits) word = ~word;
+    bits['\n' / 64] &= ~(std::uint64_t(1) << ('\n' % 64));
+  }
+  auto contains(unsigned char byte) const -> bool {
+    return bits[byte / 64] >> (byte % 64) & 1;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parsed pattern, leaves are sets of bytes and the inner nodes are
+ * concatenations, alternations and repetitions {min, max}. Height is the
+ * number of levels of the tree from the node down to its deepest leaf
+ */
+/* ----------------------------------------------------------------------------*/
+struct syntax_node {
+  enum class kind : std::uint8_t { bytes, concat, alternate, repeat };
+  kind type = kind::concat;
+  byte_set bytes;
+  std::vector<syntax_node> children;
+  unsigned min = 0;
+  unsigned max = 0;
+  unsigned height = 1;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief recursive descent parser of the pattern, every error of the syntax
+ * throws pattern_exception. Groups can be nested and the tree can be at most
+ * max_depth levels high so neither the parser nor the automata built from the
+ * tree run out of the stack
+ */
+/* ----------------------------------------------------------------------------*/
+struct parser {
+ private:
+  std::string_view source;
+  std::size_t position;
+  unsigned depth;
+
+  auto at_end() const -> bool { return position == source.size(); }
+  auto peek() const -> char { return source[position]; }
+  auto take() -> char {
+    if (at_end()) throw pattern_exception();
+    return source[position++];
+  }
+  auto grow(syntax_node &node, unsigned child_height) -> void {
+    node.height = std::max(node.height, child_height + 1);
+    if (node.height > max_depth) throw pattern_exception();
+  }
+  auto single(unsigned char byte) -> syntax_node {
+    syntax_node node;
+    node.type = syntax_node::kind::bytes;
+    node.bytes.add(byte);
+    return node;
+  }
+  auto number() -> unsigned {
+    if (at_end() || peek() < '0' || peek() > '9') throw pattern_exception();
+    unsigned value = 0;
+    while (!at_end() && peek() >= '0' && peek() <= '9') {
+      value = value * 10 + (take() - '0');
+      if (value > max_repeat) throw pattern_exception();
+    }
+    return value;
+  }
+  auto hex_digit() -> unsigned {
+    char const digit = take();
+    if (digit >= '0' && digit <= '9') return digit - '0';
+    if (digit >= 'a' && digit <= 'f') return digit - 'a' + 10;
+    if (digit >= 'A' && digit <= 'F') return digit - 'A' + 10;
+    throw pattern_exception();
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief bytes of the escape after backslash, the same in and out of the
+   * class
+   *
+   * @Returns pattern::byte_set
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto escape() -> byte_set {
+    byte_set bytes;
+    char const escaped = take();
+    switch (escaped) {
+      case 'd':
+      case 'D':
+        bytes.add_range('0', '9');
+        break;
+      case 'w':
+      case 'W':
+        bytes.add_range('0', '9');
+        bytes.add_range('a', 'z');
+        bytes.add_range('A', 'Z');
+        bytes.add('_');
+        break;
+      case 's':
+      case 'S':
+        for (const char space : {' ', '\t', '\r', '\v', '\f'}) bytes.add(space);
+        break;
+      case 't':
+        bytes.add('\t');
+        break;
+      case 'r':
+        bytes.add('\r');
+        break;
+      case 'f':
+        bytes.add('\f');
+        break;
+      case 'v':
+        bytes.add('\v');
+        break;
+      case 'n':
+        break;
+      case 'x': {
+        unsigned const high = hex_digit();
+        bytes.add(high * 16 + hex_digit());
+        break;
+      }
+      default:
+        if ((escaped >= '0' && escaped <= '9') ||
+            (escaped >= 'a' && escaped <= 'z') ||
+            (escaped >= 'A' && escaped <= 'Z'))
+          throw pattern_exception();
+        bytes.add(escaped);
+    }
+    if (escaped == 'D' || escaped == 'W' || escaped == 'S') bytes.negate();
+    return bytes;
+  }
+  auto bracket() -> syntax_node {
+    syntax_node node;
+    node.type = syntax_node::kind::bytes;
+    bool const negated = !at_end() && peek() == '^';
+    if (negated) take();
+    bool first = true;
+    while (first || at_end() || peek() != ']') {
+      first = false;
+      char const begin = take();
+      if (begin == '\\') {
+        node.bytes.add(escape());
+        continue;
+      }
+      if (position + 1 < source.size() && peek() == '-' &&
+          source[position + 1] != ']') {
+        take();
+        char const end = take();
+        if (end == '\\' ||
+            static_cast<unsigned char>(end) < static_cast<unsigned char>(begin))
+          throw pattern_exception();
+        node.bytes.add_range(begin, end);
+      } else {
+        node.bytes.add(begin);
+      }
+    }
+    take();
+    if (negated) node.bytes.negate();
+    return node;
+  }
+  auto atom() -> syntax_node {
+    char const next = take();
+    switch (next) {
+      case '(': {
+        if (++depth > max_depth) throw pattern_exception();
+        if (source.substr(position, 2) == "?:") position += 2;
+        syntax_node inner = alternation();
+        if (take() != ')') throw pattern_exception();
+        --depth;
+        return inner;
+      }
+      case '.': {
+        syntax_node node;
+        node.type = syntax_node::kind::bytes;
+        node.bytes.negate();
+        return node;
+      }
+      case '[':
+        return bracket();
+      case '\\': {
+        syntax_node node;
+        node.type = syntax_node::kind::bytes;
+        node.bytes = escape();
+        return node;
+      }
+      case '^':
+      case '$':
+      case ')':
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        throw pattern_exception();
+      default:
+        return single(next);
+    }
+  }
+  auto repetition() -> syntax_node {
+    syntax_node node = atom();
+    while (!at_end() && (peek() == '*' || peek() == '+' || peek() == '?' ||
+                         peek() == '{')) {
+      syntax_node repeated;
+      repeated.type = syntax_node::kind::repeat;
+      char const quantifier = take();
+      if (quantifier == '*') {
+        repeated.max = unbounded;
+      } else if (quantifier == '+') {
+        repeated.min = 1;
+        repeated.max = unbounded;
+      } else if (quantifier == '?') {
+        repeated.max = 1;
+      } else {
+        repeated.min = repeated.max = number();
+        if (!at_end() && peek() == ',') {
+          take();
+          repeated.max =
+              !at_end() && peek() == '}' ? unbounded : number();
+        }
+        if (take() != '}' || repeated.max < repeated.min)
+          throw pattern_exception();
+      }
+      if (!at_end() && peek() == '?') throw pattern_exception();
+      grow(repeated, node.height);
+      repeated.children.push_back(std::move(node));
+      node = std::move(repeated);
+    }
+    return node;
+  }
+  auto concatenation() -> syntax_node {
+    syntax_node node;
+    while (!at_end() && peek() != '|' && peek() != ')') {
+      node.children.push_back(repetition());
+      grow(node, node.children.back().height);
+    }
+    if (node.children.size() == 1) return std::move(node.children.front());
+    return node;
+  }
+  auto alternation() -> syntax_node {
+    syntax_node node = concatenation();
+    if (at_end() || peek() != '|') return node;
+    syntax_node alternatives;
+    alternatives.type = syntax_node::kind::alternate;
+    grow(alternatives, node.height);
+    alternatives.children.push_back(std::move(node));
+    while (!at_end() && peek() == '|') {
+      take();
+      alternatives.children.push_back(concatenation());
+      grow(alternatives, alternatives.children.back().height);
+    }
+    return alternatives;
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief parses the whole pattern
+   *
+   * @Param std::string_view pattern
+   *
+   * @Returns pattern::syntax_node
+   */
+  /* ----------------------------------------------------------------------------*/
+  static auto parse(std::string_view source) -> syntax_node {
+    parser reading;
+    reading.source = source;
+    reading.position = 0;
+    reading.depth = 0;
+    syntax_node node = reading.alternation();
+    if (!reading.at_end()) throw pattern_exception();
+    return node;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief Thompson automaton of the patterns. State consumes one byte of its
+ * set and goes to next, or (set == split) goes to next and alternative without
+ * consuming, or (set == match) accepts pattern in alternative
+ */
+/* ----------------------------------------------------------------------------*/
+struct nfa {
+  static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+  static constexpr std::uint32_t split = none;
+  static constexpr std::uint32_t match = none - 1;
+  struct state {
+    std::uint32_t set;
+    std::uint32_t next;
+    std::uint32_t alternative;
+  };
+  std::vector<state> states;
+  std::vector<byte_set> sets;
+
+  auto add(state added) -> std::uint32_t {
+    if (states.size() == max_nfa_states) throw too_complex_exception();
+    states.push_back(added);
+    return states.size() - 1;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief adds states of the node that continue to next, backwards so every
+   * state knows where it goes when it's added. Reversed automaton reads the
+   * text from the end
+   *
+   * @Param const pattern::syntax_node reference
+   * @Param std::uint32_t state after the node
+   * @Param bool reversed
+   *
+   * @Returns std::uint32_t first state of the node
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto compile(const syntax_node &node, std::uint32_t next, bool reversed)
+      -> std::uint32_t {
+    switch (node.type) {
+      case syntax_node::kind::bytes:
+        sets.push_back(node.bytes);
+        return add({std::uint32_t(sets.size() - 1), next, none});
+      case syntax_node::kind::concat:
+        if (reversed)
+          for (const auto &child : node.children)
+            next = compile(child, next, reversed);
+        else
+          for (auto child = node.children.rbegin();
+               child != node.children.rend(); ++child)
+            next = compile(*child, next, reversed);
+        return next;
+      case syntax_node::kind::alternate: {
+        std::uint32_t first = compile(node.children.back(), next, reversed);
+        for (std::size_t i = node.children.size() - 1; i-- > 0;)
+          first = add({split, compile(node.children[i], next, reversed), first});
+        return first;
+      }
+      case syntax_node::kind::repeat: {
+        const syntax_node &body = node.children.front();
+        if (node.max == unbounded) {
+          std::uint32_t const loop = add({split, none, next});
+          states[loop].next = compile(body, loop, reversed);
+          next = loop;
+        } else {
+          std::uint32_t const exit = next;
+          for (unsigned i = node.min; i < node.max; ++i)
+            next = add({split, compile(body, next, reversed), exit});
+        }
+        for (unsigned i = 0; i < node.min; ++i)
+          next = compile(body, next, reversed);
+        return next;
+      }
+    }
+    return next;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief bytes that no set tells apart share one class, so the tables of the
+ * automata have a column for every class instead of every byte
+ */
+/* ----------------------------------------------------------------------------*/
+struct byte_classes {
+  std::array<std::uint8_t, 256> of{};
+  std::vector<unsigned char> representative;
+
+  explicit byte_classes(const std::vector<byte_set> &sets) {
+    std::map<std::vector<bool>, std::uint8_t> known;
+    for (unsigned byte = 0; byte < 256; ++byte) {
+      std::vector<bool> member(sets.size());
+      for (std::size_t i = 0; i < sets.size(); ++i)
+        member[i] = sets[i].contains(byte);
+      auto const [found, added] = known.emplace(member, representative.size());
+      if (added) representative.push_back(byte);
+      of[byte] = found->second;
+    }
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief deterministic automaton built from the nfa by the subset
+ * construction, state 0 is dead and state 1 is the start. matches holds bits of
+ * the patterns accepted in the state. Unanchored automaton starts all patterns
+ * again at every byte
+ */
+/* ----------------------------------------------------------------------------*/
+struct dfa {
+  static constexpr std::uint32_t dead = 0;
+  static constexpr std::uint32_t start = 1;
+  std::size_t classes = 0;
+  std::vector<std::uint32_t> next;
+  std::vector<std::uint64_t> matches;
+
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief builds the automaton
+   *
+   * @Param const pattern::nfa reference
+   * @Param const std::vector<std::uint32_t> reference starts of the patterns
+   * @Param const pattern::byte_classes reference
+   * @Param bool unanchored
+   */
+  /* ----------------------------------------------------------------------------*/
+  dfa(const nfa &machine, const std::vector<std::uint32_t> &starts,
+      const byte_classes &bytes, bool unanchored)
+      : classes(bytes.representative.size()) {
+    std::vector<std::uint32_t> seen(machine.states.size(), 0);
+    std::uint32_t generation = 0;
+    std::vector<std::uint32_t> pending;
+    auto closure = [&](const std::vector<std::uint32_t> &from,
+                       std::vector<std::uint32_t> &set) {
+      ++generation;
+      set.clear();
+      pending = from;
+      while (!pending.empty()) {
+        std::uint32_t const id = pending.back();
+        pending.pop_back();
+        if (seen[id] == generation) continue;
+        seen[id] = generation;
+        const auto &state = machine.states[id];
+        if (state.set == nfa::split) {
+          pending.push_back(state.alternative);
+          pending.push_back(state.next);
+        } else {
+          set.push_back(id);
+        }
+      }
+      std::sort(set.begin(), set.end());
+    };
+    std::map<std::vector<std::uint32_t>, std::uint32_t> ids;
+    std::vector<std::vector<std::uint32_t>> subsets;
+    auto intern = [&](std::vector<std::uint32_t> &set) -> std::uint32_t {
+      auto const [found, added] = ids.emplace(set, subsets.size());
+      if (!added) return found->second;
+      if (subsets.size() == max_dfa_states) throw too_complex_exception();
+      std::uint64_t accepted = 0;
+      for (const auto id : set)
+        if (machine.states[id].set == nfa::match)
+          accepted |= std::uint64_t(1) << machine.states[id].alternative;
+      subsets.push_back(set);
+      matches.push_back(accepted);
+      next.resize(next.size() + classes, dead);
+      return found->second;
+    };
+    std::vector<std::uint32_t> set;
+    intern(set);
+    closure(starts, set);
+    intern(set);
+    std::vector<std::uint32_t> targets;
+    for (std::uint32_t current = start; current < subsets.size(); ++current) {
+      for (std::size_t byte_class = 0; byte_class < classes; ++byte_class) {
+        unsigned char const byte = bytes.representative[byte_class];
+        targets.clear();
+        if (unanchored) targets = starts;
+        for (const auto id : subsets[current]) {
+          const auto &state = machine.states[id];
+          if (state.set != nfa::match && machine.sets[state.set].contains(byte))
+            targets.push_back(state.next);
+        }
+        closure(targets, set);
+        std::uint32_t const target = intern(set);
+        next[current * classes + byte_class] = target;
+      }
+    }
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief patterns compiled once and counted in one pass. Every pattern counts
+ * its leftmost-longest matches that don't overlap (like grep -o), matches
+ * never cross a line. The text is read backwards by one unanchored automaton
+ * of all reversed patterns, which marks where a match of each pattern can
+ * start; at a marked start the anchored automaton of the pattern finds the
+ * longest match and the pattern continues after it
+ */
+/* ----------------------------------------------------------------------------*/
+struct pattern_set {
+ private:
+  std::vector<std::string> sources;
+  std::unique_ptr<byte_classes> bytes;
+  std::unique_ptr<dfa> starts;
+  std::vector<dfa> longest;
+
+  auto longest_end(std::size_t pattern, std::string_view text,
+                   std::size_t begin) const -> std::size_t {
+    const dfa &automaton = longest[pattern];
+    std::uint32_t state = dfa::start;
+    std::size_t end = begin;
+    for (std::size_t i = begin; i < text.size(); ++i) {
+      state = automaton.next[state * automaton.classes +
+                             bytes->of[static_cast<unsigned char>(text[i])]];
+      if (state == dfa::dead) break;
+      if (automaton.matches[state]) end = i + 1;
+    }
+    return end;
+  }
+  auto count_window(std::string_view text,
+                    std::vector<std::pair<std::size_t, std::uint64_t>> &marks,
+                    std::vector<std::uint64_t> &counts) const -> void {
+    marks.clear();
+    std::uint32_t state = dfa::start;
+    for (std::size_t i = text.size(); i-- > 0;) {
+      state = starts->next[state * starts->classes +
+                           bytes->of[static_cast<unsigned char>(text[i])]];
+      if (starts->matches[state]) marks.emplace_back(i, starts->matches[state]);
+    }
+    std::array<std::size_t, max_patterns> resume{};
+    for (auto mark = marks.rbegin(); mark != marks.rend(); ++mark) {
+      for (std::uint64_t patterns = mark->second; patterns;
+           patterns &= patterns - 1) {
+        std::size_t const pattern = std::countr_zero(patterns);
+        if (mark->first < resume[pattern]) continue;
+        std::size_t const end = longest_end(pattern, text, mark->first);
+        if (end == mark->first) continue;
+        ++counts[pattern];
+        resume[pattern] = end;
+      }
+    }
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief parses and compiles the patterns
+   *
+   * @Param const std::vector<std::string> reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  explicit pattern_set(const std::vector<std::string> &patterns)
+      : sources(patterns) {
+    if (patterns.empty() || patterns.size() > max_patterns)
+      throw pattern_exception();
+    nfa forward, backward;
+    std::vector<std::uint32_t> forward_starts, backward_starts;
+    for (std::uint32_t i = 0; i < patterns.size(); ++i) {
+      syntax_node const parsed = parser::parse(patterns[i]);
+      forward_starts.push_back(forward.compile(
+          parsed, forward.add({nfa::match, nfa::none, i}), false));
+      backward_starts.push_back(backward.compile(
+          parsed, backward.add({nfa::match, nfa::none, i}), true));
+    }
+    bytes = std::make_unique<byte_classes>(forward.sets);
+    starts = std::make_unique<dfa>(backward, backward_starts, *bytes, true);
+    for (const auto first : forward_starts) {
+      longest.emplace_back(forward, std::vector<std::uint32_t>{first}, *bytes,
+                           false);
+      if (longest.back().matches[dfa::start]) throw pattern_exception();
+    }
+  }
+  auto get_sources() const -> const std::vector<std::string> & {
+    return sources;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief counts matches of every pattern in the text, chunks of whole lines
+   * are counted on the pool and every chunk is read in windows of lines so the
+   * marked starts take little memory
+   *
+   * @Param std::string_view
+   * @Param parallel::thread_pool pointer (can be nullptr)
+   *
+   * @Returns std::vector<std::uint64_t> count of every pattern
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto count(std::string_view text, parallel::thread_pool *pool) const
+      -> std::vector<std::uint64_t> {
+    auto const chunks = parallel::split_chunks(
+        text, pool ? pool->size() * 4 : 1, [](char c) { return c == '\n'; });
+    std::vector<std::vector<std::uint64_t>> chunk_counts(
+        chunks.size(), std::vector<std::uint64_t>(sources.size(), 0));
+    parallel::for_each_index(pool, chunks.size(), [&](std::size_t i) {
+      std::vector<std::pair<std::size_t, std::uint64_t>> marks;
+      std::string_view rest = chunks[i];
+      while (!rest.empty()) {
+        std::size_t end = std::min(rest.size(), window_size);
+        const void *newline =
+            std::memchr(rest.data() + end - 1, '\n', rest.size() - end + 1);
+        end = newline ? static_cast<const char *>(newline) - rest.data() + 1
+                      : rest.size();
+        count_window(rest.substr(0, end), marks, chunk_counts[i]);
+        rest.remove_prefix(end);
+      }
+    });
+    std::vector<std::uint64_t> counts(sources.size(), 0);
+    for (const auto &partial : chunk_counts)
+      for (std::size_t i = 0; i < counts.size(); ++i) counts[i] += partial[i];
+    return counts;
+  }
+};
+}  // namespace pattern
+namespace stats {
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief timing of one phase, depth is the number of phases that were running
+ * when it started (their times include it)
+ */
+/* ----------------------------------------------------------------------------*/
+struct phase {
+  const char *name;
+  int depth;
+  double seconds;
+  std::uint64_t allocations;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief everything that is recorded for one command, every thread has its own
+ * report so commands that run in parallel don't mix their phases
+ */
+/* ----------------------------------------------------------------------------*/
+struct report {
+  bool enabled = false;
+  int depth = 0;
+  std::vector<phase> phases;
+  std::uint64_t bytes_read = 0;
+  long long lines = 0;
+  long long words = 0;
+  std::uint64_t allocations_at_start = 0;
+  std::chrono::steady_clock::time_point start;
+};
+inline thread_local report current;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief starts recording of the report for the command on this thread
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline enable() -> void {
+  allocations::start();
+  current = report();
+  current.enabled = true;
+  current.allocations_at_start = allocations::count();
+  current.start = std::chrono::steady_clock::now();
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief adds bytes that were read from the input when recording is enabled
+ *
+ * @Param std::uint64_t
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline add_bytes_read(std::uint64_t bytes) -> void {
+  if (current.enabled) current.bytes_read += bytes;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief times the scope it lives in and records it as a phase of the report,
+ * when recording is disabled (or name is nullptr) it does nothing but one check
+ */
+/* ----------------------------------------------------------------------------*/
+struct scoped_phase {
+ private:
+  std::size_t index;
+  bool active;
+  std::uint64_t allocations_before;
+  std::chrono::steady_clock::time_point start;
+
+ public:
+  explicit scoped_phase(const char *name)
+      : index(0), active(current.enabled && name), allocations_before(0) {
+    if (!active) return;
+    index = current.phases.size();
+    current.phases.push_back({name, current.depth++, 0.0, 0});
+    allocations_before = allocations::count();
+    start = std::chrono::steady_clock::now();
+  }
+  scoped_phase(const scoped_phase &) = delete;
+  auto operator=(const scoped_phase &) -> scoped_phase & = delete;
+  ~scoped_phase() {
+    if (!active) return;
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    current.phases[index].seconds = elapsed.count();
+    current.phases[index].allocations =
+        allocations::count() - allocations_before;
+    --current.depth;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief returns peak resident set size of the process
+ *
+ * @Returns long kilobytes
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline peak_rss_kb() -> long {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return usage.ru_maxrss;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes report of this thread to the stream as text (for stderr) or
+ * as JSON and stops the recording
+ *
+ * @Param std::ostream reference
+ * @Param bool true for JSON
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline write_report(std::ostream &out, bool json) -> void {
+  std::chrono::duration<double> const total =
+      std::chrono::steady_clock::now() - current.start;
+  std::uint64_t const allocations =
+      allocations::count() - current.allocations_at_start;
+  std::ios_base::fmtflags const flags = out.flags();
+  out << std::fixed << std::setprecision(6);
+  if (json) {
+    out << "{\"bytes_read\": " << current.bytes_read
+        << ", \"lines\": " << current.lines << ", \"words\": " << current.words
+        << ", \"allocations\": " << allocations
+        << ", \"peak_rss_kb\": " << peak_rss_kb()
+        << ", \"seconds\": " << total.count() << ", \"phases\": [";
+    for (std::size_t i = 0; i < current.phases.size(); ++i) {
+      const auto &recorded = current.phases[i];
+      out << (i ? ", " : "") << "{\"name\": \"" << recorded.name
+          << "\", \"depth\": " << recorded.depth
+          << ", \"seconds\": " << recorded.seconds
+          << ", \"allocations\": " << recorded.allocations << "}";
+    }
+    out << "]}" << std::endl;
+  } else {
+    out << "-----stats-------\n"
+        << "bytes read: " << current.bytes_read << "\n"
+        << "lines: " << current.lines << "\n"
+        << "words: " << current.words << "\n"
+        << "allocations: " << allocations << "\n"
+        << "peak RSS: " << peak_rss_kb() << " kB\n"
+        << "total: " << total.count() << " s\n";
+    for (const auto &recorded : current.phases)
+      out << std::string(2 * recorded.depth, ' ') << recorded.name << ": "
+          << recorded.seconds << " s, " << recorded.allocations
+          << " allocations\n";
+    out << std::flush;
+  }
+  out.flags(flags);
+  current.enabled = false;
+}
+}  // namespace stats
+namespace output {
+struct output_file_exception : public std::exception {
+  const char *what() const throw() { return "Can't open the output file"; }
+};
+struct output_write_exception : public std::exception {
+  const char *what() const throw() { return "Error while writing the output"; }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief size of the buffer of the sink, pieces that don't fit in the free
+ * part of the buffer are written together with it by one writev
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr std::size_t buffer_size = 1 << 20;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief destination of the output of the flags. Sink of a file descriptor
+ * collects small pieces in a buffer that is reused for the whole run and
+ * writes it only when it is full or flushed, so results reach the descriptor
+ * while the flags are still running and nothing is kept twice in memory. Sink
+ * without a descriptor keeps everything in memory until it is taken (output
+ * of -i batch and of the server). After a failed write the rest of the output
+ * is dropped the same way std::ostream does it after badbit and failed()
+ * tells the command to report it
+ */
+/* ----------------------------------------------------------------------------*/
+struct sink {
+ private:
+  int descriptor;
+  bool owned;
+  bool write_failed;
+  std::size_t used;
+  std::unique_ptr<char[]> buffer;
+  std::string memory;
+
+  auto write_all(const struct iovec *pieces, int count) -> void {
+    struct iovec remaining[2];
+    std::copy(pieces, pieces + count, remaining);
+    struct iovec *first = remaining;
+    while (!write_failed && count > 0) {
+      ssize_t written = writev(descriptor, first, count);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        write_failed = true;
+        return;
+      }
+      while (count > 0 && std::size_t(written) >= first->iov_len) {
+        written -= first->iov_len;
+        ++first;
+        --count;
+      }
+      if (count > 0) {
+        first->iov_base = static_cast<char *>(first->iov_base) + written;
+        first->iov_len -= written;
+      }
+    }
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief sink that keeps the output in memory
+   */
+  /* ----------------------------------------------------------------------------*/
+  sink() : descriptor(-1), owned(false), write_failed(false), used(0){};
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief sink that writes to the descriptor, owned descriptor is closed
+   * when the sink is destroyed
+   *
+   * @Param int file descriptor
+   * @Param bool owned
+   */
+  /* ----------------------------------------------------------------------------*/
+  explicit sink(int descriptor, bool owned = false)
+      : descriptor(descriptor),
+        owned(owned),
+        write_failed(false),
+        used(0),
+        buffer(new char[buffer_size]){};
+  sink(const sink &) = delete;
+  auto operator=(const sink &) -> sink & = delete;
+  ~sink() {
+    flush();
+    if (owned) close(descriptor);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief creates (or truncates) the file and returns sink that writes to it
+   *
+   * @Param const std::string reference
+   *
+   * @Returns std::unique_ptr<output::sink>
+   */
+  /* ----------------------------------------------------------------------------*/
+  static auto open_file(const std::string &file_name)
+      -> std::unique_ptr<sink> {
+    int const file_descriptor =
+        open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file_descriptor < 0) throw output_file_exception();
+    return std::make_unique<sink>(file_descriptor, true);
+  }
+  auto write(std::string_view piece) -> void {
+    if (descriptor < 0) {
+      memory.append(piece);
+      return;
+    }
+    if (piece.size() <= buffer_size - used) {
+      std::memcpy(buffer.get() + used, piece.data(), piece.size());
+      used += piece.size();
+      return;
+    }
+    struct iovec const pieces[2] = {
+        {buffer.get(), used},
+        {const_cast<char *>(piece.data()), piece.size()}};
+    write_all(pieces, 2);
+    used = 0;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief writes everything that is buffered to the descriptor
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto flush() -> void {
+    if (descriptor < 0 || used == 0) return;
+    struct iovec const pieces[1] = {{buffer.get(), used}};
+    write_all(pieces, 1);
+    used = 0;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns true when a write to the descriptor failed and the rest
+   * of the output was dropped
+   *
+   * @Returns bool
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto failed() const -> bool { return write_failed; }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns everything that was written to the sink without a
+   * descriptor and empties it
+   *
+   * @Returns std::string
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto take() -> std::string {
+    std::string taken;
+    taken.swap(memory);
+    return taken;
+  }
+  auto operator<<(std::string_view piece) -> sink & {
+    write(piece);
+    return *this;
+  }
+  auto operator<<(const char *piece) -> sink & {
+    write(piece);
+    return *this;
+  }
+  auto operator<<(char byte) -> sink & {
+    write(std::string_view(&byte, 1));
+    return *this;
+  }
+  template <typename Number>
+  auto operator<<(Number number)
+      -> std::enable_if_t<std::is_integral_v<Number>, sink &> {
+    char digits[24];
+    auto const converted = std::to_chars(digits, digits + sizeof(digits), number);
+    write(std::string_view(digits, converted.ptr - digits));
+    return *this;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief sink of the standard output that is shared by the whole program, it
+ * is flushed after every command
+ *
+ * @Returns output::sink reference
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto standard_output() -> sink & {
+  static sink out(STDOUT_FILENO);
+  return out;
+}
+}  // namespace output
+namespace compressed {
+struct decompression_exception : public std::exception {
+  const char *what() const throw() {
+    return "Compressed file is corrupted, truncated or can't be read";
+  }
+};
+struct missing_library_exception : public std::exception {
+  const char *what() const throw() {
+    return "reading .gz files needs libz.so.1 and reading .zst files needs "
+           "libzstd.so.1";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief format of the input recognized by its first bytes, the name of the
+ * file doesn't matter
+ */
+/* ----------------------------------------------------------------------------*/
+enum class format { plain, gzip, zstd };
+constexpr std::size_t magic_size = 4;
+constexpr std::size_t block_size = 1 << 20;
+constexpr std::size_t queued_blocks = 4;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief recognizes the format from the first magic_size bytes of the input
+ *
+ * @Param std::string_view first bytes of the input
+ *
+ * @Returns compressed::format
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto detect(std::string_view head) -> format {
+  if (head.size() >= 2 && head[0] == '\x1f' && head[1] == '\x8b')
+    return format::gzip;
+  if (head.size() >= 4 && head.substr(0, 4) == "\x28\xb5\x2f\xfd")
+    return format::zstd;
+  return format::plain;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief recognizes the format of the regular file without moving its offset
+ *
+ * @Param int file descriptor
+ *
+ * @Returns compressed::format
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto format_of(int descriptor) -> format {
+  char head[magic_size];
+  ssize_t const read_bytes = pread(descriptor, head, magic_size, 0);
+  if (read_bytes <= 0) return format::plain;
+  return detect(std::string_view(head, read_bytes));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief recognizes the format of the file, file that can't be opened is
+ * plain so the error comes from the code that reads it
+ *
+ * @Param const std::string reference
+ *
+ * @Returns compressed::format
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto format_of(const std::string &file_name) -> format {
+  int const descriptor = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) return format::plain;
+  format const found = format_of(descriptor);
+  close(descriptor);
+  return found;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief function of a shared library that is loaded when it is used for the
+ * first time, so the program is built without zlib and zstd and needs them
+ * only to read compressed files
+ *
+ * @Param const char pointer name of the library
+ * @Param const char pointer name of the function
+ *
+ * @Returns void pointer
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto load_function(const char *library, const char *name) -> void * {
+  void *handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+  if (!handle) throw missing_library_exception();
+  void *function = dlsym(handle, name);
+  if (!function) throw missing_library_exception();
+  return function;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief z_stream of zlib.h and the functions of libz.so.1 that inflate gzip,
+ * the layout is the stable ABI of zlib 1.x
+ */
+/* ----------------------------------------------------------------------------*/
+struct zlib {
+  struct stream {
+    const unsigned char *next_in;
+    unsigned avail_in;
+    unsigned long total_in;
+    unsigned char *next_out;
+    unsigned avail_out;
+    unsigned long total_out;
+    const char *msg;
+    void *state;
+    void *zalloc;
+    void *zfree;
+    void *opaque;
+    int data_type;
+    unsigned long adler;
+    unsigned long reserved;
+  };
+  static constexpr int ok = 0, stream_end = 1, buffer_error = -5;
+  static constexpr int gzip_window = 15 + 16;
+
+  int (*init)(stream *, int, const char *, int);
+  int (*inflate)(stream *, int);
+  int (*reset)(stream *);
+  int (*end)(stream *);
+
+  zlib()
+      : init(reinterpret_cast<decltype(init)>(
+            load_function("libz.so.1", "inflateInit2_"))),
+        inflate(reinterpret_cast<decltype(inflate)>(
+            load_function("libz.so.1", "inflate"))),
+        reset(reinterpret_cast<decltype(reset)>(
+            load_function("libz.so.1", "inflateReset"))),
+        end(reinterpret_cast<decltype(end)>(
+            load_function("libz.so.1", "inflateEnd"))){};
+  static auto get() -> const zlib & {
+    static const zlib library;
+    return library;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief buffers of zstd.h and the functions of libzstd.so.1 that decompress
+ * streams and single frames
+ */
+/* ----------------------------------------------------------------------------*/
+struct zstd {
+  struct in_buffer {
+    const void *source;
+    std::size_t size;
+    std::size_t position;
+  };
+  struct out_buffer {
+    void *destination;
+    std::size_t size;
+    std::size_t position;
+  };
+  static constexpr unsigned long long unknown_size = -1ull, error_size = -2ull;
+
+  void *(*create)();
+  std::size_t (*free)(void *);
+  std::size_t (*decompress_stream)(void *, out_buffer *, in_buffer *);
+  std::size_t (*decompress_frame)(void *, void *, std::size_t, const void *,
+                                  std::size_t);
+  std::size_t (*frame_compressed_size)(const void *, std::size_t);
+  unsigned long long (*frame_content_size)(const void *, std::size_t);
+  unsigned (*is_error)(std::size_t);
+
+  zstd()
+      : create(reinterpret_cast<decltype(create)>(
+            load_function("libzstd.so.1", "ZSTD_createDCtx"))),
+        free(reinterpret_cast<decltype(free)>(
+            load_function("libzstd.so.1", "ZSTD_freeDCtx"))),
+        decompress_stream(reinterpret_cast<decltype(decompress_stream)>(
+            load_function("libzstd.so.1", "ZSTD_decompressStream"))),
+        decompress_frame(reinterpret_cast<decltype(decompress_frame)>(
+            load_function("libzstd.so.1", "ZSTD_decompressDCtx"))),
+        frame_compressed_size(reinterpret_cast<decltype(frame_compressed_size)>(
+            load_function("libzstd.so.1", "ZSTD_findFrameCompressedSize"))),
+        frame_content_size(reinterpret_cast<decltype(frame_content_size)>(
+            load_function("libzstd.so.1", "ZSTD_getFrameContentSize"))),
+        is_error(reinterpret_cast<decltype(is_error)>(
+            load_function("libzstd.so.1", "ZSTD_isError"))){};
+  static auto get() -> const zstd & {
+    static const zstd library;
+    return library;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief RAII owner of a decompression context
+   */
+  /* ----------------------------------------------------------------------------*/
+  struct context {
+    void *pointer;
+    context() : pointer(get().create()) {
+      if (!pointer) throw std::bad_alloc();
+    }
+    context(const context &) = delete;
+    auto operator=(const context &) -> context & = delete;
+    ~context() { get().free(pointer); }
+  };
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief blocks of decompressed bytes passed from the thread that decompresses
+ * to the thread that reads them, at most queued_blocks are waiting so memory
+ * doesn't depend on the size of the input. Blocks that were read are given
+ * back and reused
+ */
+/* ----------------------------------------------------------------------------*/
+struct block_queue {
+ private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::string> blocks;
+  std::vector<std::string> spare;
+  bool finished = false;
+  bool stopped = false;
+  std::exception_ptr error;
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns empty block for the producer, a reused one when there is
+   * any
+   *
+   * @Returns std::string
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto empty_block() -> std::string {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spare.empty()) return std::string();
+    std::string block = std::move(spare.back());
+    spare.pop_back();
+    return block;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief waits until there is place for the block and adds it
+   *
+   * @Param std::string block
+   *
+   * @Returns bool false when the reader stopped and the producer should stop
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto push(std::string block) -> bool {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock,
+                 [this] { return stopped || blocks.size() < queued_blocks; });
+    if (stopped) return false;
+    blocks.push_back(std::move(block));
+    changed.notify_all();
+    return true;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief waits for the next block, the block that was read before is given
+   * back for reuse. Error of the producer is rethrown here
+   *
+   * @Param std::string reference to the block that was read, replaced with
+   * the next one
+   *
+   * @Returns bool false at the end of the input
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto pop(std::string &block) -> bool {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (block.capacity() && spare.size() < queued_blocks)
+      spare.push_back(std::move(block));
+    changed.wait(lock, [this] { return finished || !blocks.empty(); });
+    if (blocks.empty()) {
+      if (error) std::rethrow_exception(error);
+      return false;
+    }
+    block = std::move(blocks.front());
+    blocks.pop_front();
+    changed.notify_all();
+    return true;
+  }
+  auto finish(std::exception_ptr failure = nullptr) -> void {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    error = failure;
+    changed.notify_all();
+  }
+  auto stop() -> void {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    changed.notify_all();
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief reads the input the same way as read(2) reads a file, compressed
+ * input is decompressed on its own thread so decompression and everything
+ * that is done with the bytes that were read run at the same time. gzip with
+ * many members and zstd with many frames are read as one text, zero bytes
+ * after the last gzip member are skipped like gzip -d does, plain input is
+ * read directly
+ */
+/* ----------------------------------------------------------------------------*/
+struct reader {
+ private:
+  int descriptor;
+  std::string head;
+  std::size_t head_position;
+  format input_format;
+  block_queue queue;
+  std::string current;
+  std::size_t current_position;
+  std::thread producer;
+
+  auto read_input(void *data, std::size_t size) -> std::size_t {
+    if (head_position < head.size()) {
+      std::size_t const taken = std::min(size, head.size() - head_position);
+      std::memcpy(data, head.data() + head_position, taken);
+      head_position += taken;
+      return taken;
+    }
+    while (true) {
+      ssize_t const read_bytes = ::read(descriptor, data, size);
+      if (read_bytes >= 0) return read_bytes;
+      if (errno != EINTR) throw decompression_exception();
+    }
+  }
+  auto inflate_gzip() -> void {
+    const zlib &library = zlib::get();
+    zlib::stream stream{};
+    if (library.init(&stream, zlib::gzip_window, "1.2.11", sizeof(stream)) !=
+        zlib::ok)
+      throw decompression_exception();
+    std::vector<unsigned char> input(1 << 17);
+    std::string block = queue.empty_block();
+    block.resize(block_size);
+    auto start_block = [&] {
+      stream.next_out = reinterpret_cast<unsigned char *>(block.data());
+      stream.avail_out = block.size();
+    };
+    start_block();
+    bool end_of_input = false, member_done = false, padding = false;
+    try {
+      while (true) {
+        if (stream.avail_in == 0 && !end_of_input) {
+          std::size_t const read_bytes = read_input(input.data(), input.size());
+          end_of_input = read_bytes == 0;
+          stream.next_in = input.data();
+          stream.avail_in = read_bytes;
+        }
+        if (member_done) {
+          while (stream.avail_in > 0 && *stream.next_in == 0) {
+            ++stream.next_in;
+            --stream.avail_in;
+            padding = true;
+          }
+          if (padding && stream.avail_in > 0) throw decompression_exception();
+          if (padding && !end_of_input) continue;
+        }
+        int const code = library.inflate(&stream, 0);
+        if (stream.avail_out == 0) {
+          if (!queue.push(std::move(block))) break;
+          block = queue.empty_block();
+          block.resize(block_size);
+          start_block();
+        }
+        if (code == zlib::stream_end) {
+          member_done = true;
+          library.reset(&stream);
+        } else if (code == zlib::ok) {
+          member_done = false;
+        } else if (code != zlib::buffer_error) {
+          throw decompression_exception();
+        }
+        if (end_of_input && stream.avail_in == 0 && code != zlib::ok) {
+          if (!member_done) throw decompression_exception();
+          block.resize(block.size() - stream.avail_out);
+          if (!block.empty()) queue.push(std::move(block));
+          break;
+        }
+      }
+    } catch (...) {
+      library.end(&stream);
+      throw;
+    }
+    library.end(&stream);
+  }
+  auto decompress_zstd() -> void {
+    const zstd &library = zstd::get();
+    zstd::context context;
+    std::vector<char> input(1 << 17);
+    zstd::in_buffer in{input.data(), 0, 0};
+    std::string block = queue.empty_block();
+    block.resize(block_size);
+    zstd::out_buffer out{block.data(), block.size(), 0};
+    bool end_of_input = false;
+    std::size_t left = 1;
+    while (true) {
+      if (in.position == in.size && !end_of_input) {
+        in.size = read_input(input.data(), input.size());
+        in.position = 0;
+        end_of_input = in.size == 0;
+      }
+      bool const input_done = end_of_input && in.position == in.size;
+      if (input_done && left == 0) break;
+      std::size_t const before = out.position;
+      left = library.decompress_stream(context.pointer, &out, &in);
+      if (library.is_error(left)) throw decompression_exception();
+      if (input_done && left != 0 && out.position == before)
+        throw decompression_exception();
+      if (out.position == out.size) {
+        if (!queue.push(std::move(block))) return;
+        block = queue.empty_block();
+        block.resize(block_size);
+        out = {block.data(), block.size(), 0};
+      }
+    }
+    block.resize(out.position);
+    if (!block.empty()) queue.push(std::move(block));
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief reads the first bytes of the descriptor to recognize the format and
+   * starts the thread that decompresses compressed input
+   *
+   * @Param int file descriptor, it's not closed by the reader
+   */
+  /* ----------------------------------------------------------------------------*/
+  explicit reader(int descriptor)
+      : descriptor(descriptor), head_position(0), current_position(0) {
+    char first[magic_size];
+    std::size_t size = 0;
+    while (size < magic_size) {
+      std::size_t const read_bytes =
+          read_input(first + size, magic_size - size);
+      if (read_bytes == 0) break;
+      size += read_bytes;
+    }
+    head.assign(first, size);
+    input_format = detect(head);
+    if (input_format == format::gzip) zlib::get();
+    if (input_format == format::zstd) zstd::get();
+    if (input_format == format::plain) return;
+    producer = std::thread([this] {
+      try {
+        if (input_format == format::gzip)
+          inflate_gzip();
+        else
+          decompress_zstd();
+        queue.finish();
+      } catch (...) {
+        queue.finish(std::current_exception());
+      }
+    });
+  }
+  reader(const reader &) = delete;
+  auto operator=(const reader &) -> reader & = delete;
+  ~reader() {
+    if (!producer.joinable()) return;
+    queue.stop();
+    producer.join();
+  }
+  auto is_compressed() const -> bool { return input_format != format::plain; }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief reads at most size bytes of the (decompressed) input
+   *
+   * @Param char pointer
+   * @Param std::size_t size
+   *
+   * @Returns std::size_t bytes that were read, 0 at the end of the input
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto read(char *data, std::size_t size) -> std::size_t {
+    if (!is_compressed()) return read_input(data, size);
+    while (current_position == current.size()) {
+      if (!queue.pop(current)) return 0;
+      current_position = 0;
+    }
+    std::size_t const taken = std::min(size, current.size() - current_position);
+    std::memcpy(data, current.data() + current_position, taken);
+    current_position += taken;
+    return taken;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief decompresses zstd file of many frames with the frames split between
+ * threads of the pool, every frame is written straight to its place in the
+ * text. Works only when every frame has its size in the header, which is
+ * true for files compressed by zstd from a file (not from a pipe) and for
+ * files that were compressed in parts and concatenated
+ *
+ * @Param int file descriptor of a regular file
+ * @Param std::size_t size of the file
+ * @Param parallel::thread_pool pointer
+ * @Param std::string reference that gets the text
+ *
+ * @Returns bool false when the file can't be decompressed this way and has
+ * to be read with compressed::reader
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto decompress_frames(int descriptor, std::size_t size,
+                              parallel::thread_pool *pool, std::string &text)
+    -> bool {
+  if (!pool || pool->size() == 1 || size == 0 ||
+      format_of(descriptor) != format::zstd)
+    return false;
+  const zstd &library = zstd::get();
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  if (mapping == MAP_FAILED) return false;
+  std::unique_ptr<void, std::function<void(void *)>> const unmap(
+      mapping, [size](void *address) { munmap(address, size); });
+  const char *compressed_text = static_cast<const char *>(mapping);
+  struct frame {
+    std::size_t offset;
+    std::size_t size;
+    std::size_t text_offset;
+    std::size_t text_size;
+  };
+  std::vector<frame> frames;
+  std::size_t text_size = 0;
+  for (std::size_t offset = 0; offset < size;) {
+    std::size_t const frame_size =
+        library.frame_compressed_size(compressed_text + offset, size - offset);
+    if (library.is_error(frame_size)) throw decompression_exception();
+    unsigned long long const content_size =
+        library.frame_content_size(compressed_text + offset, frame_size);
+    if (content_size == zstd::unknown_size || content_size == zstd::error_size)
+      return false;
+    frames.push_back({offset, frame_size, text_size, content_size});
+    offset += frame_size;
+    text_size += content_size;
+  }
+  if (frames.size() < 2) return false;
+  text.resize(text_size);
+  std::size_t const ranges = std::min<std::size_t>(frames.size(), pool->size());
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    zstd::context context;
+    for (std::size_t i = frames.size() * range / ranges;
+         i < frames.size() * (range + 1) / ranges; ++i) {
+      std::size_t const written = library.decompress_frame(
+          context.pointer, text.data() + frames[i].text_offset,
+          frames[i].text_size, compressed_text + frames[i].offset,
+          frames[i].size);
+      if (library.is_error(written) || written != frames[i].text_size)
+        throw decompression_exception();
+    }
+  });
+  return true;
+}
+}  // namespace compressed
+namespace file {
+struct file_not_opened_exception : public std::exception {
+  const char *what() const throw() { return "File didn't open"; }
+};
+struct cannot_open_file_exception : public std::exception {
+  const char *what() const throw() {
+    return "Error while trying to process file";
+  }
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief RAII owner of read only memory mapping of the whole file
+ */
+/* ----------------------------------------------------------------------------*/
+struct mapped_region {
+ private:
+  void *address;
+  std::size_t length;
+
+ public:
+  mapped_region() : address(nullptr), length(0){};
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief maps length bytes of the already opened file descriptor, the
+   * descriptor can be closed right after the constructor returns
+   *
+   * @Param int file descriptor
+   * @Param std::size_t length of the file
+   */
+  /* ----------------------------------------------------------------------------*/
+  mapped_region(int descriptor, std::size_t length)
+      : address(nullptr), length(length) {
+    void *mapping =
+        mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (mapping == MAP_FAILED) throw cannot_open_file_exception();
+    address = mapping;
+    madvise(address, length, MADV_SEQUENTIAL);
+  }
+  mapped_region(const mapped_region &) = delete;
+  auto operator=(const mapped_region &) -> mapped_region & = delete;
+  mapped_region(mapped_region &&other) noexcept
+      : address(other.address), length(other.length) {
+    other.address = nullptr;
+    other.length = 0;
+  }
+  auto operator=(mapped_region &&other) noexcept -> mapped_region & {
+    std::swap(address, other.address);
+    std::swap(length, other.length);
+    return *this;
+  }
+  ~mapped_region() {
+    if (address) munmap(address, length);
+  }
+  auto view() const -> std::string_view {
+    return {static_cast<const char *>(address), length};
+  }
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief asks the kernel to start reading the whole file into the page cache
+ * and returns right away, the file is read in the background while other
+ * files are processed
+ *
+ * @Param const std::string reference
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto read_ahead(const std::string &file_name) -> void {
+  int const descriptor = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) return;
+  posix_fadvise(descriptor, 0, 0, POSIX_FADV_WILLNEED);
+  close(descriptor);
+}
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief specifies how manage_file gets the bytes of the file, mapped is
+ * zero-copy and falls back to buffered for files that can't be mapped
+ * (pipes, character devices, empty files)
+ */
+/* ----------------------------------------------------------------------------*/
+enum class load_mode { mapped, buffered };
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief compact reference to a line or a word, offset from the beginning of
+ * the text and length. Offset is split to two 32 bit halves so the reference
+ * takes 12 bytes instead of 16 of std::string_view
+ */
+/* ----------------------------------------------------------------------------*/
+struct text_ref {
+  std::uint32_t offset_low;
+  std::uint32_t offset_high;
+  std::uint32_t length;
+
+  text_ref(std::size_t offset, std::size_t length)
+      : offset_low(std::uint32_t(offset)),
+        offset_high(std::uint32_t(std::uint64_t(offset) >> 32)),
+        length(std::uint32_t(length)){};
+  auto offset() const -> std::size_t {
+    return std::size_t(offset_high) << 32 | offset_low;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief read only view of lines or words of the text, elements are returned
+ * as std::string_view into the text
+ */
+/* ----------------------------------------------------------------------------*/
+struct ref_table {
+ private:
+  std::string_view text;
+  std::span<const text_ref> refs;
+
+ public:
+  struct iterator {
+    const ref_table *table;
+    std::size_t index;
+    auto operator*() const -> std::string_view { return (*table)[index]; }
+    auto operator++() -> iterator & {
+      ++index;
+      return *this;
+    }
+    auto operator==(const iterator &other) const -> bool {
+      return index == other.index;
+    }
+  };
+  ref_table() = default;
+  ref_table(std::string_view text, std::span<const text_ref> refs)
+      : text(text), refs(refs){};
+  auto size() const -> std::size_t { return refs.size(); }
+  auto empty() const -> bool { return refs.empty(); }
+  auto operator[](std::size_t index) const -> std::string_view {
+    return {text.data() + refs[index].offset(), refs[index].length};
+  }
+  auto begin() const -> iterator { return {this, 0}; }
+  auto end() const -> iterator { return {this, refs.size()}; }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief splits chunk of the text to lines the same way std::getline does it,
+ * last line is present only if it is not empty
+ *
+ * @Param std::string_view whole text
+ * @Param std::string_view chunk of the text
+ * @Param file::text_ref pointer where lines are written
+ *
+ * @Returns file::text_ref pointer after the last written line
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline split_lines(std::string_view text, std::string_view chunk,
+                        text_ref *lines) -> text_ref * {
+  const char *position = chunk.data();
+  const char *end = chunk.data() + chunk.size();
+  while (position != end) {
+    const char *newline = static_cast<const char *>(
+        std::memchr(position, '\n', end - position));
+    if (!newline) newline = end;
+    *lines++ = text_ref(position - text.data(), newline - position);
+    position = newline == end ? end : newline + 1;
+  }
+  return lines;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief splits chunk of the text to words the same way std::istream_iterator
+ * does it
+ *
+ * @Param std::string_view whole text
+ * @Param std::string_view chunk of the text
+ * @Param file::text_ref pointer where words are written
+ *
+ * @Returns file::text_ref pointer after the last written word
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline split_words(std::string_view text, std::string_view chunk,
+                        text_ref *words) -> text_ref * {
+  const char *position = chunk.data();
+  const char *end = chunk.data() + chunk.size();
+  while (position != end) {
+    while (position != end && helper::is_space(*position)) ++position;
+    const char *word_begin = position;
+    while (position != end && !helper::is_space(*position)) ++position;
+    if (word_begin != position)
+      *words++ = text_ref(word_begin - text.data(), position - word_begin);
+  }
+  return words;
+}
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief struct that's purpose to keep the state of the file, lines and words
+ * are kept as std::string_view into the bytes of the file so nothing is copied
+ * after the file is loaded
+ */
+/* ----------------------------------------------------------------------------*/
+struct manage_file {
+ private:
+  const std::string file_name;
+  mapped_region mapping;
+  std::string buffer;
+  std::string_view text;
+  mutable std::pmr::monotonic_buffer_resource arena;
+  mutable std::mutex arena_mutex;
+  mutable std::once_flag lines_built;
+  mutable std::once_flag words_built;
+  mutable std::once_flag unicode_words_built;
+  mutable std::once_flag ascii_checked;
+  mutable ref_table my_lines;
+  mutable ref_table my_words;
+  mutable ref_table my_unicode_words;
+  mutable bool ascii_text;
+  mutable std::mutex summary_mutex;
+  mutable scan::summary my_summary;
+  mutable unsigned scanned_counters;
+  mutable std::once_flag anagram_index_built[3];
+  mutable helper::anagram_index my_anagram_index[3];
+  parallel::thread_pool *pool;
+  bool loaded;
+
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief reads whole content of the descriptor to the owned buffer, gzip and
+   * zstd input is decompressed. zstd file of many frames is decompressed in
+   * parallel with the pool, otherwise compressed input is decompressed on its
+   * own thread while the blocks that are already decompressed are scanned, so
+   * get_summary doesn't have to read the text again
+   *
+   * @Param int file descriptor
+   * @Param const struct stat reference of the descriptor
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto read_to_buffer(int descriptor, const struct stat &file_stat) -> void {
+    if (S_ISREG(file_stat.st_mode) &&
+        compressed::decompress_frames(descriptor, file_stat.st_size, pool,
+                                      buffer)) {
+      text = buffer;
+      return;
+    }
+    compressed::reader input(descriptor);
+    scan::scanner scanner;
+    std::vector<char> chunk(input.is_compressed() ? compressed::block_size
+                                                  : 1 << 16);
+    try {
+      std::size_t read_bytes;
+      while ((read_bytes = input.read(chunk.data(), chunk.size())) != 0) {
+        buffer.append(chunk.data(), read_bytes);
+        if (input.is_compressed())
+          scanner.feed(std::string_view(chunk.data(), read_bytes));
+      }
+    } catch (compressed::decompression_exception &) {
+      if (input.is_compressed()) throw;
+      throw cannot_open_file_exception();
+    }
+    if (input.is_compressed()) {
+      my_summary = scanner.finish();
+      scanned_counters = scan::all;
+    }
+    text = buffer;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief builds table of lines or words of the text in the arena of the file.
+   * Chunks of the text are counted first so the table is allocated once with
+   * exact size and then every chunk is split directly to its part of the table,
+   * with the pool chunks are counted and split in parallel
+   *
+   * @Param unsigned scan::lines or scan::words
+   *
+   * @Returns file::ref_table
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto build_table(unsigned counter) const -> ref_table {
+    std::size_t const pieces = pool ? pool->size() * 4 : 1;
+    auto const chunks =
+        counter == scan::lines
+            ? parallel::split_chunks(text, pieces,
+                                     [](char c) { return c == '\n'; })
+            : parallel::split_chunks(
+                  text, pieces, [](char c) { return helper::is_space(c); });
+    std::vector<std::size_t> chunk_begin(chunks.size() + 1, 0);
+    parallel::for_each_index(pool, chunks.size(), [&](std::size_t i) {
+      scan::summary const chunk_summary = scan::count(chunks[i], counter);
+      chunk_begin[i + 1] =
+          counter == scan::lines ? chunk_summary.lines : chunk_summary.words;
+    });
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+      chunk_begin[i + 1] += chunk_begin[i];
+    text_ref *refs;
+    {
+      std::lock_guard<std::mutex> lock(arena_mutex);
+      refs = static_cast<text_ref *>(arena.allocate(
+          chunk_begin.back() * sizeof(text_ref), alignof(text_ref)));
+    }
+    parallel::for_each_index(pool, chunks.size(), [&](std::size_t i) {
+      if (counter == scan::lines)
+        split_lines(text, chunks[i], refs + chunk_begin[i]);
+      else
+        split_words(text, chunks[i], refs + chunk_begin[i]);
+    });
+    return ref_table(text, std::span<const text_ref>(refs, chunk_begin.back()));
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief builds table of words separated by Unicode whitespace from the
+   * table of words, ascii words are copied and only the other words are
+   * decoded and split again. Like build_table ranges are counted first and
+   * then written to the arena
+   *
+   * @Returns file::ref_table
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto build_unicode_table() const -> ref_table {
+    const auto &words = get_all_words();
+    std::size_t const ranges = pool ? pool->size() * 4 : 1;
+    auto split_range = [&words, ranges](std::size_t range, auto emit) {
+      for (std::size_t i = words.size() * range / ranges;
+           i < words.size() * (range + 1) / ranges; ++i) {
+        if (unicode::is_ascii(words[i]))
+          emit(words[i]);
+        else
+          unicode::for_each_word(words[i], emit);
+      }
+    };
+    std::vector<std::size_t> range_begin(ranges + 1, 0);
+    parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+      split_range(range,
+                  [&](std::string_view) { ++range_begin[range + 1]; });
+    });
+    for (std::size_t i = 0; i < ranges; ++i)
+      range_begin[i + 1] += range_begin[i];
+    text_ref *refs;
+    {
+      std::lock_guard<std::mutex> lock(arena_mutex);
+      refs = static_cast<text_ref *>(arena.allocate(
+          range_begin.back() * sizeof(text_ref), alignof(text_ref)));
+    }
+    parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+      text_ref *position = refs + range_begin[range];
+      split_range(range, [&](std::string_view word) {
+        *position++ = text_ref(word.data() - text.data(), word.size());
+      });
+    });
+    return ref_table(text, std::span<const text_ref>(refs, range_begin.back()));
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief Constructor that maps the file with supplied file_name to memory
+   * (or reads it to the buffer when mode is buffered or file can't be mapped),
+   * lines and words are indexed when they are needed for the first time. When
+   * pool is given it's used for indexing and scanning of the file
+   *
+   * @Param const std::string reference
+   * @Param file::load_mode
+   * @Param parallel::thread_pool pointer (can be nullptr)
+   */
+  /* ----------------------------------------------------------------------------*/
+  manage_file()
+      : ascii_text(false), scanned_counters(0), pool(nullptr), loaded(false){};
+  manage_file(const std::string &file_name,
+              load_mode mode = load_mode::mapped,
+              parallel::thread_pool *pool = nullptr)
+      : file_name(file_name),
+        ascii_text(false),
+        scanned_counters(0),
+        pool(pool),
+        loaded(false) {
+    stats::scoped_phase const phase("load");
+    int descriptor = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    try {
+      if (descriptor < 0) throw cannot_open_file_exception();
+      struct stat file_stat;
+      if (fstat(descriptor, &file_stat) != 0)
+        throw cannot_open_file_exception();
+      if (mode == load_mode::mapped && S_ISREG(file_stat.st_mode) &&
+          file_stat.st_size > 0 &&
+          compressed::format_of(descriptor) == compressed::format::plain) {
+        mapping = mapped_region(descriptor, file_stat.st_size);
+        text = mapping.view();
+      } else {
+        read_to_buffer(descriptor, file_stat);
+      }
+      close(descriptor);
+      loaded = true;
+      stats::add_bytes_read(text.size());
+    } catch (cannot_open_file_exception &e) {
+      if (descriptor >= 0) {
+        close(descriptor);
+        std::cerr << "There was an error when reading a file" << std::endl;
+      } else {
+        std::cerr << "Wrong file name was provided" << std::endl;
+      }
+      throw e;
+    } catch (...) {
+      if (descriptor >= 0) close(descriptor);
+      throw;
+    }
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief Constructor of the file that is a part of already loaded file, the
+   * text is not copied so the whole file has to live longer than the part.
+   * Lines, words and counters are built only for the part
+   *
+   * @Param const file::manage_file reference whole file
+   * @Param std::string_view part of the text of the whole file
+   */
+  /* ----------------------------------------------------------------------------*/
+  manage_file(const manage_file &whole, std::string_view part)
+      : file_name(whole.file_name),
+        text(part),
+        ascii_text(false),
+        scanned_counters(0),
+        pool(whole.pool),
+        loaded(whole.loaded){};
+  manage_file(const manage_file &) = delete;
+  auto operator=(const manage_file &) -> manage_file & = delete;
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns file::ref_table that contains all of the lines that are
+   * present in the file(including empty ones), table is built on the first call
+   *
+   *
+   * @Returns const file::ref_table reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_all_lines() const -> const ref_table & {
+    if (!loaded) throw file_not_opened_exception();
+    std::call_once(lines_built, [this] {
+      stats::scoped_phase const phase("index_lines");
+      my_lines = build_table(scan::lines);
+    });
+    return my_lines;
+  }
+
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns file::ref_table that contains all of the words that are
+   * present in the file, table is built on the first call and all of the flags
+   * share it
+   *
+   *
+   * @Returns const file::ref_table reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_all_words() const -> const ref_table & {
+    if (!loaded) throw file_not_opened_exception();
+    std::call_once(words_built, [this] {
+      stats::scoped_phase const phase("index_words");
+      my_words = build_table(scan::words);
+    });
+    return my_words;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief checks once if the whole file is ascii
+   *
+   * @Returns bool
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto is_ascii() const -> bool {
+    if (!loaded) throw file_not_opened_exception();
+    std::call_once(ascii_checked,
+                   [this] { ascii_text = unicode::is_ascii(text); });
+    return ascii_text;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns the text mode in which the file is compared, every byte of
+   * ascii file is one character so utf8 is the same as bytes for it
+   *
+   * @Param unicode::text_mode
+   *
+   * @Returns unicode::text_mode
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto matching_mode(unicode::text_mode mode) const -> unicode::text_mode {
+    if (mode == unicode::text_mode::utf8 && is_ascii())
+      return unicode::text_mode::bytes;
+    return mode;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns words of the file in the text mode, with utf8 modes words
+   * are also separated by Unicode whitespace. For ascii file it is the same
+   * table as get_all_words()
+   *
+   * @Param unicode::text_mode
+   *
+   * @Returns const file::ref_table reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_all_words(unicode::text_mode mode) const -> const ref_table & {
+    if (mode == unicode::text_mode::bytes || is_ascii()) return get_all_words();
+    std::call_once(unicode_words_built, [this] {
+      stats::scoped_phase const phase("index_words");
+      my_unicode_words = build_unicode_table();
+    });
+    return my_unicode_words;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns all bytes of the file, lines and words are views into it
+   *
+   * @Returns std::string_view
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_text() const -> std::string_view {
+    if (!loaded) throw file_not_opened_exception();
+    return text;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief return number of lines
+   *
+   * @Returns long long
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_lines_number() const -> long long {
+    return get_all_lines().size();
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns counters of the file, all of the requested counters that
+   * were not collected before are collected in one pass over the file, calls
+   * from different threads wait for each other
+   *
+   * @Param unsigned bits of scan::counter
+   *
+   * @Returns const scan::summary reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_summary(unsigned requested) const -> const scan::summary & {
+    if (!loaded) throw file_not_opened_exception();
+    std::lock_guard<std::mutex> lock(summary_mutex);
+    unsigned const missing = requested & ~scanned_counters;
+    if (!missing) return my_summary;
+    stats::scoped_phase const phase("scan");
+    scan::summary const fresh = scan::count(text, missing, pool);
+    if (missing & scan::lines) my_summary.lines = fresh.lines;
+    if (missing & scan::digits) my_summary.digits = fresh.digits;
+    if (missing & scan::numbers) my_summary.numbers = fresh.numbers;
+    if (missing & scan::chars) my_summary.chars = fresh.chars;
+    if (missing & scan::words) my_summary.words = fresh.words;
+    scanned_counters |= missing;
+    return my_summary;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns index of words of the file grouped by anagram signature of
+   * the text mode, index is built on the first call and reused by every call
+   * after it
+   *
+   * @Param unicode::text_mode
+   *
+   * @Returns const helper::anagram_index reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_anagram_index(
+      unicode::text_mode mode = unicode::text_mode::bytes) const
+      -> const helper::anagram_index & {
+    if (!loaded) throw file_not_opened_exception();
+    mode = matching_mode(mode);
+    std::size_t const slot = std::size_t(mode);
+    std::call_once(anagram_index_built[slot], [this, mode, slot] {
+      stats::scoped_phase const phase("anagram_index");
+      my_anagram_index[slot] =
+          helper::anagram_index(get_all_words(mode), pool, mode);
+    });
+    return my_anagram_index[slot];
+  }
+};
+
+}  // namespace file
+namespace sorting {
+struct spill_failed_exception : public std::exception {
+  const char *what() const throw() {
+    return "Error while writing sorted words to temporary file";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief word prepared for sorting, first 8 bytes of the word are kept inline
+ * in big endian order so most comparisons are one integer comparison, the
+ * rest of the word is read from the shared text only when prefixes are equal
+ */
+/* ----------------------------------------------------------------------------*/
+struct sort_key {
+  std::uint64_t prefix;
+  std::uint64_t offset;
+  std::uint32_t length;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief builds sort_key for the word that lies inside of the text
+ *
+ * @Param std::string_view word
+ * @Param const char pointer to the beginning of the text
+ *
+ * @Returns sorting::sort_key
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto make_key(std::string_view word, const char *base) -> sort_key {
+  std::uint64_t prefix = 0;
+  std::size_t const inline_bytes = std::min<std::size_t>(word.size(), 8);
+  for (std::size_t i = 0; i < inline_bytes; ++i)
+    prefix |= std::uint64_t(static_cast<unsigned char>(word[i]))
+              << (56 - 8 * i);
+  return {prefix, std::uint64_t(word.data() - base),
+          std::uint32_t(word.size())};
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief orders sort_keys the same way std::string compares the words
+ */
+/* ----------------------------------------------------------------------------*/
+struct key_less {
+  const char *base;
+  auto operator()(const sort_key &left, const sort_key &right) const -> bool {
+    if (left.prefix != right.prefix) return left.prefix < right.prefix;
+    if (left.length <= 8 || right.length <= 8)
+      return left.length < right.length;
+    return std::string_view(base + left.offset + 8, left.length - 8) <
+           std::string_view(base + right.offset + 8, right.length - 8);
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief sorts keys with sample sort: splitters are chosen from a sample of
+ * keys, keys are distributed to buckets between the splitters in parallel and
+ * every bucket is sorted on its own thread. Without the pool it's std::sort
+ *
+ * @Param std::vector<sorting::sort_key> reference
+ * @Param const char pointer to the beginning of the text
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto sort_keys(std::vector<sort_key> &keys, const char *base,
+                      parallel::thread_pool *pool) -> void {
+  key_less const less{base};
+  std::size_t const buckets = pool ? pool->size() * 4 : 1;
+  if (buckets == 1 || keys.size() < buckets * 1024) {
+    std::sort(keys.begin(), keys.end(), less);
+    return;
+  }
+  std::size_t const oversampling = 32;
+  std::vector<sort_key> samples;
+  std::size_t const stride = keys.size() / (buckets * oversampling);
+  for (std::size_t i = 0; i < buckets * oversampling; ++i)
+    samples.push_back(keys[i * stride]);
+  std::sort(samples.begin(), samples.end(), less);
+  std::vector<sort_key> splitters;
+  for (std::size_t i = 1; i < buckets; ++i)
+    splitters.push_back(samples[i * oversampling]);
+
+  std::size_t const ranges = pool->size();
+  std::vector<std::uint32_t> bucket_of(keys.size());
+  std::vector<std::vector<std::size_t>> counts(
+      ranges, std::vector<std::size_t>(buckets, 0));
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    for (std::size_t i = keys.size() * range / ranges;
+         i < keys.size() * (range + 1) / ranges; ++i) {
+      bucket_of[i] = std::upper_bound(splitters.begin(), splitters.end(),
+                                      keys[i], less) -
+                     splitters.begin();
+      ++counts[range][bucket_of[i]];
+    }
+  });
+  std::vector<std::size_t> bucket_begin(buckets + 1, 0);
+  std::vector<std::vector<std::size_t>> write_position(
+      ranges, std::vector<std::size_t>(buckets, 0));
+  for (std::size_t bucket = 0, position = 0; bucket < buckets; ++bucket) {
+    bucket_begin[bucket] = position;
+    for (std::size_t range = 0; range < ranges; ++range) {
+      write_position[range][bucket] = position;
+      position += counts[range][bucket];
+    }
+  }
+  bucket_begin[buckets] = keys.size();
+  std::vector<sort_key> distributed(keys.size());
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    for (std::size_t i = keys.size() * range / ranges;
+         i < keys.size() * (range + 1) / ranges; ++i)
+      distributed[write_position[range][bucket_of[i]]++] = keys[i];
+  });
+  parallel::for_each_index(pool, buckets, [&](std::size_t bucket) {
+    std::sort(distributed.begin() + bucket_begin[bucket],
+              distributed.begin() + bucket_begin[bucket + 1], less);
+  });
+  keys.swap(distributed);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief default memory budget for keys of the sort, half of the physical
+ * memory of the machine
+ *
+ * @Returns std::size_t bytes
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto default_memory_budget() -> std::size_t {
+  long const pages = sysconf(_SC_PHYS_PAGES);
+  long const page_size = sysconf(_SC_PAGE_SIZE);
+  if (pages <= 0 || page_size <= 0) return std::size_t(1) << 30;
+  return std::size_t(pages) * std::size_t(page_size) / 2;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief sorted run of words that was spilled to temporary file, the file is
+ * removed when the run is destroyed
+ */
+/* ----------------------------------------------------------------------------*/
+struct spilled_run {
+ private:
+  std::FILE *stream;
+  char *line;
+  std::size_t capacity;
+
+ public:
+  std::string_view current;
+
+  spilled_run() : stream(std::tmpfile()), line(nullptr), capacity(0) {
+    if (!stream) throw spill_failed_exception();
+  }
+  spilled_run(const spilled_run &) = delete;
+  auto operator=(const spilled_run &) -> spilled_run & = delete;
+  ~spilled_run() {
+    std::free(line);
+    std::fclose(stream);
+  }
+  auto write(std::string_view word) -> void {
+    if (std::fwrite(word.data(), 1, word.size(), stream) != word.size() ||
+        std::fputc('\n', stream) == EOF)
+      throw spill_failed_exception();
+  }
+  auto rewind() -> void {
+    if (std::fflush(stream) != 0) throw spill_failed_exception();
+    std::rewind(stream);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief reads next word of the run to current
+   *
+   * @Returns bool false when the run is exhausted
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto next() -> bool {
+    ssize_t const length = getline(&line, &capacity, stream);
+    if (length <= 0) return false;
+    current = std::string_view(line, length - 1);
+    return true;
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief number of runs that are merged at once, every run keeps its
+ * temporary file open so a quarter of the limit of open files of the process
+ * is used, leaving the rest for the files of the command and of other
+ * commands of the batch
+ *
+ * @Returns std::size_t
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto merge_fan_in() -> std::size_t {
+  std::size_t open_files = 1024;
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    open_files = limit.rlim_cur;
+  return std::clamp<std::size_t>(open_files / 4, 2, 256);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief merges the rewound runs and calls write for every word in the order
+ * of the runs
+ *
+ * @Param std::vector<std::unique_ptr<spilled_run>> reference
+ * @Param bool true when the runs are in reversed alphabetical order
+ * @Param write callable with std::string_view
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename Writer>
+auto merge_runs(const std::vector<std::unique_ptr<spilled_run>> &runs,
+                bool descending, Writer &&write) -> void {
+  auto later = [descending, &runs](std::size_t left, std::size_t right) {
+    return descending ? runs[left]->current < runs[right]->current
+                      : runs[right]->current < runs[left]->current;
+  };
+  std::vector<std::size_t> heap;
+  for (std::size_t run = 0; run < runs.size(); ++run)
+    if (runs[run]->next()) heap.push_back(run);
+  std::make_heap(heap.begin(), heap.end(), later);
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    std::size_t const run = heap.back();
+    write(runs[run]->current);
+    if (runs[run]->next())
+      std::push_heap(heap.begin(), heap.end(), later);
+    else
+      heap.pop_back();
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief returns keys of words in [begin, end) in alphabetical order
+ *
+ * @Param const file::ref_table reference
+ * @Param const char pointer to the beginning of the text the words are in
+ * @Param std::size_t index of the first word
+ * @Param std::size_t index after the last word
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns std::vector<sorting::sort_key>
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto sorted_keys(const file::ref_table &words, const char *base,
+                        std::size_t begin, std::size_t end,
+                        parallel::thread_pool *pool) -> std::vector<sort_key> {
+  std::vector<sort_key> keys;
+  keys.reserve(end - begin);
+  for (std::size_t i = begin; i < end; ++i)
+    keys.push_back(make_key(words[i], base));
+  sort_keys(keys, base, pool);
+  return keys;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checks if keys of all words fit in memory_budget so they can be
+ * sorted at once without spilling
+ *
+ * @Param std::size_t number of words
+ * @Param std::size_t memory budget in bytes
+ *
+ * @Returns bool
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto fits_in_memory(std::size_t words, std::size_t memory_budget)
+    -> bool {
+  return words <= std::max<std::size_t>(1, memory_budget / sizeof(sort_key));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief calls function with every word of the text in the order of the text
+ * without building the table of words, words of utf8 modes are separated by
+ * Unicode whitespace like in file::manage_file::get_all_words
+ *
+ * @Param std::string_view
+ * @Param unicode::text_mode
+ * @Param function callable with std::string_view
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename Function>
+auto for_each_text_word(std::string_view text, unicode::text_mode mode,
+                        Function function) -> void {
+  if (mode != unicode::text_mode::bytes) {
+    unicode::for_each_word(text, function);
+    return;
+  }
+  const char *position = text.data();
+  const char *end = text.data() + text.size();
+  while (position != end) {
+    while (position != end && helper::is_space(*position)) ++position;
+    const char *word_begin = position;
+    while (position != end && !helper::is_space(*position)) ++position;
+    if (word_begin != position)
+      function(std::string_view(word_begin, position - word_begin));
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief number of words of the file in the mode, taken from the counters of
+ * the scan so the table of words is not built for it
+ *
+ * @Param const file::manage_file reference
+ * @Param unicode::text_mode
+ *
+ * @Returns std::size_t
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto word_count(const file::manage_file &file, unicode::text_mode mode)
+    -> std::size_t {
+  if (mode == unicode::text_mode::bytes || file.is_ascii())
+    return file.get_summary(scan::words).words;
+  std::size_t count = 0;
+  unicode::for_each_word(file.get_text(),
+                         [&count](std::string_view) { ++count; });
+  return count;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief sorts words of the file and calls write for every word in sorted
+ * order. When the keys of all words don't fit in memory_budget, words are
+ * read from the text straight to runs that fit the budget, every run is
+ * sorted, spilled to temporary file and the runs are merged, at most
+ * merge_fan_in() of them at once so the number of open temporary files stays
+ * small for files much larger than the budget. The table of
+ * all words is not built then, only the keys of one run are in memory next
+ * to the text of the file (which is mapped, or decompressed to memory for
+ * gzip and zstd files)
+ *
+ * @Param const file::manage_file reference
+ * @Param unicode::text_mode mode in which words are split
+ * @Param bool true for reversed alphabetical order
+ * @Param std::size_t memory budget in bytes
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param write callable with std::string_view
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename Writer>
+auto sort_words(const file::manage_file &file, unicode::text_mode mode,
+                bool descending, std::size_t memory_budget,
+                parallel::thread_pool *pool, Writer write) -> void {
+  std::string_view const text = file.get_text();
+  const char *base = text.data();
+  auto key_word = [base](const sort_key &key) {
+    return std::string_view(base + key.offset, key.length);
+  };
+  std::size_t const words = word_count(file, mode);
+  if (fits_in_memory(words, memory_budget)) {
+    const auto &table = file.get_all_words(mode);
+    auto keys = sorted_keys(table, base, 0, table.size(), pool);
+    if (descending) std::reverse(keys.begin(), keys.end());
+    for (const auto &key : keys) write(key_word(key));
+    return;
+  }
+  std::size_t const run_size =
+      std::max<std::size_t>(1, memory_budget / sizeof(sort_key));
+  // runs[level] holds runs made of merge_fan_in()^level spilled runs, when
+  // a level is full its runs are merged to one run of the next level so the
+  // number of open runs grows with the logarithm of the size of the file
+  std::size_t const fan_in = merge_fan_in();
+  std::vector<std::vector<std::unique_ptr<spilled_run>>> runs;
+  auto add_run = [&](std::unique_ptr<spilled_run> run) {
+    for (std::size_t level = 0;; ++level) {
+      if (runs.size() == level) runs.emplace_back();
+      runs[level].push_back(std::move(run));
+      if (runs[level].size() < fan_in) return;
+      run = std::make_unique<spilled_run>();
+      merge_runs(runs[level], descending,
+                 [&run](std::string_view word) { run->write(word); });
+      run->rewind();
+      runs[level].clear();
+    }
+  };
+  std::vector<sort_key> keys;
+  keys.reserve(std::min(run_size, words));
+  auto spill = [&] {
+    sort_keys(keys, base, pool);
+    if (descending) std::reverse(keys.begin(), keys.end());
+    auto run = std::make_unique<spilled_run>();
+    for (const auto &key : keys) run->write(key_word(key));
+    run->rewind();
+    add_run(std::move(run));
+    keys.clear();
+  };
+  for_each_text_word(text, mode, [&](std::string_view word) {
+    keys.push_back(make_key(word, base));
+    if (keys.size() == run_size) spill();
+  });
+  if (!keys.empty()) spill();
+  std::vector<sort_key>().swap(keys);
+  std::vector<std::unique_ptr<spilled_run>> last;
+  for (auto &level : runs)
+    for (auto &run : level) last.push_back(std::move(run));
+  merge_runs(last, descending, write);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief collation order of the locale from LC_ALL, LC_COLLATE or LANG. The
+ * "C" and "POSIX" locales and locales that are not installed order words by
+ * codepoints, which for UTF-8 is the same as the order of bytes
+ */
+/* ----------------------------------------------------------------------------*/
+struct collation {
+ private:
+  locale_t locale;
+
+ public:
+  collation() : locale(locale_t(0)) {
+    const char *name = nullptr;
+    for (const char *variable : {"LC_ALL", "LC_COLLATE", "LANG"}) {
+      name = std::getenv(variable);
+      if (name && *name) break;
+      name = nullptr;
+    }
+    if (!name) return;
+    std::string_view const locale_name(name);
+    if (locale_name == "C" || locale_name == "POSIX" ||
+        locale_name.starts_with("C."))
+      return;
+    locale = newlocale(LC_COLLATE_MASK, name, locale_t(0));
+  }
+  collation(const collation &) = delete;
+  auto operator=(const collation &) -> collation & = delete;
+  ~collation() {
+    if (locale) freelocale(locale);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns collation of the environment, it's read once
+   *
+   * @Returns const sorting::collation reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  static auto environment() -> const collation & {
+    static const collation from_environment;
+    return from_environment;
+  }
+  auto codepoint_order() const -> bool { return !locale; }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief writes key of the word, keys compared byte by byte are in the
+   * collation order of the words
+   *
+   * @Param std::string_view
+   * @Param std::string reference that is overwritten with the key
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto key(std::string_view word, std::string &key) const -> void {
+    thread_local std::string terminated;
+    terminated.assign(word);
+    key.resize(std::max(key.capacity(), 2 * word.size() + 16));
+    std::size_t length =
+        strxfrm_l(key.data(), terminated.c_str(), key.size(), locale);
+    if (length >= key.size()) {
+      key.resize(length + 1);
+      length = strxfrm_l(key.data(), terminated.c_str(), key.size(), locale);
+    }
+    key.resize(length);
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief sorts words in the collation order and calls write for every word.
+ * Keys are made once for every distinct word (in parallel on the pool), words
+ * with the same key are ordered by bytes and every word is written as many
+ * times as it is in the table. Only distinct words are kept in memory so the
+ * memory budget of sort_words doesn't apply
+ *
+ * @Param const file::ref_table reference
+ * @Param const sorting::collation reference
+ * @Param bool true for reversed order
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param write callable with std::string_view
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename Writer>
+auto sort_collated(const file::ref_table &words, const collation &order,
+                   bool descending, parallel::thread_pool *pool, Writer write)
+    -> void {
+  struct collated {
+    std::string key;
+    std::string_view word;
+    std::uint64_t count;
+  };
+  std::vector<collated> distinct;
+  {
+    auto const counts = helper::word_counts::count(words, pool);
+    distinct.reserve(counts.size());
+    counts.for_each([&distinct](std::string_view word, std::uint64_t count) {
+      distinct.push_back({std::string(), word, count});
+    });
+  }
+  std::size_t const ranges = pool ? pool->size() * 4 : 1;
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    for (std::size_t i = distinct.size() * range / ranges;
+         i < distinct.size() * (range + 1) / ranges; ++i)
+      order.key(distinct[i].word, distinct[i].key);
+  });
+  std::sort(distinct.begin(), distinct.end(),
+            [](const collated &left, const collated &right) {
+              if (left.key != right.key) return left.key < right.key;
+              return left.word < right.word;
+            });
+  if (descending) std::reverse(distinct.begin(), distinct.end());
+  for (const auto &sorted : distinct)
+    for (auto repeat = sorted.count; repeat; --repeat) write(sorted.word);
+}
+}  // namespace sorting
+namespace cache {
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief loaded file with the derived data that is memoized next to it, the
+ * file keeps its own tables of lines and words, counters and anagram index and
+ * the sorted order of the words is kept here. It's safe to use from many
+ * commands at the same time
+ */
+/* ----------------------------------------------------------------------------*/
+struct cached_file {
+ private:
+  mutable std::once_flag sorted_built[2];
+  mutable std::vector<sorting::sort_key> my_sorted_keys[2];
+  const std::shared_ptr<const cached_file> whole;
+
+ public:
+  const file::manage_file file;
+
+  cached_file(const std::string &file_name, parallel::thread_pool *pool,
+              file::load_mode mode = file::load_mode::mapped)
+      : file(file_name, mode, pool){};
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief part of the cached file, the whole file is kept alive by the part
+   *
+   * @Param std::shared_ptr<const cache::cached_file> whole file
+   * @Param std::string_view part of the text of the whole file
+   */
+  /* ----------------------------------------------------------------------------*/
+  cached_file(std::shared_ptr<const cached_file> whole, std::string_view part)
+      : whole(std::move(whole)), file(this->whole->file, part){};
+  cached_file(const cached_file &) = delete;
+  auto operator=(const cached_file &) -> cached_file & = delete;
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns keys of all words of the file in alphabetical order, keys
+   * are sorted on the first call and reused by -s and -rs of every command
+   * after it. Words that don't fit in memory_budget are not memoized. Words of
+   * the utf8 modes are kept apart because they can be split differently
+   *
+   * @Param std::size_t memory budget in bytes
+   * @Param parallel::thread_pool pointer (can be nullptr)
+   * @Param unicode::text_mode
+   *
+   * @Returns const std::vector<sorting::sort_key> pointer, nullptr when keys
+   * don't fit in memory_budget
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_sorted_keys(std::size_t memory_budget, parallel::thread_pool *pool,
+                       unicode::text_mode mode = unicode::text_mode::bytes)
+      const -> const std::vector<sorting::sort_key> * {
+    if (!sorting::fits_in_memory(sorting::word_count(file, mode),
+                                 memory_budget))
+      return nullptr;
+    std::size_t const slot = mode != unicode::text_mode::bytes;
+    std::call_once(sorted_built[slot], [&] {
+      stats::scoped_phase const phase("sort");
+      const auto &words = file.get_all_words(mode);
+      my_sorted_keys[slot] = sorting::sorted_keys(
+          words, file.get_text().data(), 0, words.size(), pool);
+    });
+    return &my_sorted_keys[slot];
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief files loaded by the commands of one -i batch or of the server, keyed
+ * by path and checked against mtime and size of the file so a file that was
+ * changed is loaded again. The first command that asks for a file loads it
+ * and the commands that ask at the same time wait for it instead of loading
+ * it again. Files that are not regular files (pipes, devices) are never
+ * cached. The server reads files to memory instead of mapping them, a mapped
+ * file that is truncated while it's used (copytruncate log rotation) kills
+ * the process with SIGBUS
+ */
+/* ----------------------------------------------------------------------------*/
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief returns absolute path with symbolic links of its existing part
+ * resolved, so different names of the same file are equal
+ *
+ * @Param const std::string reference
+ *
+ * @Returns std::string
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto normalized_path(const std::string &path) -> std::string {
+  std::error_code error;
+  auto normal = std::filesystem::weakly_canonical(path, error);
+  if (error) return path;
+  return normal.string();
+}
+struct file_cache {
+ private:
+  struct slot {
+    std::int64_t mtime_ns;
+    std::int64_t size;
+    std::uint64_t generation;
+    std::uint64_t last_used;
+    std::size_t bytes;
+    std::shared_future<std::shared_ptr<const cached_file>> loading;
+  };
+  std::mutex slots_mutex;
+  std::unordered_map<std::string, slot> slots;
+  std::uint64_t generations;
+  std::uint64_t uses;
+  file::load_mode mode;
+  std::size_t max_bytes;
+  std::size_t max_files;
+  std::unique_ptr<parallel::thread_pool> pool;
+
+  static auto modified_ns(const struct stat &file_stat) -> std::int64_t {
+    return std::int64_t(file_stat.st_mtim.tv_sec) * 1000000000 +
+           file_stat.st_mtim.tv_nsec;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief drops slots of files that were removed or changed since they were
+   * loaded and then the least recently used slots until the cache fits in
+   * max_bytes and max_files. The slot of the file that is being returned and
+   * slots that are still loading are kept, commands that use a dropped file
+   * keep it alive until they finish
+   *
+   * @Param const std::string reference path that is kept
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto prune(const std::string &kept) -> void {
+    struct known_slot {
+      std::string file_name;
+      std::uint64_t generation;
+      std::int64_t mtime_ns;
+      std::int64_t size;
+    };
+    std::vector<known_slot> known;
+    {
+      std::lock_guard<std::mutex> lock(slots_mutex);
+      for (const auto &[file_name, cached] : slots)
+        if (file_name != kept)
+          known.push_back(
+              {file_name, cached.generation, cached.mtime_ns, cached.size});
+    }
+    std::vector<known_slot> stale;
+    for (auto &checked : known) {
+      struct stat file_stat;
+      if (stat(checked.file_name.c_str(), &file_stat) != 0 ||
+          modified_ns(file_stat) != checked.mtime_ns ||
+          file_stat.st_size != checked.size)
+        stale.push_back(std::move(checked));
+    }
+    std::lock_guard<std::mutex> lock(slots_mutex);
+    for (const auto &checked : stale) {
+      auto found = slots.find(checked.file_name);
+      if (found != slots.end() && found->second.generation == checked.generation)
+        slots.erase(found);
+    }
+    std::size_t bytes = 0;
+    for (const auto &entry : slots) bytes += entry.second.bytes;
+    while (bytes > max_bytes || slots.size() > max_files) {
+      auto oldest = slots.end();
+      for (auto it = slots.begin(); it != slots.end(); ++it)
+        if (it->first != kept &&
+            it->second.loading.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready &&
+            (oldest == slots.end() ||
+             it->second.last_used < oldest->second.last_used))
+          oldest = it;
+      if (oldest == slots.end()) break;
+      bytes -= oldest->second.bytes;
+      slots.erase(oldest);
+    }
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief creates cache that indexes and scans the files on the given number
+   * of threads, loads them in the given mode and keeps at most max_bytes of
+   * text of at most max_files files
+   *
+   * @Param unsigned number of threads
+   * @Param file::load_mode
+   * @Param std::size_t max_bytes
+   * @Param std::size_t max_files
+   */
+  /* ----------------------------------------------------------------------------*/
+  explicit file_cache(
+      unsigned threads, file::load_mode mode = file::load_mode::mapped,
+      std::size_t max_bytes = std::numeric_limits<std::size_t>::max(),
+      std::size_t max_files = std::numeric_limits<std::size_t>::max())
+      : generations(0),
+        uses(0),
+        mode(mode),
+        max_bytes(max_bytes),
+        max_files(max_files) {
+    if (threads > 1) pool = std::make_unique<parallel::thread_pool>(threads);
+  }
+  file_cache(const file_cache &) = delete;
+  auto operator=(const file_cache &) -> file_cache & = delete;
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns loaded file with the given path, loads it when it's not in
+   * the cache or it was changed since it was loaded. File that fails to load
+   * is removed from the cache so the next command tries again
+   *
+   * @Param const std::string reference
+   *
+   * @Returns std::shared_ptr<const cache::cached_file>
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get(const std::string &file_name)
+      -> std::shared_ptr<const cached_file> {
+    struct stat file_stat;
+    if (stat(file_name.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+      return std::make_shared<const cached_file>(file_name, pool.get(), mode);
+    std::int64_t const mtime_ns = modified_ns(file_stat);
+    std::int64_t const size = file_stat.st_size;
+    std::promise<std::shared_ptr<const cached_file>> loaded;
+    std::shared_future<std::shared_ptr<const cached_file>> loading;
+    std::uint64_t generation = 0;
+    {
+      std::lock_guard<std::mutex> lock(slots_mutex);
+      auto found = slots.find(file_name);
+      if (found != slots.end() && found->second.mtime_ns == mtime_ns &&
+          found->second.size == size) {
+        found->second.last_used = ++uses;
+        loading = found->second.loading;
+      } else {
+        generation = ++generations;
+        loading = loaded.get_future().share();
+        slots[file_name] = {mtime_ns, size, generation, ++uses,
+                            std::size_t(size), loading};
+      }
+    }
+    if (generation) {
+      try {
+        auto file =
+            std::make_shared<const cached_file>(file_name, pool.get(), mode);
+        std::size_t const bytes = file->file.get_text().size();
+        loaded.set_value(std::move(file));
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        auto found = slots.find(file_name);
+        if (found != slots.end() && found->second.generation == generation)
+          found->second.bytes = bytes;
+      } catch (...) {
+        loaded.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        auto found = slots.find(file_name);
+        if (found != slots.end() && found->second.generation == generation)
+          slots.erase(found);
+      }
+    }
+    auto result = loading.get();
+    prune(file_name);
+    return result;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief drops the file with the given normalized path, it was written by a
+   * command and the next command loads it again even when mtime and size of
+   * the new file are the same
+   *
+   * @Param const std::string reference normalized path
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto forget(const std::string &path) -> void {
+    std::lock_guard<std::mutex> lock(slots_mutex);
+    for (auto it = slots.begin(); it != slots.end();)
+      if (normalized_path(it->first) == path)
+        it = slots.erase(it);
+      else
+        ++it;
+  }
+};
+}  // namespace cache
+namespace sidecar {
+struct index_write_exception : public std::exception {
+  const char *what() const throw() { return "Error while writing index file"; }
+};
+struct index_corrupted_exception : public std::exception {
+  const char *what() const throw() { return "Index file is corrupted"; }
+};
+struct compressed_source_exception : public std::exception {
+  const char *what() const throw() {
+    return "--build-index can't be used with gzip or zstd files";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief index is kept next to the file it describes under the name of the
+ * file with this suffix
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr const char *suffix = ".cidx";
+constexpr char magic[8] = {'C', 'O', 'N', 'S', 'I', 'D', 'X', '\0'};
+constexpr std::uint32_t version = 1;
+constexpr std::uint32_t byte_order = 0x01020304;
+constexpr std::size_t fingerprint_bytes = 1 << 16;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief position of an array in the index file, offset is from the beginning
+ * of the file and is aligned to 8 bytes
+ */
+/* ----------------------------------------------------------------------------*/
+struct section {
+  std::uint64_t offset;
+  std::uint64_t count;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief beginning of the index file. Everything is written in the byte order
+ * of the machine (byte_order tells which one) so the file can be mapped and
+ * used without parsing. Source is described by size, mtime and fingerprint
+ * that are checked before the index is used
+ */
+/* ----------------------------------------------------------------------------*/
+struct header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t source_size;
+  std::int64_t source_mtime_ns;
+  std::uint64_t source_fingerprint;
+  std::int64_t lines;
+  std::int64_t digits;
+  std::int64_t numbers;
+  std::int64_t chars;
+  std::int64_t words;
+  section line_offsets;
+  section dictionary;
+  section strings;
+  section word_ids;
+  section signatures;
+  section signature_members;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief distinct word of the file, dictionary is in alphabetical order so it
+ * is also the sorted order of the words
+ */
+/* ----------------------------------------------------------------------------*/
+struct dictionary_entry {
+  std::uint64_t offset;
+  std::uint64_t frequency;
+  std::uint32_t length;
+  std::uint32_t reserved;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief words of the dictionary with the same anagram signature, members
+ * [first, first + count) of signature_members. Groups are sorted by hash
+ */
+/* ----------------------------------------------------------------------------*/
+struct signature_group {
+  std::uint64_t hash;
+  std::uint32_t first;
+  std::uint32_t count;
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief FNV-1a hash, unlike std::hash it's the same in every build so it can
+ * be saved to the file
+ *
+ * @Param std::string_view
+ * @Param std::uint64_t hash to continue from
+ *
+ * @Returns std::uint64_t
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr auto stable_hash(std::string_view bytes,
+                           std::uint64_t hash = 14695981039346656037ull)
+    -> std::uint64_t {
+  for (const char c : bytes) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief hash of the size and of the first and the last fingerprint_bytes of
+ * the source, cheap to check on every run and catches changes that keep the
+ * mtime
+ *
+ * @Param std::uint64_t size of the source
+ * @Param std::string_view first bytes of the source
+ * @Param std::string_view last bytes of the source
+ *
+ * @Returns std::uint64_t
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto fingerprint(std::uint64_t size, std::string_view head,
+                        std::string_view tail) -> std::uint64_t {
+  std::uint64_t hash = stable_hash(
+      std::string_view(reinterpret_cast<const char *>(&size), sizeof(size)));
+  return stable_hash(tail, stable_hash(head, hash));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief size, mtime and fingerprint of the source file as they are now
+ */
+/* ----------------------------------------------------------------------------*/
+struct source_state {
+  std::uint64_t size = 0;
+  std::int64_t mtime_ns = 0;
+  std::uint64_t fingerprint = 0;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief reads state of the source, only the bytes of the fingerprint are read
+ *
+ * @Param const std::string reference
+ * @Param sidecar::source_state reference
+ *
+ * @Returns bool false when the source can't be read or is not a regular file
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto read_source_state(const std::string &file_name,
+                              source_state &state) -> bool {
+  int const descriptor = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) return false;
+  struct stat file_stat;
+  bool valid = fstat(descriptor, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+  std::string head, tail;
+  auto read_at = [descriptor, &valid](std::string &bytes, std::size_t length,
+                                      off_t offset) {
+    bytes.resize(length);
+    std::size_t done = 0;
+    while (valid && done < length) {
+      ssize_t const read_bytes =
+          pread(descriptor, bytes.data() + done, length - done, offset + done);
+      if (read_bytes < 0 && errno == EINTR) continue;
+      if (read_bytes <= 0) valid = false;
+      else done += read_bytes;
+    }
+  };
+  if (valid) {
+    state.size = file_stat.st_size;
+    state.mtime_ns = std::int64_t(file_stat.st_mtim.tv_sec) * 1000000000 +
+                     file_stat.st_mtim.tv_nsec;
+    std::size_t const length =
+        std::min<std::uint64_t>(state.size, fingerprint_bytes);
+    read_at(head, length, 0);
+    read_at(tail, length, state.size - length);
+    state.fingerprint = fingerprint(state.size, head, tail);
+  }
+  close(descriptor);
+  return valid;
+}
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes index of the loaded file to file_name + suffix. Dictionary is
+ * built from the sorted words so equal words are next to each other, then
+ * every word of the file is replaced with its position in the dictionary.
+ * Index is written to a temporary file that replaces the old index at the end
+ * so readers never see half written index
+ *
+ * @Param const std::string reference name of the source
+ * @Param const file::manage_file reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns std::string name of the index file
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto build(const std::string &file_name, const file::manage_file &file,
+                  parallel::thread_pool *pool) -> std::string {
+  stats::scoped_phase const phase("build_index");
+  std::string_view const text = file.get_text();
+  const auto &words = file.get_all_words();
+  const auto &lines = file.get_all_lines();
+  scan::summary const &summary = file.get_summary(scan::all);
+  header result{};
+  std::memcpy(result.magic, magic, sizeof(magic));
+  result.version = version;
+  result.byte_order = byte_order;
+  source_state state;
+  if (!read_source_state(file_name, state) || state.size != text.size())
+    throw index_write_exception();
+  result.source_size = state.size;
+  result.source_mtime_ns = state.mtime_ns;
+  std::size_t const head = std::min(text.size(), fingerprint_bytes);
+  result.source_fingerprint = fingerprint(
+      text.size(), text.substr(0, head), text.substr(text.size() - head));
+  result.lines = summary.lines;
+  result.digits = summary.digits;
+  result.numbers = summary.numbers;
+  result.chars = summary.chars;
+  result.words = summary.words;
+
+  std::vector<std::uint64_t> line_offsets;
+  line_offsets.reserve(lines.size());
+  for (const auto line : lines) line_offsets.push_back(line.data() - text.data());
+
+  std::vector<dictionary_entry> dictionary;
+  std::string strings;
+  std::unordered_map<std::string_view, std::uint32_t> dictionary_id;
+  for (const auto &key :
+       sorting::sorted_keys(words, text.data(), 0, words.size(), pool)) {
+    std::string_view const word(text.data() + key.offset, key.length);
+    if (!dictionary.empty() &&
+        std::string_view(strings.data() + dictionary.back().offset,
+                         dictionary.back().length) == word) {
+      ++dictionary.back().frequency;
+      continue;
+    }
+    if (dictionary.size() == std::numeric_limits<std::uint32_t>::max())
+      throw index_write_exception();
+    dictionary_id.emplace(word, dictionary.size());
+    dictionary.push_back({strings.size(), 1, std::uint32_t(word.size()), 0});
+    strings.append(word);
+  }
+  std::vector<std::uint32_t> word_ids(words.size());
+  parallel::for_each_index(pool, pool ? pool->size() : 1, [&](std::size_t range) {
+    std::size_t const ranges = pool ? pool->size() : 1;
+    for (std::size_t i = words.size() * range / ranges;
+         i < words.size() * (range + 1) / ranges; ++i)
+      word_ids[i] = dictionary_id.find(words[i])->second;
+  });
+
+  std::vector<std::pair<std::uint64_t, std::uint32_t>> hashed(dictionary.size());
+  std::string signature;
+  for (std::uint32_t id = 0; id < dictionary.size(); ++id) {
+    helper::anagram_signature(
+        std::string_view(strings.data() + dictionary[id].offset,
+                         dictionary[id].length),
+        signature);
+    hashed[id] = {stable_hash(signature), id};
+  }
+  std::sort(hashed.begin(), hashed.end());
+  std::vector<signature_group> signatures;
+  std::vector<std::uint32_t> signature_members;
+  for (const auto &[hash, id] : hashed) {
+    if (signatures.empty() || signatures.back().hash != hash)
+      signatures.push_back({hash, std::uint32_t(signature_members.size()), 0});
+    ++signatures.back().count;
+    signature_members.push_back(id);
+  }
+
+  std::uint64_t end = sizeof(header);
+  auto place = [&end](section &placed, std::size_t count, std::size_t size) {
+    end = (end + 7) / 8 * 8;
+    placed = {end, count};
+    end += count * size;
+  };
+  place(result.line_offsets, line_offsets.size(), sizeof(std::uint64_t));
+  place(result.dictionary, dictionary.size(), sizeof(dictionary_entry));
+  place(result.strings, strings.size(), 1);
+  place(result.word_ids, word_ids.size(), sizeof(std::uint32_t));
+  place(result.signatures, signatures.size(), sizeof(signature_group));
+  place(result.signature_members, signature_members.size(),
+        sizeof(std::uint32_t));
+
+  std::string const index_name = file_name + suffix;
+  std::string temporary_name = index_name + ".XXXXXX";
+  int const descriptor = mkstemp(temporary_name.data());
+  if (descriptor < 0) throw index_write_exception();
+  fchmod(descriptor, 0644);
+  std::FILE *stream = fdopen(descriptor, "wb");
+  if (!stream) {
+    close(descriptor);
+    unlink(temporary_name.c_str());
+    throw index_write_exception();
+  }
+  bool written = true;
+  auto write_at = [&](const section &placed, const void *data,
+                      std::size_t bytes) {
+    static constexpr char padding[8] = {};
+    long const position = std::ftell(stream);
+    if (position < 0 || std::uint64_t(position) > placed.offset) written = false;
+    if (written && position < long(placed.offset))
+      written = std::fwrite(padding, 1, placed.offset - position, stream) ==
+                placed.offset - position;
+    if (written && bytes) written = std::fwrite(data, 1, bytes, stream) == bytes;
+  };
+  write_at({0, 1}, &result, sizeof(result));
+  write_at(result.line_offsets, line_offsets.data(),
+           line_offsets.size() * sizeof(std::uint64_t));
+  write_at(result.dictionary, dictionary.data(),
+           dictionary.size() * sizeof(dictionary_entry));
+  write_at(result.strings, strings.data(), strings.size());
+  write_at(result.word_ids, word_ids.data(),
+           word_ids.size() * sizeof(std::uint32_t));
+  write_at(result.signatures, signatures.data(),
+           signatures.size() * sizeof(signature_group));
+  write_at(result.signature_members, signature_members.data(),
+           signature_members.size() * sizeof(std::uint32_t));
+  if (std::fclose(stream) != 0) written = false;
+  if (!written || rename(temporary_name.c_str(), index_name.c_str()) != 0) {
+    unlink(temporary_name.c_str());
+    throw index_write_exception();
+  }
+  return index_name;
+}
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief mapped index of a file, everything is read directly from the mapping
+ */
+/* ----------------------------------------------------------------------------*/
+struct index_file {
+ private:
+  file::mapped_region mapping;
+  std::string_view bytes;
+  const header *my_header;
+
+  template <typename T>
+  auto array(const section &placed) const -> std::span<const T> {
+    return {reinterpret_cast<const T *>(bytes.data() + placed.offset),
+            placed.count};
+  }
+  auto section_fits(const section &placed, std::size_t size) const -> bool {
+    return placed.offset % 8 == 0 && placed.offset <= bytes.size() &&
+           placed.count <= (bytes.size() - placed.offset) / size;
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief maps the index of the file and checks that it describes the file as
+   * it is now
+   *
+   * @Param const std::string reference name of the source
+   *
+   * @Returns std::unique_ptr<sidecar::index_file>, nullptr when there is no
+   * valid index
+   */
+  /* ----------------------------------------------------------------------------*/
+  static auto open_for(const std::string &file_name)
+      -> std::unique_ptr<index_file> {
+    std::string const index_name = file_name + suffix;
+    int const descriptor = open(index_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) return nullptr;
+    struct stat index_stat;
+    if (fstat(descriptor, &index_stat) != 0 || !S_ISREG(index_stat.st_mode) ||
+        std::size_t(index_stat.st_size) < sizeof(header)) {
+      close(descriptor);
+      return nullptr;
+    }
+    auto index = std::make_unique<index_file>();
+    try {
+      index->mapping = file::mapped_region(descriptor, index_stat.st_size);
+    } catch (file::cannot_open_file_exception &) {
+      close(descriptor);
+      return nullptr;
+    }
+    close(descriptor);
+    index->bytes = index->mapping.view();
+    index->my_header = reinterpret_cast<const header *>(index->bytes.data());
+    if (!index->valid()) return nullptr;
+    source_state state;
+    if (!read_source_state(file_name, state)) return nullptr;
+    const header &mapped = *index->my_header;
+    if (mapped.source_size != state.size ||
+        mapped.source_mtime_ns != state.mtime_ns ||
+        mapped.source_fingerprint != state.fingerprint)
+      return nullptr;
+    stats::add_bytes_read(index->bytes.size());
+    return index;
+  }
+  index_file() : my_header(nullptr){};
+  index_file(const index_file &) = delete;
+  auto operator=(const index_file &) -> index_file & = delete;
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief checks magic, version and that every section and every word of the
+   * dictionary lies inside of the file
+   *
+   * @Returns bool
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto valid() const -> bool {
+    const header &mapped = *my_header;
+    if (std::memcmp(mapped.magic, magic, sizeof(magic)) != 0 ||
+        mapped.version != version || mapped.byte_order != byte_order)
+      return false;
+    if (!section_fits(mapped.line_offsets, sizeof(std::uint64_t)) ||
+        !section_fits(mapped.dictionary, sizeof(dictionary_entry)) ||
+        !section_fits(mapped.strings, 1) ||
+        !section_fits(mapped.word_ids, sizeof(std::uint32_t)) ||
+        !section_fits(mapped.signatures, sizeof(signature_group)) ||
+        !section_fits(mapped.signature_members, sizeof(std::uint32_t)))
+      return false;
+    for (const auto &entry : array<dictionary_entry>(mapped.dictionary))
+      if (entry.offset > mapped.strings.count ||
+          entry.length > mapped.strings.count - entry.offset)
+        return false;
+    for (const auto &group : array<signature_group>(mapped.signatures))
+      if (group.first > mapped.signature_members.count ||
+          group.count > mapped.signature_members.count - group.first)
+        return false;
+    return true;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief counters of the file that were collected when index was built
+   *
+   * @Returns scan::summary
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_summary() const -> scan::summary {
+    scan::summary summary;
+    summary.lines = my_header->lines;
+    summary.digits = my_header->digits;
+    summary.numbers = my_header->numbers;
+    summary.chars = my_header->chars;
+    summary.words = my_header->words;
+    return summary;
+  }
+  auto get_line_offsets() const -> std::span<const std::uint64_t> {
+    return array<std::uint64_t>(my_header->line_offsets);
+  }
+  auto get_dictionary() const -> std::span<const dictionary_entry> {
+    return array<dictionary_entry>(my_header->dictionary);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief returns positions in the dictionary of all words of the file in the
+   * order they are in the file
+   *
+   * @Returns std::span<const std::uint32_t>
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto get_word_ids() const -> std::span<const std::uint32_t> {
+    return array<std::uint32_t>(my_header->word_ids);
+  }
+  auto word(std::uint32_t id) const -> std::string_view {
+    if (id >= my_header->dictionary.count) throw index_corrupted_exception();
+    const auto &entry = get_dictionary()[id];
+    return {bytes.data() + my_header->strings.offset + entry.offset,
+            entry.length};
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief finds the word in the dictionary with binary search
+   *
+   * @Param std::string_view
+   *
+   * @Returns std::size_t position in the dictionary, size of the dictionary
+   * when the word is not in the file
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto find(std::string_view searched) const -> std::size_t {
+    std::size_t low = 0, high = my_header->dictionary.count;
+    while (low < high) {
+      std::size_t const middle = low + (high - low) / 2;
+      if (word(middle) < searched)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+    if (low < my_header->dictionary.count && word(low) == searched) return low;
+    return my_header->dictionary.count;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief calls found with position in the dictionary of every word that has
+   * the given anagram signature
+   *
+   * @Param std::string_view signature
+   * @Param found callable with std::uint32_t
+   */
+  /* ----------------------------------------------------------------------------*/
+  template <typename Found>
+  auto for_each_anagram(std::string_view signature, Found found) const
+      -> void {
+    auto const groups = array<signature_group>(my_header->signatures);
+    auto const members = array<std::uint32_t>(my_header->signature_members);
+    std::uint64_t const hash = stable_hash(signature);
+    auto group = std::lower_bound(
+        groups.begin(), groups.end(), hash,
+        [](const signature_group &left, std::uint64_t right) {
+          return left.hash < right;
+        });
+    std::string member_signature;
+    for (; group != groups.end() && group->hash == hash; ++group) {
+      for (std::uint32_t i = group->first; i < group->first + group->count;
+           ++i) {
+        helper::anagram_signature(word(members[i]), member_signature);
+        if (member_signature == signature) found(members[i]);
+      }
+    }
+  }
+};
+}  // namespace sidecar
+namespace seek {
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief line index is kept next to the file under the name of the file with
+ * this suffix, it's written on the first use and reused while the file is not
+ * changed
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr const char *suffix = ".clines";
+constexpr char magic[8] = {'C', 'O', 'N', 'S', 'L', 'I', 'N', '\0'};
+constexpr std::uint32_t version = 1;
+constexpr std::uint64_t checkpoint_lines = 1024;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief beginning of the line index file, it's followed by checkpoints
+ * offsets. Source is described the same way as in the sidecar index and
+ * text_size is the size of the text the offsets point to (decompressed size
+ * for compressed files)
+ */
+/* ----------------------------------------------------------------------------*/
+struct header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t source_size;
+  std::int64_t source_mtime_ns;
+  std::uint64_t source_fingerprint;
+  std::uint64_t text_size;
+  std::uint64_t interval;
+  std::uint64_t lines;
+  std::uint64_t checkpoints;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief sparse index of the lines, offset of the beginning of every
+ * checkpoint_lines-th line. Line is found by jumping to the checkpoint before
+ * it and skipping less than checkpoint_lines newlines, so finding a range of
+ * lines costs time of the range and not of the text before it
+ */
+/* ----------------------------------------------------------------------------*/
+struct line_index {
+  std::vector<std::uint64_t> checkpoints;
+  std::uint64_t lines = 0;
+
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief offset of the beginning of the line
+   *
+   * @Param std::string_view text the index was built for
+   * @Param std::uint64_t number of the line counted from 0
+   *
+   * @Returns std::size_t size of the text when there is no such line
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto locate(std::string_view text, std::uint64_t line) const -> std::size_t {
+    if (line >= lines) return text.size();
+    std::size_t position = checkpoints[line / checkpoint_lines];
+    for (std::uint64_t skipped = line % checkpoint_lines; skipped; --skipped) {
+      const void *newline = std::memchr(text.data() + position, '\n',
+                                        text.size() - position);
+      if (!newline) return text.size();
+      position = static_cast<const char *>(newline) - text.data() + 1;
+    }
+    return position;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief part of the text with lines [first, last), counted from 0
+   *
+   * @Param std::string_view text the index was built for
+   * @Param std::uint64_t first line
+   * @Param std::uint64_t line after the last one
+   *
+   * @Returns std::string_view
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto range(std::string_view text, std::uint64_t first,
+             std::uint64_t last) const -> std::string_view {
+    if (first >= last) return text.substr(text.size());
+    std::size_t const begin = locate(text, first);
+    return text.substr(begin, locate(text, last) - begin);
+  }
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief calls found(offset) after every newline of the text, newlines are
+ * found with the block masks of the scanner and the call is skipped for the
+ * blocks whose newlines don't reach the next line that is wanted
+ *
+ * @Param std::string_view
+ * @Param std::uint64_t number of the line that starts at the beginning of text
+ * @Param std::uint64_t first line that is wanted, every checkpoint_lines-th
+ * line after it is wanted too
+ * @Param found callable with std::uint64_t line and std::size_t offset in text
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename Found>
+auto find_checkpoints(std::string_view text, std::uint64_t line,
+                      std::uint64_t next, Found found) -> void {
+  char padded[scan::block_size];
+  for (std::size_t base = 0; base < text.size(); base += scan::block_size) {
+    const char *block = text.data() + base;
+    if (text.size() - base < scan::block_size) {
+      std::memset(padded, ' ', scan::block_size);
+      std::memcpy(padded, block, text.size() - base);
+      block = padded;
+    }
+    std::uint64_t mask = scan::classify(block).newline;
+    while (mask) {
+      std::uint64_t const skip = next - line;
+      if (skip > std::uint64_t(std::popcount(mask))) {
+        line += std::popcount(mask);
+        break;
+      }
+      for (std::uint64_t i = 1; i < skip; ++i) mask &= mask - 1;
+      found(next, base + std::countr_zero(mask) + 1);
+      mask &= mask - 1;
+      line = next;
+      next += checkpoint_lines;
+    }
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief builds the index of the text, chunks of the text are counted first
+ * and then every chunk writes the checkpoints that fall into it, with the pool
+ * the chunks are processed in parallel
+ *
+ * @Param std::string_view
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns seek::line_index
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto build(std::string_view text, parallel::thread_pool *pool)
+    -> line_index {
+  stats::scoped_phase const phase("line_index");
+  std::size_t const pieces = pool ? pool->size() * 4 : 1;
+  auto const chunks = parallel::split_chunks(text, pieces,
+                                             [](char c) { return c == '\n'; });
+  std::vector<std::uint64_t> chunk_line(chunks.size() + 1, 0);
+  parallel::for_each_index(pool, chunks.size(), [&](std::size_t i) {
+    scan::summary const counted = scan::count(chunks[i], scan::lines);
+    chunk_line[i + 1] = counted.lines - (chunks[i].back() != '\n');
+  });
+  for (std::size_t i = 0; i < chunks.size(); ++i)
+    chunk_line[i + 1] += chunk_line[i];
+  line_index index;
+  index.lines = chunk_line.back() + (!text.empty() && text.back() != '\n');
+  index.checkpoints.resize((index.lines + checkpoint_lines - 1) /
+                           checkpoint_lines);
+  if (!index.checkpoints.empty()) index.checkpoints[0] = 0;
+  parallel::for_each_index(pool, chunks.size(), [&](std::size_t i) {
+    std::size_t const chunk_offset = chunks[i].data() - text.data();
+    std::uint64_t const next =
+        chunk_line[i] / checkpoint_lines * checkpoint_lines + checkpoint_lines;
+    find_checkpoints(chunks[i], chunk_line[i], next,
+                     [&](std::uint64_t line, std::size_t offset) {
+                       if (line < index.lines)
+                         index.checkpoints[line / checkpoint_lines] =
+                             chunk_offset + offset;
+                     });
+  });
+  return index;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief reads the saved index and checks that it was built for the source as
+ * it is now and that every checkpoint lies inside of the text
+ *
+ * @Param const std::string reference name of the index
+ * @Param const sidecar::source_state reference
+ * @Param std::size_t size of the text
+ * @Param seek::line_index reference
+ *
+ * @Returns bool false when there is no valid index
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto load(const std::string &index_name,
+                 const sidecar::source_state &state, std::size_t text_size,
+                 line_index &loaded) -> bool {
+  std::unique_ptr<std::FILE, int (*)(std::FILE *)> stream(
+      std::fopen(index_name.c_str(), "rb"), std::fclose);
+  if (!stream) return false;
+  header saved;
+  if (std::fread(&saved, sizeof(saved), 1, stream.get()) != 1 ||
+      std::memcmp(saved.magic, magic, sizeof(magic)) != 0 ||
+      saved.version != version || saved.byte_order != sidecar::byte_order ||
+      saved.source_size != state.size ||
+      saved.source_mtime_ns != state.mtime_ns ||
+      saved.source_fingerprint != state.fingerprint ||
+      saved.text_size != text_size || saved.interval != checkpoint_lines ||
+      saved.checkpoints !=
+          (saved.lines + checkpoint_lines - 1) / checkpoint_lines ||
+      saved.checkpoints > text_size + 1)
+    return false;
+  loaded.lines = saved.lines;
+  loaded.checkpoints.resize(saved.checkpoints);
+  if (!loaded.checkpoints.empty() &&
+      std::fread(loaded.checkpoints.data(), sizeof(std::uint64_t),
+                 loaded.checkpoints.size(),
+                 stream.get()) != loaded.checkpoints.size())
+    return false;
+  for (std::size_t i = 0; i < loaded.checkpoints.size(); ++i)
+    if (loaded.checkpoints[i] > text_size ||
+        (i && loaded.checkpoints[i] <= loaded.checkpoints[i - 1]))
+      return false;
+  stats::add_bytes_read(sizeof(saved) +
+                        loaded.checkpoints.size() * sizeof(std::uint64_t));
+  return true;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes the index to a temporary file that replaces the old one, the
+ * index only saves time of the next run so a directory that can't be written
+ * is not an error
+ *
+ * @Param const std::string reference name of the index
+ * @Param const sidecar::source_state reference
+ * @Param std::size_t size of the text
+ * @Param const seek::line_index reference
+ *
+ * @Returns bool true when the index was saved
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto save(const std::string &index_name,
+                 const sidecar::source_state &state, std::size_t text_size,
+                 const line_index &saved) -> bool {
+  header result{};
+  std::memcpy(result.magic, magic, sizeof(magic));
+  result.version = version;
+  result.byte_order = sidecar::byte_order;
+  result.source_size = state.size;
+  result.source_mtime_ns = state.mtime_ns;
+  result.source_fingerprint = state.fingerprint;
+  result.text_size = text_size;
+  result.interval = checkpoint_lines;
+  result.lines = saved.lines;
+  result.checkpoints = saved.checkpoints.size();
+  std::string temporary_name = index_name + ".XXXXXX";
+  int const descriptor = mkstemp(temporary_name.data());
+  if (descriptor < 0) return false;
+  fchmod(descriptor, 0644);
+  std::FILE *stream = fdopen(descriptor, "wb");
+  if (!stream) {
+    close(descriptor);
+    unlink(temporary_name.c_str());
+    return false;
+  }
+  // an empty file has no checkpoints and data() of the vector may be null
+  bool written = std::fwrite(&result, sizeof(result), 1, stream) == 1 &&
+                 (saved.checkpoints.empty() ||
+                  std::fwrite(saved.checkpoints.data(), sizeof(std::uint64_t),
+                              saved.checkpoints.size(),
+                              stream) == saved.checkpoints.size());
+  if (std::fclose(stream) != 0) written = false;
+  if (!written || rename(temporary_name.c_str(), index_name.c_str()) != 0) {
+    unlink(temporary_name.c_str());
+    return false;
+  }
+  return true;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief returns line index of the loaded text of the file, the saved index
+ * is used when it describes the file as it is now, otherwise the index is
+ * built and saved for the next run
+ *
+ * @Param const std::string reference name of the source
+ * @Param std::string_view loaded text of the source
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns seek::line_index
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto open_for(const std::string &file_name, std::string_view text,
+                     parallel::thread_pool *pool) -> line_index {
+  sidecar::source_state state;
+  bool const regular = sidecar::read_source_state(file_name, state);
+  line_index index;
+  if (regular && load(file_name + suffix, state, text.size(), index))
+    return index;
+  index = build(text, pool);
+  if (regular) save(file_name + suffix, state, text.size(), index);
+  return index;
+}
+}  // namespace seek
+namespace follow {
+struct checkpoint_write_exception : public std::exception {
+  const char *what() const throw() {
+    return "Error while writing checkpoint file";
+  }
+};
+struct not_followable_exception : public std::exception {
+  const char *what() const throw() {
+    return "--follow can be used only with -n, -d, -dd, -c, --top and --freq "
+           "on a regular, uncompressed file";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checkpoint is kept next to the followed file under the name of the
+ * file with this suffix
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr const char *suffix = ".cfollow";
+constexpr char magic[8] = {'C', 'O', 'N', 'S', 'F', 'O', 'L', '\0'};
+constexpr std::uint32_t version = 1;
+constexpr std::size_t read_size = 1 << 20;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief beginning of the checkpoint file, it's followed by vocabulary_size
+ * vocabulary entries and then by the bytes of the words. Offset is the number
+ * of bytes of the source that are counted, it always ends right after a
+ * newline so no word or line is split by it. Source is recognized by device,
+ * inode and fingerprint of the bytes before the offset
+ */
+/* ----------------------------------------------------------------------------*/
+struct header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t device;
+  std::uint64_t inode;
+  std::uint64_t offset;
+  std::uint64_t fingerprint;
+  std::int64_t lines;
+  std::int64_t digits;
+  std::int64_t numbers;
+  std::int64_t chars;
+  std::int64_t words;
+  std::uint64_t has_vocabulary;
+  std::uint64_t vocabulary_size;
+  std::uint64_t strings_size;
+};
+struct vocabulary_entry {
+  std::uint64_t count;
+  std::uint32_t length;
+  std::uint32_t reserved;
+};
+using vocabulary_table =
+    std::unordered_map<std::string, std::uint64_t, helper::string_hash,
+                       std::equal_to<>>;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief counters and vocabulary of the followed file, vocabulary is kept only
+ * when some command needed it, after that it's updated on every run
+ */
+/* ----------------------------------------------------------------------------*/
+struct state {
+  std::uint64_t device = 0;
+  std::uint64_t inode = 0;
+  std::uint64_t offset = 0;
+  std::uint64_t fingerprint = 0;
+  scan::summary counted;
+  bool has_vocabulary = false;
+  vocabulary_table vocabulary;
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief reads length bytes from offset of the descriptor
+ *
+ * @Param int file descriptor
+ * @Param std::string reference resized to the read bytes
+ * @Param std::size_t length
+ * @Param std::uint64_t offset
+ *
+ * @Returns bool false when the bytes can't be read
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto read_at(int descriptor, std::string &bytes, std::size_t length,
+                    std::uint64_t offset) -> bool {
+  bytes.resize(length);
+  std::size_t done = 0;
+  while (done < length) {
+    ssize_t const read_bytes =
+        pread(descriptor, bytes.data() + done, length - done, offset + done);
+    if (read_bytes < 0 && errno == EINTR) continue;
+    if (read_bytes <= 0) return false;
+    done += read_bytes;
+  }
+  return true;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief fingerprint of the first offset bytes of the source, the same as
+ * sidecar uses for the whole source
+ *
+ * @Param int file descriptor
+ * @Param std::uint64_t offset
+ *
+ * @Returns std::uint64_t, 0 when the bytes can't be read
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto prefix_fingerprint(int descriptor, std::uint64_t offset)
+    -> std::uint64_t {
+  std::size_t const length =
+      std::min<std::uint64_t>(offset, sidecar::fingerprint_bytes);
+  std::string head, tail;
+  if (!read_at(descriptor, head, length, 0) ||
+      !read_at(descriptor, tail, length, offset - length))
+    return 0;
+  return sidecar::fingerprint(offset, head, tail);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief reads checkpoint of the file
+ *
+ * @Param const std::string reference name of the checkpoint
+ * @Param follow::state reference
+ *
+ * @Returns bool false when there is no valid checkpoint
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto load(const std::string &checkpoint_name, state &loaded) -> bool {
+  std::unique_ptr<std::FILE, int (*)(std::FILE *)> stream(
+      std::fopen(checkpoint_name.c_str(), "rb"), std::fclose);
+  if (!stream) return false;
+  header saved;
+  if (std::fread(&saved, sizeof(saved), 1, stream.get()) != 1 ||
+      std::memcmp(saved.magic, magic, sizeof(magic)) != 0 ||
+      saved.version != version || saved.byte_order != sidecar::byte_order)
+    return false;
+  loaded.device = saved.device;
+  loaded.inode = saved.inode;
+  loaded.offset = saved.offset;
+  loaded.fingerprint = saved.fingerprint;
+  loaded.counted = {saved.lines, saved.digits, saved.numbers, saved.chars,
+                    saved.words};
+  loaded.has_vocabulary = saved.has_vocabulary;
+  std::vector<vocabulary_entry> entries(saved.vocabulary_size);
+  std::string strings(saved.strings_size, '\0');
+  if ((!entries.empty() &&
+       std::fread(entries.data(), sizeof(vocabulary_entry), entries.size(),
+                  stream.get()) != entries.size()) ||
+      std::fread(strings.data(), 1, strings.size(), stream.get()) !=
+          strings.size())
+    return false;
+  loaded.vocabulary.reserve(entries.size());
+  std::size_t position = 0;
+  for (const auto &entry : entries) {
+    if (entry.length > strings.size() - position) return false;
+    loaded.vocabulary.emplace(strings.substr(position, entry.length),
+                              entry.count);
+    position += entry.length;
+  }
+  return true;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes checkpoint to a temporary file that replaces the old one so
+ * a run that is stopped never leaves half written checkpoint
+ *
+ * @Param const std::string reference name of the checkpoint
+ * @Param const follow::state reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto save(const std::string &checkpoint_name, const state &saved)
+    -> void {
+  stats::scoped_phase const phase("checkpoint");
+  header result{};
+  std::memcpy(result.magic, magic, sizeof(magic));
+  result.version = version;
+  result.byte_order = sidecar::byte_order;
+  result.device = saved.device;
+  result.inode = saved.inode;
+  result.offset = saved.offset;
+  result.fingerprint = saved.fingerprint;
+  result.lines = saved.counted.lines;
+  result.digits = saved.counted.digits;
+  result.numbers = saved.counted.numbers;
+  result.chars = saved.counted.chars;
+  result.words = saved.counted.words;
+  result.has_vocabulary = saved.has_vocabulary;
+  std::vector<vocabulary_entry> entries;
+  std::string strings;
+  entries.reserve(saved.vocabulary.size());
+  for (const auto &[word, count] : saved.vocabulary) {
+    entries.push_back({count, std::uint32_t(word.size()), 0});
+    strings.append(word);
+  }
+  result.vocabulary_size = entries.size();
+  result.strings_size = strings.size();
+
+  std::string temporary_name = checkpoint_name + ".XXXXXX";
+  int const descriptor = mkstemp(temporary_name.data());
+  if (descriptor < 0) throw checkpoint_write_exception();
+  fchmod(descriptor, 0644);
+  std::FILE *stream = fdopen(descriptor, "wb");
+  if (!stream) {
+    close(descriptor);
+    unlink(temporary_name.c_str());
+    throw checkpoint_write_exception();
+  }
+  bool written =
+      std::fwrite(&result, sizeof(result), 1, stream) == 1 &&
+      (entries.empty() ||
+       std::fwrite(entries.data(), sizeof(vocabulary_entry), entries.size(),
+                   stream) == entries.size()) &&
+      std::fwrite(strings.data(), 1, strings.size(), stream) == strings.size();
+  if (std::fclose(stream) != 0) written = false;
+  if (!written || rename(temporary_name.c_str(), checkpoint_name.c_str()) != 0) {
+    unlink(temporary_name.c_str());
+    throw checkpoint_write_exception();
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief sums counters of two parts of the text, the first part has to end
+ * with newline
+ *
+ * @Param const scan::summary reference
+ * @Param const scan::summary reference
+ *
+ * @Returns scan::summary
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto add(const scan::summary &first, const scan::summary &second)
+    -> scan::summary {
+  return {first.lines + second.lines, first.digits + second.digits,
+          first.numbers + second.numbers, first.chars + second.chars,
+          first.words + second.words};
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief counters (and vocabulary) of the followed file as it is now
+ */
+/* ----------------------------------------------------------------------------*/
+struct result {
+  scan::summary summary;
+  vocabulary_table vocabulary;
+  bool rebuilt = false;
+  std::uint64_t scanned = 0;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief adds words of the text to the vocabulary, words are split the same
+ * way as the words of the loaded file
+ *
+ * @Param std::string_view
+ * @Param follow::vocabulary_table reference
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto add_words(std::string_view text, vocabulary_table &vocabulary)
+    -> void {
+  const char *position = text.data();
+  const char *end = text.data() + text.size();
+  while (position != end) {
+    while (position != end && helper::is_space(*position)) ++position;
+    const char *word_begin = position;
+    while (position != end && !helper::is_space(*position)) ++position;
+    if (word_begin == position) break;
+    std::string_view const word(word_begin, position - word_begin);
+    auto const found = vocabulary.find(word);
+    if (found != vocabulary.end())
+      ++found->second;
+    else
+      vocabulary.emplace(word, 1);
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief counts the file starting from its checkpoint: only bytes appended
+ * after the checkpoint are read, complete lines of them are added to the
+ * checkpoint that is saved again and the last line that doesn't end with
+ * newline yet is counted only for this run. The file is counted from the
+ * beginning when there is no checkpoint, when the file is shorter than the
+ * checkpoint (truncated), when it's another file (rotated) or when the bytes
+ * before the checkpoint changed. Vocabulary is collected when it's needed and
+ * then kept in the checkpoint
+ *
+ * @Param int file descriptor of the file
+ * @Param const struct stat reference of the file
+ * @Param const std::string reference name of the checkpoint
+ * @Param bool true when the vocabulary is needed
+ *
+ * @Returns follow::result
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto resume(int descriptor, const struct stat &file_stat,
+                   const std::string &checkpoint_name, bool with_vocabulary)
+    -> result {
+  std::uint64_t const size = file_stat.st_size;
+  state current;
+  bool const resumed =
+      load(checkpoint_name, current) &&
+      current.device == std::uint64_t(file_stat.st_dev) &&
+      current.inode == std::uint64_t(file_stat.st_ino) &&
+      current.offset <= size &&
+      (current.has_vocabulary || !with_vocabulary) &&
+      current.fingerprint == prefix_fingerprint(descriptor, current.offset);
+  result followed;
+  if (!resumed) {
+    current = state();
+    current.device = file_stat.st_dev;
+    current.inode = file_stat.st_ino;
+    current.has_vocabulary = with_vocabulary;
+    followed.rebuilt = true;
+  }
+  followed.scanned = size - current.offset;
+  stats::add_bytes_read(followed.scanned);
+
+  scan::scanner appended;
+  std::string pending;
+  std::string chunk;
+  for (std::uint64_t position = current.offset; position < size;) {
+    std::size_t const length =
+        std::min<std::uint64_t>(read_size, size - position);
+    if (!read_at(descriptor, chunk, length, position))
+      throw file::file_not_opened_exception();
+    position += length;
+    pending.append(chunk);
+    std::size_t const last_newline = pending.rfind('\n');
+    if (last_newline == std::string::npos) continue;
+    std::string_view const complete(pending.data(), last_newline + 1);
+    appended.feed(complete);
+    if (current.has_vocabulary) add_words(complete, current.vocabulary);
+    current.offset += complete.size();
+    pending.erase(0, complete.size());
+  }
+  scan::summary const lines = appended.finish();
+  current.counted = add(current.counted, lines);
+  if (followed.rebuilt || lines.chars) {
+    current.fingerprint = prefix_fingerprint(descriptor, current.offset);
+    save(checkpoint_name, current);
+  }
+
+  followed.summary = add(current.counted, scan::count(pending, scan::all));
+  if (current.has_vocabulary) add_words(pending, current.vocabulary);
+  followed.vocabulary = std::move(current.vocabulary);
+  return followed;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief follow::resume for the file with the specified name
+ *
+ * @Param const std::string reference name of the file
+ * @Param bool true when the vocabulary is needed
+ *
+ * @Returns follow::result
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto update(const std::string &file_name, bool with_vocabulary)
+    -> result {
+  stats::scoped_phase const phase("follow");
+  int const descriptor = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) throw file::cannot_open_file_exception();
+  result followed;
+  try {
+    struct stat file_stat;
+    if (fstat(descriptor, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+        compressed::format_of(descriptor) != compressed::format::plain)
+      throw not_followable_exception();
+    followed =
+        resume(descriptor, file_stat, file_name + suffix, with_vocabulary);
+  } catch (...) {
+    close(descriptor);
+    throw;
+  }
+  close(descriptor);
+  return followed;
+}
+}  // namespace follow
+namespace stream {
+struct not_streamable_exception : public std::exception {
+  const char *what() const throw() {
+    return "-s, -rs, -bi, -pw, -lp, -cp, -re, --top and --freq need the "
+           "whole file and can't be used with --stream or -f -";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief size of the window the stream is read through, memory used by the
+ * stream doesn't depend on the size of the input
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr std::size_t window_size = 1 << 20;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief input that is read once from the beginning to the end through a
+ * window of fixed size, used for stdin ("-") and for --stream. gzip and zstd
+ * input is decompressed on its own thread while the words are matched. Word
+ * that is cut by the end of the window is moved to the front of the window
+ * and completed by the next read, words longer than any query are dropped
+ * because they can't match anyway
+ */
+/* ----------------------------------------------------------------------------*/
+struct stream_file {
+ private:
+  int descriptor;
+  bool owned;
+  bool consumed;
+  scan::summary my_summary;
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief opens the file with supplied file_name, "-" is the standard input
+   *
+   * @Param const std::string reference
+   */
+  /* ----------------------------------------------------------------------------*/
+  explicit stream_file(const std::string &file_name)
+      : descriptor(STDIN_FILENO), owned(false), consumed(false) {
+    if (file_name == "-") return;
+    descriptor = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+      std::cerr << "Wrong file name was provided" << std::endl;
+      throw file::cannot_open_file_exception();
+    }
+    owned = true;
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  stream_file(const stream_file &) = delete;
+  auto operator=(const stream_file &) -> stream_file & = delete;
+  ~stream_file() {
+    if (owned) close(descriptor);
+  }
+  auto is_consumed() const -> bool { return consumed; }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief reads the stream to the end, collects requested counters and calls
+   * write for every word as many times as matcher returns (matcher can be
+   * empty when nothing is matched)
+   *
+   * @Param unsigned bits of scan::counter
+   * @Param std::function matcher of the words
+   * @Param std::size_t length of the longest word that matcher can accept
+   * @Param std::function writer of the matched words
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto consume(unsigned counters,
+               const std::function<std::size_t(std::string_view)> &matcher,
+               std::size_t longest_word,
+               const std::function<void(std::string_view)> &write) -> void {
+    if (consumed) throw file::file_not_opened_exception();
+    consumed = true;
+    stats::scoped_phase const phase("consume");
+    scan::scanner scanner(counters);
+    std::vector<char> window(std::max(window_size, 2 * longest_word + 1));
+    std::size_t kept = 0;
+    bool skipping = false;
+    auto match = [&](std::string_view word) {
+      for (std::size_t repeat = matcher(word); repeat; --repeat) write(word);
+    };
+    std::optional<compressed::reader> input;
+    auto read_window = [&]() -> std::size_t {
+      try {
+        if (!input) input.emplace(descriptor);
+        return input->read(window.data() + kept, window.size() - kept);
+      } catch (compressed::decompression_exception &) {
+        if (input && input->is_compressed()) throw;
+        std::cerr << "There was an error when reading a file" << std::endl;
+        throw file::cannot_open_file_exception();
+      }
+    };
+    while (true) {
+      std::size_t const read_bytes = read_window();
+      if (read_bytes == 0) break;
+      stats::add_bytes_read(read_bytes);
+      scanner.feed(std::string_view(window.data() + kept, read_bytes));
+      if (!matcher) continue;
+      const char *position = window.data();
+      const char *end = window.data() + kept + read_bytes;
+      if (skipping) {
+        while (position != end && !helper::is_space(*position)) ++position;
+        skipping = position == end;
+      }
+      kept = 0;
+      while (position != end) {
+        while (position != end && helper::is_space(*position)) ++position;
+        const char *word_begin = position;
+        while (position != end && !helper::is_space(*position)) ++position;
+        if (word_begin == position) break;
+        if (position != end) {
+          match(std::string_view(word_begin, position - word_begin));
+        } else if (std::size_t(position - word_begin) > longest_word) {
+          skipping = true;
+        } else {
+          kept = position - word_begin;
+          std::memmove(window.data(), word_begin, kept);
+        }
+      }
+    }
+    if (kept) match(std::string_view(window.data(), kept));
+    my_summary = scanner.finish();
+  }
+  auto get_summary() const -> const scan::summary & {
+    if (!consumed) throw file::file_not_opened_exception();
+    return my_summary;
+  }
+};
+}  // namespace stream
+namespace server {
+auto serve(const std::string &socket_path, unsigned threads) -> void;
+}  // namespace server
+namespace bench {
+template <typename It>
+auto run_benchmarks(output::sink &output_stream, It option_iterator,
+                    const It &end_iterator, parallel::thread_pool *pool)
+    -> void;
+}  // namespace bench
+namespace command {
+struct parssing_error_exception : public std::exception {
+  const char *what() const throw() { return "Error while parsing commands"; }
+};
+struct input_file_missing_exception : public std::exception {
+  const char *what() const throw() { return "Wrong input file provided"; }
+};
+
+struct input_flag_exception : public std::exception {
+  const char *what() const throw() {
+    return "-i should be the only specified flag";
+  }
+};
+struct several_files_exception : public std::exception {
+  const char *what() const throw() {
+    return "with several files only -n, -d, -dd, -c, --top, --freq, -s, -rs "
+           "and --count-pattern can be used, without --stream, --follow and "
+           "--build-index";
+  }
+};
+struct utf8_exception : public std::exception {
+  const char *what() const throw() {
+    return "--utf8 and --ignore-case can't be used with --stream, -f -, "
+           "--follow, --build-index or several files";
+  }
+};
+struct line_range_exception : public std::exception {
+  const char *what() const throw() {
+    return "--lines takes \"A:B\" with 1 <= A <= B (or \"A:\" for lines "
+           "from A to the end) and --lines and --line-sample can't be used "
+           "with --stream, -f -, --follow, --build-index or several files";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief where the command writes and what it shares with other commands, a
+ * command of -i batch writes to its own buffers that are copied to the console
+ * in the order of the commands and takes its files from the cache of the batch.
+ * Commands of the server run on the threads of the server, -t of the request
+ * doesn't start threads of its own
+ */
+/* ----------------------------------------------------------------------------*/
+struct command_context {
+  output::sink *console = &output::standard_output();
+  std::ostream *errors = &std::cerr;
+  cache::file_cache *files = nullptr;
+  bool own_threads = true;
+};
+auto manage_command(const std::vector<std::string> &command_vector,
+                    bool = false, const command_context & = command_context())
+    -> bool;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief flags of the program, value of the flag is its position in
+ * command::flags
+ */
+/* ----------------------------------------------------------------------------*/
+enum class flag_id : std::uint8_t {
+  help,
+  file,
+  input,
+  newlines,
+  digits,
+  numbers,
+  chars,
+  anagrams,
+  palindroms,
+  sorted,
+  reverse_sorted,
+  output,
+  threads,
+  sort_memory,
+  stream,
+  bench,
+  stats,
+  stats_file,
+  build_index,
+  serve,
+  palindromic_words,
+  longest_palindromes,
+  count_palindromes,
+  top,
+  freq,
+  fuzzy,
+  follow,
+  utf8,
+  ignore_case,
+  lines,
+  line_sample,
+  count_pattern,
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief everything that is known about a flag: short name, alias, arguments
+ * and description for the help and name of the phase under which --stats
+ * records its time (nullptr for flags that only set options)
+ */
+/* ----------------------------------------------------------------------------*/
+struct flag_info {
+  flag_id id;
+  std::string_view name;
+  std::string_view alias;
+  std::string_view arguments;
+  std::string_view description;
+  const char *phase;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief registry of the flags, new flag is added here and to the switch of
+ * manage_command, the help is written from this table
+ */
+/* ----------------------------------------------------------------------------*/
+inline constexpr flag_info flags[] = {
+    {flag_id::help, "", "--help", "", "shows this help menu", nullptr},
+    {flag_id::file, "-f", "--file", "\"file_name\"",
+     "specify the file that will be used for the rest of the program, "
+     "several files, patterns like logs/*.log and directories can be "
+     "given, then every file is written after ==> file_name <== and the "
+     "merged result after ==> total <==, with -t the files are processed "
+     "at the same time. gzip and zstd files are decompressed while they "
+     "are read",
+     nullptr},
+    {flag_id::input, "-i", "--input", "\"file_name\"",
+     "!!!should be the only specified flag in program!!! specify the file "
+     "name that have a file with flags for the program, every line is one "
+     "command. Commands run at the same time and every file is loaded once "
+     "for all of them, output is written in the order of the lines",
+     nullptr},
+    {flag_id::newlines, "-n", "--newlines", "",
+     "will output number of lines that are in the file", "newline_flag"},
+    {flag_id::digits, "-d", "--digits", "",
+     "will output number of digits in a file", "digits_flag"},
+    {flag_id::numbers, "-dd", "--numbers", "",
+     "will output number of numbers in a file", "numbers_flag"},
+    {flag_id::chars, "-c", "--chars", "",
+     "will output number of chars in a file", "chars_flag"},
+    {flag_id::anagrams, "-a", "--anagrams", "\"words words\"",
+     "should be the last specified flag and after the flag all the words in "
+     "the file will be checked against anagrams and the ones that match will "
+     "be outputted",
+     "anagrams_flag"},
+    {flag_id::palindroms, "-p", "--palindroms", "\"words words\"",
+     "should be the last specified flag and after the flag all the words that "
+     "are palindroms and are in the file will be outputted",
+     "palindroms_flag"},
+    {flag_id::sorted, "-s", "--sorted", "",
+     "outputs all the words that are in the file in alphabetical order",
+     "sorted_flag"},
+    {flag_id::reverse_sorted, "-rs", "--reverse-sorted", "",
+     "outputs all the words that are in the file in reversed alphabetical "
+     "order",
+     "reverse_sorted_flag"},
+    {flag_id::output, "-o", "--output", "\"output_file_name\"",
+     "outputs of the command are written to specified file as they are "
+     "produced, the file is created or truncated before the command runs",
+     nullptr},
+    {flag_id::threads, "-t", "--threads", "\"N\"",
+     "splits the file to chunks that are processed by N threads, 0 uses all "
+     "cores of the machine, output is the same as with one thread",
+     nullptr},
+    {flag_id::sort_memory, "-m", "--sort-memory", "\"MB\"",
+     "memory that -s and -rs can use for sorting, when words don't fit they "
+     "are read from the file in parts that are sorted, saved to temporary "
+     "files and merged, so only one part is in memory next to the file "
+     "(default half of the memory). Doesn't apply to --utf8 in a locale "
+     "that is not C",
+     nullptr},
+    {flag_id::stream, "-st", "--stream", "",
+     "reads the file once through a buffer of fixed size instead of loading "
+     "it, memory used doesn't depend on the size of the file. -f - reads "
+     "standard input the same way. -s and -rs can't be streamed",
+     nullptr},
+    {flag_id::bench, "-b", "--bench", "\"key=value key=value\"",
+     "should be the last specified flag, generates corpus and writes time, "
+     "MB/s, words/s and allocations of every flag as JSON. Keys: seed, size "
+     "(MB), word-length (min:max), numbers, palindromes, anagrams (ratios of "
+     "words) and repeat",
+     nullptr},
+    {flag_id::stats, "-S", "--stats", "",
+     "writes to the standard error time of every phase (loading, indexing, "
+     "scanning, every flag and output), bytes read, lines, words, "
+     "allocations and peak memory of the command",
+     nullptr},
+    {flag_id::stats_file, "-Sf", "--stats-file", "\"file_name\"",
+     "writes the same statistics as --stats to the specified file as JSON",
+     nullptr},
+    {flag_id::build_index, "-bi", "--build-index", "",
+     "saves index of the file next to it (file name with .cidx), later "
+     "commands with -n, -d, -dd, -c, -a, -p, -s and -rs on the same file are "
+     "answered from the index without reading the file as long as the file "
+     "is not changed, gzip and zstd files can't be indexed",
+     nullptr},
+    {flag_id::serve, "-sv", "--serve", "\"socket_path\"",
+     "runs a server on the unix socket that takes commands with the same "
+     "flags, one command per line, and keeps the files loaded between them "
+     "(files are loaded again when they change, removed files and the least "
+     "recently used ones above 256 files or a quarter of the memory are "
+     "dropped). Every response starts with "
+     "line \"OK\" or \"ERROR\" with sizes of the output and of the errors in "
+     "bytes, then the output and the errors follow. -t \"N\" sets the number "
+     "of threads that run the commands (default all cores), -t of a command "
+     "sent to the server is ignored. SIGINT or SIGTERM stops the server",
+     nullptr},
+    {flag_id::palindromic_words, "-pw", "--palindromic-words", "",
+     "outputs every word of the file that is a palindrom",
+     "palindromic_words_flag"},
+    {flag_id::longest_palindromes, "-lp", "--longest-palindromes", "",
+     "outputs the longest palindromic substring of every line of the file, "
+     "one line for every line",
+     "longest_palindromes_flag"},
+    {flag_id::count_palindromes, "-cp", "--count-palindromes", "",
+     "outputs number of palindromic substrings of the lines of the file",
+     "count_palindromes_flag"},
+    {flag_id::top, "-tk", "--top", "\"K\"",
+     "outputs K most frequent words of the file with the number of their "
+     "occurences, most frequent first",
+     "top_words_flag"},
+    {flag_id::freq, "-fq", "--freq", "",
+     "outputs every word of the file with the number of its occurences, most "
+     "frequent first",
+     "top_words_flag"},
+    {flag_id::fuzzy, "-fz", "--fuzzy", "\"K\" \"words words\"",
+     "should be the last specified flag, outputs words of the file that can "
+     "be changed to one of the words by at most K inserted, deleted or "
+     "replaced characters",
+     "fuzzy_flag"},
+    {flag_id::follow, "-fl", "--follow", "",
+     "counts the file from its checkpoint (file name with .cfollow) so only "
+     "the bytes appended since the last run are read, the checkpoint is "
+     "created on the first run and the file is counted again when it is "
+     "truncated or replaced. Works with -n, -d, -dd, -c, --top and --freq",
+     nullptr},
+    {flag_id::utf8, "-u", "--utf8", "",
+     "reads the file as UTF-8: words are also separated by Unicode spaces, "
+     "-a, -p, -pw, -lp and -cp compare characters (a letter with its "
+     "combining marks is one character) instead of bytes and -s and -rs use "
+     "the collation of the locale from LC_ALL, LC_COLLATE or LANG. "
+     "--fuzzy still counts edits of bytes. Ascii words and lines are "
+     "handled as before",
+     nullptr},
+    {flag_id::ignore_case, "-ci", "--ignore-case", "",
+     "turns on --utf8 and -a, -p, -pw, -lp and -cp ignore case of Latin, "
+     "Greek, Cyrillic and Armenian letters",
+     nullptr},
+    {flag_id::lines, "-ln", "--lines", "\"A:B\"",
+     "the other flags of the command work only on lines A to B of the file "
+     "(counted from 1, \"A:\" goes to the end of the file), without other "
+     "flags the lines are outputted. Lines are found with the line index "
+     "(file name with .clines) that is saved on the first use, so the time "
+     "depends on the size of the range and not of the file",
+     "lines_flag"},
+    {flag_id::line_sample, "-ls", "--line-sample", "\"K\"",
+     "outputs K lines chosen at random from the file (or from the range of "
+     "--lines) in the order of the file, every line is found with the line "
+     "index without reading the lines before it",
+     "line_sample_flag"},
+    {flag_id::count_pattern, "-re", "--count-pattern", "\"re re\"",
+     "should be the last specified flag, outputs number of matches of every "
+     "pattern after the flag (leftmost-longest, not overlapping, within "
+     "lines). Patterns have ., [classes], \\d \\w \\s, groups, | and "
+     "* + ? {m,n}, all of them are compiled once to automata and counted in "
+     "one pass",
+     "count_pattern_flag"},
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief names and aliases of all flags in alphabetical order, sorted at
+ * compile time so a token is found by binary search without hashing or
+ * allocating
+ */
+/* ----------------------------------------------------------------------------*/
+struct flag_token {
+  std::string_view token;
+  flag_id id;
+};
+constexpr auto sorted_flag_tokens()
+    -> std::array<flag_token, 2 * std::size(flags)> {
+  std::array<flag_token, 2 * std::size(flags)> tokens{};
+  for (std::size_t i = 0; i < std::size(flags); ++i) {
+    tokens[2 * i] = {flags[i].name, flags[i].id};
+    tokens[2 * i + 1] = {flags[i].alias, flags[i].id};
+  }
+  std::sort(tokens.begin(), tokens.end(),
+            [](const flag_token &left, const flag_token &right) {
+              return left.token < right.token;
+            });
+  return tokens;
+}
+inline constexpr auto flag_tokens = sorted_flag_tokens();
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checks the registry: every flag is at the position of its id, has
+ * description and alias starting with "--" and no token is used twice
+ *
+ * @Returns bool
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr auto valid_flags() -> bool {
+  for (std::size_t i = 0; i < std::size(flags); ++i) {
+    if (std::size_t(flags[i].id) != i || flags[i].description.empty() ||
+        !flags[i].alias.starts_with("--"))
+      return false;
+  }
+  for (std::size_t i = 1; i < flag_tokens.size(); ++i)
+    if (flag_tokens[i - 1].token == flag_tokens[i].token) return false;
+  return true;
+}
+static_assert(valid_flags(), "flags have to be in the order of flag_id with "
+                             "unique names and aliases");
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief finds the flag by its name or alias
+ *
+ * @Param std::string_view
+ *
+ * @Returns const command::flag_info pointer, nullptr for unknown token
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr auto find_flag(std::string_view token) -> const flag_info * {
+  auto const found = std::lower_bound(
+      flag_tokens.begin(), flag_tokens.end(), token,
+      [](const flag_token &entry, std::string_view searched) {
+        return entry.token < searched;
+      });
+  if (found == flag_tokens.end() || found->token != token) return nullptr;
+  return &flags[std::size_t(found->id)];
+}
+static_assert(find_flag("--file")->id == flag_id::file &&
+              find_flag("")->id == flag_id::help && !find_flag("-x"));
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief prints help text to the console
+ *
+ * @Param output::sink reference
+ */
+/* ----------------------------------------------------------------------------*/
+auto print_help(output::sink &out = output::standard_output()) -> void {
+  out << "-----help-------\n"
+         "This program needs to be specified with first flag -f and file name "
+         "or just with the flag -i and name of the input file\n";
+  for (const auto &flag : flags) {
+    out << "flag [" << flag.name << "||" << flag.alias << "] ";
+    if (!flag.arguments.empty()) out << flag.arguments << ' ';
+    out << flag.description << '\n';
+  }
+  out << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief opens specified file and returns cache::cached_file object that is
+ * used for other commands, with the cache of the batch the file is shared with
+ * other commands that use it
+ *
+ * @Param const std::string reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param cache::file_cache pointer (can be nullptr)
+ *
+ * @Returns std::shared_ptr<const cache::cached_file>
+ */
+/* ----------------------------------------------------------------------------*/
+auto inline file_flag(const std::string &file_name,
+                      parallel::thread_pool *pool = nullptr,
+                      cache::file_cache *files = nullptr)
+    -> std::shared_ptr<const cache::cached_file> {
+  if (files) return files->get(file_name);
+  return std::make_shared<const cache::cached_file>(file_name, pool);
+}
+template <typename It>
+auto expand_paths(It &path_iterator, const It &end_iterator)
+    -> std::vector<std::string>;
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief files a command of -i batch reads and writes, all paths are
+ * normalized with cache::normalized_path. Directories and glob patterns
+ * after -f are kept too, so a file that is created in them later is also
+ * read by the command
+ */
+/* ----------------------------------------------------------------------------*/
+struct command_paths {
+  std::vector<std::string> reads;
+  std::vector<std::string> read_directories;
+  std::vector<std::string> read_patterns;
+  std::vector<std::string> writes;
+  bool alone = false;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief finds the files the command reads with -f and writes with -o and
+ * --stats-file, the command has to run alone when it reads the standard
+ * input, runs another batch or measures time with --bench
+ *
+ * @Param const std::vector<std::string> reference
+ *
+ * @Returns command::command_paths
+ */
+/* ----------------------------------------------------------------------------*/
+auto paths_of(const std::vector<std::string> &command_vector)
+    -> command_paths {
+  command_paths paths;
+  for (auto it = command_vector.begin(); it != command_vector.end(); ++it) {
+    const flag_info *flag = find_flag(*it);
+    if (!flag) continue;
+    switch (flag->id) {
+      case flag_id::input:
+      case flag_id::bench:
+        paths.alone = true;
+        return paths;
+      case flag_id::anagrams:
+      case flag_id::palindroms:
+      case flag_id::fuzzy:
+      case flag_id::count_pattern:
+        return paths;
+      case flag_id::output:
+      case flag_id::stats_file:
+        if (it + 1 != command_vector.end())
+          paths.writes.push_back(cache::normalized_path(*++it));
+        break;
+      case flag_id::file: {
+        if (it + 1 == command_vector.end()) break;
+        if (*++it == "-") {
+          paths.alone = true;
+          return paths;
+        }
+        for (auto path = it;; ++path) {
+          std::error_code error;
+          if (path->find_first_of("*?[") != std::string::npos)
+            paths.read_patterns.push_back(
+                std::filesystem::absolute(*path, error)
+                    .lexically_normal()
+                    .string());
+          else if (std::filesystem::is_directory(*path, error))
+            paths.read_directories.push_back(
+                cache::normalized_path(*path) + "/");
+          if (path + 1 == command_vector.end() || find_flag(*(path + 1)))
+            break;
+        }
+        try {
+          for (const auto &path : expand_paths(it, command_vector.end()))
+            paths.reads.push_back(cache::normalized_path(path));
+        } catch (std::exception &e) {
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return paths;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checks if the command reads the normalized path
+ *
+ * @Param const command::command_paths reference
+ * @Param const std::string reference
+ *
+ * @Returns bool
+ */
+/* ----------------------------------------------------------------------------*/
+auto reads_path(const command_paths &paths, const std::string &path) -> bool {
+  if (std::find(paths.reads.begin(), paths.reads.end(), path) !=
+      paths.reads.end())
+    return true;
+  for (const auto &directory : paths.read_directories)
+    if (path.starts_with(directory)) return true;
+  for (const auto &pattern : paths.read_patterns)
+    if (fnmatch(pattern.c_str(), path.c_str(), FNM_PATHNAME) == 0) return true;
+  return false;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief finds the commands that have to run alone: they read the standard
+ * input, run another batch or measure time with --bench, they read a file
+ * that an earlier command writes, or they write a file that another command
+ * reads or writes. Commands that run alone start after everything before them
+ * was written and commands after them start after they were written, so a
+ * file is never read while it's written and is never truncated while it's
+ * mapped
+ *
+ * @Param const std::vector<command::command_paths> reference paths of all
+ * commands of the batch
+ *
+ * @Returns std::vector<bool> true for the commands that run alone
+ */
+/* ----------------------------------------------------------------------------*/
+auto exclusive_commands(const std::vector<command_paths> &commands)
+    -> std::vector<bool> {
+  std::vector<bool> exclusive(commands.size());
+  std::vector<std::size_t> writers;
+  for (std::size_t index = 0; index < commands.size(); ++index) {
+    exclusive[index] = commands[index].alone;
+    if (!commands[index].writes.empty()) writers.push_back(index);
+  }
+  for (std::size_t writer : writers) {
+    for (std::size_t other = 0; other < commands.size(); ++other) {
+      if (other == writer) continue;
+      for (const auto &written : commands[writer].writes) {
+        bool const both_write =
+            std::find(commands[other].writes.begin(),
+                      commands[other].writes.end(),
+                      written) != commands[other].writes.end();
+        if (both_write || reads_path(commands[other], written)) {
+          exclusive[writer] = true;
+          if (other > writer) exclusive[other] = true;
+        }
+      }
+    }
+  }
+  return exclusive;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief takes the name of file and treats lines in the file as command with
+ * specified flags. Commands run on a pool of threads with the files shared
+ * through cache::file_cache, output and errors of every command are kept in
+ * its own buffers and written in the order of the lines. At most a few
+ * commands per thread are started ahead of the first one that wasn't written.
+ * Exclusive commands run alone after everything before them was written. The
+ * batch stops at the first command that fails, commands after it that were
+ * already started are finished but their output is dropped
+ *
+ * @Param const std::string reference
+ * @Param output::sink reference of the console
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto input_flag(const std::string &input_file_name, output::sink &console)
+    -> void {
+  std::unique_ptr<file::manage_file> input_file;
+  try {
+    input_file = std::make_unique<file::manage_file>(input_file_name);
+  } catch (std::exception &e) {
+    throw input_file_missing_exception();
+  }
+
+  std::vector<std::vector<std::string>> commands;
+  std::vector<command_paths> paths;
+  for (const auto &line : input_file->get_all_lines()) {
+    std::vector<std::string> all_flags;
+    std::istringstream buffer{std::string(line)};
+    std::copy(std::istream_iterator<std::string>(buffer),
+              std::istream_iterator<std::string>(),
+              std::back_inserter(all_flags));
+    paths.push_back(paths_of(all_flags));
+    commands.push_back(std::move(all_flags));
+  }
+  std::vector<bool> const exclusive = exclusive_commands(paths);
+
+  struct command_result {
+    output::sink console;
+    std::stringstream errors;
+    bool failed = false;
+    bool done = false;
+  };
+  unsigned const threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<command_result> results(commands.size());
+  std::mutex results_mutex;
+  std::condition_variable result_ready;
+  std::atomic<bool> cancelled{false};
+  cache::file_cache files(threads);
+  auto run = [&](std::size_t index) {
+    command_result &result = results[index];
+    command_context const context{&result.console, &result.errors, &files};
+    bool failed = false;
+    if (!cancelled.load(std::memory_order_relaxed)) {
+      try {
+        manage_command(commands[index], true, context);
+      } catch (std::exception &e) {
+        failed = true;
+      }
+    }
+    std::lock_guard<std::mutex> lock(results_mutex);
+    result.failed = failed;
+    result.done = true;
+    result_ready.notify_all();
+  };
+  parallel::thread_pool pool(threads);
+  std::size_t const ahead = 4 * std::size_t(threads);
+  std::size_t submitted = 0;
+  for (std::size_t written = 0; written < commands.size(); ++written) {
+    if (exclusive[written]) {
+      if (submitted == written) run(submitted++);
+    } else {
+      for (; submitted < commands.size() && submitted < written + ahead &&
+             !exclusive[submitted];
+           ++submitted)
+        pool.submit([&run, submitted] { run(submitted); });
+    }
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(results_mutex);
+        if (results[written].done) break;
+      }
+      if (pool.run_one()) continue;
+      std::unique_lock<std::mutex> lock(results_mutex);
+      result_ready.wait_for(lock, std::chrono::milliseconds(1),
+                            [&] { return results[written].done; });
+    }
+    for (const auto &written_path : paths[written].writes)
+      files.forget(written_path);
+    console << results[written].console.take();
+    console.flush();
+    std::cerr << results[written].errors.str();
+    if (results[written].failed) {
+      cancelled = true;
+      std::cerr << "Error while using command from input file\n";
+      break;
+    }
+    results[written].errors.str("");
+  }
+  while (pool.run_one()) {
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief checks if first argument iterator is not the last item in vector
+ *
+ * @Param iterator reference
+ * @Param const iterator reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto increment_iterator(It &increment_iterator, const It &end_iterator)
+    -> void {
+  ++increment_iterator;
+  if (increment_iterator == end_iterator) throw parssing_error_exception();
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief options that apply to the whole command no matter where in the
+ * command they were specified
+ */
+/* ----------------------------------------------------------------------------*/
+struct command_options {
+  unsigned counters = 0;
+  unsigned threads = 0;
+  bool serve = false;
+  std::size_t sort_memory = sorting::default_memory_budget();
+  bool stream = false;
+  bool stats = false;
+  std::string stats_file;
+  bool build_index = false;
+  bool follow = false;
+  bool vocabulary = false;
+  std::string output_file;
+  unicode::text_mode text = unicode::text_mode::bytes;
+  bool line_range = false;
+  std::uint64_t first_line = 1;
+  std::uint64_t last_line = std::numeric_limits<std::uint64_t>::max();
+  bool line_sample = false;
+  bool file_flags = false;
+  flag_id match_flag = flag_id::help;
+  std::size_t match_position = 0;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parses argument of the -t flag, 0 means all cores of the machine
+ *
+ * @Param const std::string reference
+ *
+ * @Returns unsigned
+ */
+/* ----------------------------------------------------------------------------*/
+auto parse_threads(const std::string &argument) -> unsigned {
+  if (argument.empty() || argument.size() > 4 ||
+      !std::all_of(argument.begin(), argument.end(),
+                   [](char c) { return c >= '0' && c <= '9'; }))
+    throw parssing_error_exception();
+  unsigned const threads = std::stoul(argument);
+  if (threads == 0) return std::max(1u, std::thread::hardware_concurrency());
+  return threads;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parses argument of the --top flag
+ *
+ * @Param const std::string reference
+ *
+ * @Returns std::size_t
+ */
+/* ----------------------------------------------------------------------------*/
+auto parse_count(const std::string &argument) -> std::size_t {
+  if (argument.empty() || argument.size() > 18 ||
+      !std::all_of(argument.begin(), argument.end(),
+                   [](char c) { return c >= '0' && c <= '9'; }))
+    throw parssing_error_exception();
+  return std::stoull(argument);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parses argument of the -m flag
+ *
+ * @Param const std::string reference number of megabytes
+ *
+ * @Returns std::size_t bytes
+ */
+/* ----------------------------------------------------------------------------*/
+auto parse_sort_memory(const std::string &argument) -> std::size_t {
+  if (argument.empty() || argument.size() > 9 ||
+      !std::all_of(argument.begin(), argument.end(),
+                   [](char c) { return c >= '0' && c <= '9'; }))
+    throw parssing_error_exception();
+  return std::max<std::size_t>(1, std::stoull(argument)) << 20;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parses argument of the --lines flag, "A:B" or "A:" for the lines
+ * from A to the end of the file
+ *
+ * @Param const std::string reference
+ *
+ * @Returns std::pair<std::uint64_t, std::uint64_t> first and last line
+ * counted from 1
+ */
+/* ----------------------------------------------------------------------------*/
+auto parse_line_range(const std::string &argument)
+    -> std::pair<std::uint64_t, std::uint64_t> {
+  std::size_t const colon = argument.find(':');
+  if (colon == std::string::npos) throw line_range_exception();
+  try {
+    std::uint64_t const first = parse_count(argument.substr(0, colon));
+    std::uint64_t const last =
+        colon + 1 == argument.size()
+            ? std::numeric_limits<std::uint64_t>::max()
+            : parse_count(argument.substr(colon + 1));
+    if (first == 0 || last < first) throw line_range_exception();
+    return {first, last};
+  } catch (parssing_error_exception &) {
+    throw line_range_exception();
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief goes through the command before it is executed and collects bits of
+ * all counters that are requested by it so the file is scanned only once for
+ * all of them, the number of threads (0 when -t is not given), if the command
+ * runs the server, the memory budget of the sort, if the
+ * file is streamed, where statistics are written, if the index is built, how
+ * words are compared, which lines the command works on and which flag matches
+ * words at the end of the command
+ *
+ * @Param const std::vector<std::string> reference
+ *
+ * @Returns command::command_options
+ */
+/* ----------------------------------------------------------------------------*/
+auto scan_options(const std::vector<std::string> &command_vector)
+    -> command_options {
+  command_options options;
+  for (auto it = command_vector.begin(); it != command_vector.end(); ++it) {
+    const flag_info *flag = find_flag(*it);
+    if (!flag) continue;
+    if (flag->phase && flag->id != flag_id::lines) options.file_flags = true;
+    switch (flag->id) {
+      case flag_id::file:
+        if (it + 1 != command_vector.end() && *++it == "-")
+          options.stream = true;
+        break;
+      case flag_id::serve:
+        options.serve = true;
+        [[fallthrough]];
+      case flag_id::input:
+        if (it + 1 != command_vector.end()) ++it;
+        break;
+      case flag_id::output:
+        increment_iterator(it, command_vector.end());
+        options.output_file = *it;
+        break;
+      case flag_id::newlines:
+        options.counters |= scan::lines;
+        break;
+      case flag_id::digits:
+        options.counters |= scan::digits;
+        break;
+      case flag_id::numbers:
+        options.counters |= scan::numbers;
+        break;
+      case flag_id::chars:
+        options.counters |= scan::chars;
+        break;
+      case flag_id::anagrams:
+      case flag_id::palindroms:
+      case flag_id::fuzzy:
+        options.match_flag = flag->id;
+        options.match_position = it - command_vector.begin();
+        return options;
+      case flag_id::bench:
+      case flag_id::count_pattern:
+        return options;
+      case flag_id::threads:
+        increment_iterator(it, command_vector.end());
+        options.threads = parse_threads(*it);
+        break;
+      case flag_id::sort_memory:
+        increment_iterator(it, command_vector.end());
+        options.sort_memory = parse_sort_memory(*it);
+        break;
+      case flag_id::stream:
+        options.stream = true;
+        break;
+      case flag_id::stats_file:
+        increment_iterator(it, command_vector.end());
+        options.stats_file = *it;
+        [[fallthrough]];
+      case flag_id::stats:
+        options.stats = true;
+        options.counters |= scan::lines | scan::words;
+        break;
+      case flag_id::build_index:
+        options.build_index = true;
+        break;
+      case flag_id::follow:
+        options.follow = true;
+        break;
+      case flag_id::top:
+      case flag_id::freq:
+        options.vocabulary = true;
+        break;
+      case flag_id::utf8:
+        if (options.text == unicode::text_mode::bytes)
+          options.text = unicode::text_mode::utf8;
+        break;
+      case flag_id::ignore_case:
+        options.text = unicode::text_mode::utf8_folded;
+        break;
+      case flag_id::lines:
+        increment_iterator(it, command_vector.end());
+        options.line_range = true;
+        std::tie(options.first_line, options.last_line) =
+            parse_line_range(*it);
+        break;
+      case flag_id::line_sample:
+        options.line_sample = true;
+        break;
+      default:
+        break;
+    }
+  }
+  return options;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes statistics of the command to the standard error or as JSON to
+ * the stats_file of the options. Lines and words are taken from the counters
+ * that were collected together with the counters of the command
+ *
+ * @Param const command::command_options reference
+ * @Param const file::manage_file pointer (can be nullptr)
+ * @Param const stream::stream_file pointer (can be nullptr)
+ * @Param const scan::summary pointer of the index or of the followed file (can
+ * be nullptr)
+ * @Param std::ostream reference used instead of the standard error
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto write_stats(const command_options &options, const file::manage_file *file,
+                 const stream::stream_file *stream,
+                 const scan::summary *known, std::ostream &errors) -> void {
+  stats::current.enabled = false;
+  try {
+    if (known) {
+      stats::current.lines = known->lines;
+      stats::current.words = known->words;
+    } else if (file) {
+      const auto &file_summary =
+          file->get_summary(scan::lines | scan::words);
+      stats::current.lines = file_summary.lines;
+      stats::current.words = file_summary.words;
+    } else if (stream && stream->is_consumed()) {
+      stats::current.lines = stream->get_summary().lines;
+      stats::current.words = stream->get_summary().words;
+    }
+  } catch (std::exception &e) {
+  }
+  if (options.stats_file.empty()) {
+    stats::write_report(errors, false);
+    return;
+  }
+  std::ofstream stats_output(options.stats_file);
+  if (!stats_output) {
+    errors << "Can't write statistics to " << options.stats_file
+              << std::endl;
+    return;
+  }
+  stats::write_report(stats_output, true);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes number of lines that are in the scanned file to the
+ * specified output::sink output_stream
+ *
+ * @Param output::sink reference
+ * @Param const scan::summary reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto newline_flag(output::sink &output_stream,
+                  const scan::summary &summary) -> void {
+  output_stream << "Lines in file: " << summary.lines << "\n";
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes number of digits that are in the scanned file to the
+ * specified output::sink output_stream
+ *
+ * @Param output::sink reference
+ * @Param const scan::summary reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto digits_flag(output::sink &output_stream,
+                 const scan::summary &summary) -> void {
+  output_stream << "Digits in file: " << summary.digits << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes number of numbers that are in the scanned file to the
+ * specified output::sink output_stream
+ *
+ * @Param output::sink reference
+ * @Param const scan::summary reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto numbers_flag(output::sink &output_stream,
+                  const scan::summary &summary) -> void {
+  output_stream << "Numbers in file: " << summary.numbers << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes number of chars that are in the scanned file to the
+ * specified output::sink output_stream
+ *
+ * @Param output::sink reference
+ * @Param const scan::summary reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto chars_flag(output::sink &output_stream, const scan::summary &summary)
+    -> void {
+  output_stream << "Chars in file: " << summary.chars << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes words for which matcher returns non zero to output_stream, each
+ * word as many times as matcher returned, in the order they are in words. With
+ * the pool words are split to ranges that are matched in parallel and then
+ * written in order so the output is the same as without the pool
+ *
+ * @Param output::sink reference
+ * @Param const file::ref_table reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param matcher callable with std::string_view returning std::size_t
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename Matcher>
+auto write_matches(output::sink &output_stream,
+                   const file::ref_table &words,
+                   parallel::thread_pool *pool, Matcher matcher) -> void {
+  std::size_t const ranges = pool ? pool->size() * 4 : 1;
+  std::vector<std::string> range_output(ranges);
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    std::size_t const begin = words.size() * range / ranges;
+    std::size_t const end = words.size() * (range + 1) / ranges;
+    for (std::size_t i = begin; i < end; ++i) {
+      for (std::size_t repeat = matcher(words[i]); repeat; --repeat) {
+        range_output[range].append(words[i]);
+        range_output[range].push_back('\n');
+      }
+    }
+  });
+  for (const auto &output : range_output) output_stream << output;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs to output_stream words that are found in file and are anagrams
+ * in the specified iterator range, words are looked up in the anagram index of
+ * the file so every word of the file is canonicalized only once. Word is
+ * written once for every word in the range that it is an anagram of
+ *
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param iterator reference
+ * @Param const iterator reference
+ * @Param unicode::text_mode
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto anagrams_flag(output::sink &output_stream,
+                   const file::manage_file &file, It &word_iterator,
+                   const It &end_iterator,
+                   unicode::text_mode mode = unicode::text_mode::bytes)
+    -> void {
+  output_stream << "Anagrams Found: " << '\n';
+  word_iterator++;
+  mode = file.matching_mode(mode);
+  helper::anagram_queries const anagrams(word_iterator, end_iterator, mode);
+  word_iterator = end_iterator;
+  const auto &index = file.get_anagram_index(mode);
+  std::vector<std::pair<std::size_t, std::size_t>> found;
+  for (const auto &[anagram, repeats] : anagrams.get_signatures()) {
+    if (const auto *positions = index.find(anagram))
+      for (const auto position : *positions)
+        found.emplace_back(position, repeats);
+  }
+  std::sort(found.begin(), found.end());
+  const auto &words = file.get_all_words(mode);
+  for (const auto &[position, repeats] : found)
+    for (std::size_t repeat = 0; repeat < repeats; ++repeat)
+      output_stream << words[position] << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs to output_stream words that are found in file and are
+ * palindroms in the specified iterator range, with
+ * unicode::text_mode::utf8_folded words are compared folded to lower case
+ *
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param iterator reference
+ * @Param const iterator reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param unicode::text_mode
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto palindroms_flag(output::sink &output_stream,
+                     const file::manage_file &file, It &word_iterator,
+                     const It &end_iterator,
+                     parallel::thread_pool *pool = nullptr,
+                     unicode::text_mode mode = unicode::text_mode::bytes)
+    -> void {
+  word_iterator++;
+  mode = file.matching_mode(mode);
+  auto palindrom_set = helper::palindroms(word_iterator, end_iterator, mode);
+  output_stream << "Palindroms found: " << '\n';
+  if (mode != unicode::text_mode::utf8_folded) {
+    write_matches(output_stream, file.get_all_words(mode), pool,
+                  [&palindrom_set](std::string_view word) -> std::size_t {
+                    return palindrom_set.contains(word);
+                  });
+    return;
+  }
+  write_matches(output_stream, file.get_all_words(mode), pool,
+                [&palindrom_set](std::string_view word) -> std::size_t {
+                  thread_local std::string folded;
+                  unicode::fold_word(word, folded);
+                  return palindrom_set.contains(folded);
+                });
+}
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs to the output_stream sorted words that are present in the file
+ * in the alphabetical order, keys that were already sorted are written without
+ * sorting again
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param std::size_t memory budget of the sort in bytes
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param const std::vector<sorting::sort_key> pointer to keys of all words in
+ * alphabetical order (can be nullptr)
+ * @Param unicode::text_mode words of utf8 modes are sorted in the collation
+ * order of the locale
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto sorted_flag(output::sink &output_stream,
+                 const file::manage_file &file, std::size_t sort_memory,
+                 parallel::thread_pool *pool = nullptr,
+                 const std::vector<sorting::sort_key> *sorted = nullptr,
+                 unicode::text_mode mode = unicode::text_mode::bytes)
+    -> void {
+  auto write = [&output_stream](std::string_view word) {
+    output_stream << word << '\n';
+  };
+  const auto &order = sorting::collation::environment();
+  if (mode != unicode::text_mode::bytes && !order.codepoint_order()) {
+    sorting::sort_collated(file.get_all_words(mode), order, false, pool,
+                           write);
+    return;
+  }
+  const char *base = file.get_text().data();
+  if (sorted) {
+    for (const auto &key : *sorted)
+      output_stream << std::string_view(base + key.offset, key.length)
+                    << '\n';
+    return;
+  }
+  sorting::sort_words(file, mode, false, sort_memory, pool, write);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs to the output_stream sorted words that are present in the file
+ * in the reversed alphabetical order, keys that were already sorted are
+ * written backwards without sorting again
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param std::size_t memory budget of the sort in bytes
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param const std::vector<sorting::sort_key> pointer to keys of all words in
+ * alphabetical order (can be nullptr)
+ * @Param unicode::text_mode words of utf8 modes are sorted in the collation
+ * order of the locale
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto reverse_sorted_flag(output::sink &output_stream,
+                         const file::manage_file &file,
+                         std::size_t sort_memory,
+                         parallel::thread_pool *pool = nullptr,
+                         const std::vector<sorting::sort_key> *sorted = nullptr,
+                         unicode::text_mode mode = unicode::text_mode::bytes)
+    -> void {
+  auto write = [&output_stream](std::string_view word) {
+    output_stream << word << '\n';
+  };
+  const auto &order = sorting::collation::environment();
+  if (mode != unicode::text_mode::bytes && !order.codepoint_order()) {
+    sorting::sort_collated(file.get_all_words(mode), order, true, pool, write);
+    return;
+  }
+  const char *base = file.get_text().data();
+  if (sorted) {
+    for (auto key = sorted->rbegin(); key != sorted->rend(); ++key)
+      output_stream << std::string_view(base + key->offset, key->length)
+                    << '\n';
+    return;
+  }
+  sorting::sort_words(file, mode, true, sort_memory, pool, write);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes words of the indexed file for which repeats is non zero to
+ * output_stream, each word as many times as repeats says, in the order they
+ * are in the file. Like write_matches ranges of words are matched in parallel
+ * on the pool and written in order
+ *
+ * @Param output::sink reference
+ * @Param const sidecar::index_file reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param const std::vector<std::size_t> reference repeats of every word of
+ * the dictionary
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto write_index_matches(output::sink &output_stream,
+                         const sidecar::index_file &index,
+                         parallel::thread_pool *pool,
+                         const std::vector<std::size_t> &repeats) -> void {
+  if (std::all_of(repeats.begin(), repeats.end(),
+                  [](std::size_t repeat) { return repeat == 0; }))
+    return;
+  auto const word_ids = index.get_word_ids();
+  std::size_t const ranges = pool ? pool->size() * 4 : 1;
+  std::vector<std::string> range_output(ranges);
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    std::size_t const begin = word_ids.size() * range / ranges;
+    std::size_t const end = word_ids.size() * (range + 1) / ranges;
+    for (std::size_t i = begin; i < end; ++i) {
+      if (word_ids[i] >= repeats.size())
+        throw sidecar::index_corrupted_exception();
+      for (std::size_t repeat = repeats[word_ids[i]]; repeat; --repeat) {
+        range_output[range].append(index.word(word_ids[i]));
+        range_output[range].push_back('\n');
+      }
+    }
+  });
+  for (const auto &output : range_output) output_stream << output;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief -a answered from the index, the query signatures are looked up in
+ * the signature table of the index so the words of the file are not touched
+ * until the matches are written
+ *
+ * @Param output::sink reference
+ * @Param const sidecar::index_file reference
+ * @Param iterator reference
+ * @Param const iterator reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto anagrams_flag(output::sink &output_stream,
+                   const sidecar::index_file &index, It &word_iterator,
+                   const It &end_iterator,
+                   parallel::thread_pool *pool = nullptr) -> void {
+  output_stream << "Anagrams Found: " << '\n';
+  word_iterator++;
+  helper::anagram_queries const anagrams(word_iterator, end_iterator);
+  word_iterator = end_iterator;
+  std::vector<std::size_t> repeats(index.get_dictionary().size(), 0);
+  for (const auto &[anagram, query_repeats] : anagrams.get_signatures())
+    index.for_each_anagram(anagram, [&repeats, query_repeats](std::uint32_t id) {
+      repeats[id] = query_repeats;
+    });
+  write_index_matches(output_stream, index, pool, repeats);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief -p answered from the index, palindroms of the query are looked up in
+ * the dictionary of the index
+ *
+ * @Param output::sink reference
+ * @Param const sidecar::index_file reference
+ * @Param iterator reference
+ * @Param const iterator reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto palindroms_flag(output::sink &output_stream,
+                     const sidecar::index_file &index, It &word_iterator,
+                     const It &end_iterator,
+                     parallel::thread_pool *pool = nullptr) -> void {
+  word_iterator++;
+  auto palindrom_set = helper::palindroms(word_iterator, end_iterator);
+  output_stream << "Palindroms found: " << '\n';
+  std::vector<std::size_t> repeats(index.get_dictionary().size(), 0);
+  for (const auto &palindrom : palindrom_set) {
+    std::size_t const id = index.find(palindrom);
+    if (id < repeats.size()) repeats[id] = 1;
+  }
+  write_index_matches(output_stream, index, pool, repeats);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parses the distance after --fuzzy and builds helper::fuzzy_queries
+ * from the words after it
+ *
+ * @Param iterator reference to the --fuzzy flag, moved to end_iterator
+ * @Param const iterator reference
+ *
+ * @Returns helper::fuzzy_queries
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto parse_fuzzy(It &word_iterator, const It &end_iterator)
+    -> helper::fuzzy_queries {
+  increment_iterator(word_iterator, end_iterator);
+  std::size_t const distance = parse_count(*word_iterator);
+  helper::fuzzy_queries queries(word_iterator + 1, end_iterator, distance);
+  word_iterator = end_iterator;
+  return queries;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs to output_stream words of the file that are within the edit
+ * distance of any word in the specified iterator range, each match as many
+ * times as it is in the file and in the order of the file. Every distinct word
+ * of the file is compared with the queries once (in parallel on the pool) and
+ * the file is written through the set of the matched words
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param iterator reference
+ * @Param const iterator reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param unicode::text_mode
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto fuzzy_flag(output::sink &output_stream, const file::manage_file &file,
+                It &word_iterator, const It &end_iterator,
+                parallel::thread_pool *pool = nullptr,
+                unicode::text_mode mode = unicode::text_mode::bytes) -> void {
+  auto const queries = parse_fuzzy(word_iterator, end_iterator);
+  output_stream << "Fuzzy matches: " << '\n';
+  const auto &words = file.get_all_words(mode);
+  std::vector<std::string_view> vocabulary;
+  helper::word_counts::count(words, pool)
+      .for_each([&vocabulary](std::string_view word, std::uint64_t) {
+        vocabulary.push_back(word);
+      });
+  std::size_t const ranges = pool ? pool->size() * 4 : 1;
+  std::vector<std::vector<std::string_view>> range_matches(ranges);
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    for (std::size_t i = vocabulary.size() * range / ranges;
+         i < vocabulary.size() * (range + 1) / ranges; ++i)
+      if (queries(vocabulary[i])) range_matches[range].push_back(vocabulary[i]);
+  });
+  helper::string_set matched;
+  for (const auto &matches : range_matches)
+    matched.insert(matches.begin(), matches.end());
+  if (matched.empty()) return;
+  write_matches(output_stream, words, pool,
+                [&matched](std::string_view word) -> std::size_t {
+                  return matched.contains(word);
+                });
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief --fuzzy answered from the index, words of the dictionary are the
+ * distinct words of the file so they are compared with the queries directly
+ *
+ * @Param output::sink reference
+ * @Param const sidecar::index_file reference
+ * @Param iterator reference
+ * @Param const iterator reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto fuzzy_flag(output::sink &output_stream, const sidecar::index_file &index,
+                It &word_iterator, const It &end_iterator,
+                parallel::thread_pool *pool = nullptr) -> void {
+  auto const queries = parse_fuzzy(word_iterator, end_iterator);
+  output_stream << "Fuzzy matches: " << '\n';
+  std::vector<std::size_t> repeats(index.get_dictionary().size(), 0);
+  std::size_t const ranges = pool ? pool->size() * 4 : 1;
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    for (std::size_t id = repeats.size() * range / ranges;
+         id < repeats.size() * (range + 1) / ranges; ++id)
+      repeats[id] = queries(index.word(id));
+  });
+  write_index_matches(output_stream, index, pool, repeats);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief -s and -rs answered from the index, dictionary of the index is in
+ * alphabetical order so every word is written as many times as it is in the
+ * file
+ *
+ * @Param output::sink reference
+ * @Param const sidecar::index_file reference
+ * @Param bool true for reversed alphabetical order
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto index_sorted_flag(output::sink &output_stream,
+                       const sidecar::index_file &index, bool descending)
+    -> void {
+  std::size_t const words = index.get_dictionary().size();
+  for (std::size_t i = 0; i < words; ++i) {
+    std::uint32_t const id = descending ? words - 1 - i : i;
+    std::string_view const word = index.word(id);
+    for (auto repeat = index.get_dictionary()[id].frequency; repeat; --repeat)
+      output_stream << word << '\n';
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs to output_stream every word of the file that is a palindrom,
+ * in the order they are in the file
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param unicode::text_mode
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto palindromic_words_flag(
+    output::sink &output_stream, const file::manage_file &file,
+    parallel::thread_pool *pool = nullptr,
+    unicode::text_mode mode = unicode::text_mode::bytes) -> void {
+  output_stream << "Palindromic words: " << '\n';
+  mode = file.matching_mode(mode);
+  write_matches(output_stream, file.get_all_words(mode), pool,
+                [mode](std::string_view word) -> std::size_t {
+                  return helper::check_if_palindrome(word, mode);
+                });
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief -pw answered from the index, every word of the dictionary is checked
+ * once
+ *
+ * @Param output::sink reference
+ * @Param const sidecar::index_file reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto palindromic_words_flag(output::sink &output_stream,
+                            const sidecar::index_file &index,
+                            parallel::thread_pool *pool = nullptr) -> void {
+  output_stream << "Palindromic words: " << '\n';
+  std::vector<std::size_t> repeats(index.get_dictionary().size(), 0);
+  for (std::uint32_t id = 0; id < repeats.size(); ++id)
+    repeats[id] = helper::check_if_palindrome(index.word(id));
+  write_index_matches(output_stream, index, pool, repeats);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs to output_stream the longest palindromic substring of every
+ * line of the file, one line of output for every line. Ranges of lines are
+ * processed in parallel on the pool and written in order
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param unicode::text_mode
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto longest_palindromes_flag(
+    output::sink &output_stream, const file::manage_file &file,
+    parallel::thread_pool *pool = nullptr,
+    unicode::text_mode mode = unicode::text_mode::bytes) -> void {
+  output_stream << "Longest palindromes in lines: " << '\n';
+  mode = file.matching_mode(mode);
+  const auto &lines = file.get_all_lines();
+  std::size_t const ranges = pool ? pool->size() * 4 : 1;
+  std::vector<std::string> range_output(ranges);
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    thread_local helper::palindrome_radii radii;
+    for (std::size_t i = lines.size() * range / ranges;
+         i < lines.size() * (range + 1) / ranges; ++i) {
+      radii.compute(lines[i], mode);
+      range_output[range].append(radii.longest(lines[i]));
+      range_output[range].push_back('\n');
+    }
+  });
+  for (const auto &output : range_output) output_stream << output;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes number of palindromic substrings of the lines of the file,
+ * every position is counted so "aaa" has 6 of them. Lines are counted in
+ * parallel on the pool
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param unicode::text_mode
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto count_palindromes_flag(
+    output::sink &output_stream, const file::manage_file &file,
+    parallel::thread_pool *pool = nullptr,
+    unicode::text_mode mode = unicode::text_mode::bytes) -> void {
+  mode = file.matching_mode(mode);
+  const auto &lines = file.get_all_lines();
+  std::size_t const ranges = pool ? pool->size() * 4 : 1;
+  std::vector<long long> range_count(ranges, 0);
+  parallel::for_each_index(pool, ranges, [&](std::size_t range) {
+    thread_local helper::palindrome_radii radii;
+    for (std::size_t i = lines.size() * range / ranges;
+         i < lines.size() * (range + 1) / ranges; ++i) {
+      radii.compute(lines[i], mode);
+      range_count[range] += radii.count();
+    }
+  });
+  long long total = 0;
+  for (const auto count : range_count) total += count;
+  output_stream << "Palindromic substrings in file: " << total << "\n";
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes words with their counts, one "count word" line for each word
+ *
+ * @Param output::sink reference
+ * @Param const std::vector<std::pair<std::string_view, std::uint64_t>>
+ * reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto write_counts(
+    output::sink &output_stream,
+    const std::vector<std::pair<std::string_view, std::uint64_t>> &counts)
+    -> void {
+  for (const auto &[word, count] : counts)
+    output_stream << count << ' ' << word << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs k most frequent words of the file with their counts, words
+ * are counted in helper::word_counts (in parallel with the pool) and selected
+ * with a bounded heap. When k is bigger than number of distinct words all of
+ * them are written, which is the whole frequency histogram
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param std::size_t k
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param unicode::text_mode
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto top_words_flag(output::sink &output_stream,
+                    const file::manage_file &file, std::size_t k,
+                    parallel::thread_pool *pool = nullptr,
+                    unicode::text_mode mode = unicode::text_mode::bytes)
+    -> void {
+  auto const counts =
+      helper::word_counts::count(file.get_all_words(mode), pool);
+  write_counts(output_stream,
+               helper::most_frequent(
+                   [&counts](auto visit) { counts.for_each(visit); }, k));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief --top and --freq answered from the index, counts are the frequencies
+ * that are saved in the dictionary
+ *
+ * @Param output::sink reference
+ * @Param const sidecar::index_file reference
+ * @Param std::size_t k
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto top_words_flag(output::sink &output_stream,
+                    const sidecar::index_file &index, std::size_t k) -> void {
+  write_counts(output_stream,
+               helper::most_frequent(
+                   [&index](auto visit) {
+                     auto const dictionary = index.get_dictionary();
+                     for (std::uint32_t id = 0; id < dictionary.size(); ++id)
+                       visit(index.word(id), dictionary[id].frequency);
+                   },
+                   k));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief --top and --freq of the followed file, counts are the vocabulary of
+ * its checkpoint
+ *
+ * @Param output::sink reference
+ * @Param const follow::vocabulary_table reference
+ * @Param std::size_t k
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto top_words_flag(output::sink &output_stream,
+                    const follow::vocabulary_table &vocabulary, std::size_t k)
+    -> void {
+  write_counts(output_stream, helper::most_frequent(
+                                  [&vocabulary](auto visit) {
+                                    for (const auto &[word, count] : vocabulary)
+                                      visit(word, count);
+                                  },
+                                  k));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief builds index of the file and then writes where it was saved
+ *
+ * @Param output::sink reference
+ * @Param const std::string reference name of the file
+ * @Param const file::manage_file reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto build_index_flag(output::sink &output_stream,
+                      const std::string &file_name,
+                      const file::manage_file &file,
+                      parallel::thread_pool *pool = nullptr) -> void {
+  std::string const index_name = sidecar::build(file_name, file, pool);
+  output_stream << "Index saved to: " << index_name << "\n";
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs the lines of the --lines range, the last line gets newline
+ * when the file doesn't end with one
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference part of the file with the range
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto lines_flag(output::sink &output_stream, const file::manage_file &file)
+    -> void {
+  std::string_view const text = file.get_text();
+  output_stream << "Lines of the range: " << '\n' << text;
+  if (!text.empty() && text.back() != '\n') output_stream << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief outputs k lines of [first, last) chosen at random without repeating
+ * any line, in the order of the file. Numbers of the lines are chosen first
+ * (Floyd's algorithm, k steps) and every line is then found with the index,
+ * so only the chosen lines are read
+ *
+ * @Param output::sink reference
+ * @Param std::string_view whole text of the file
+ * @Param const seek::line_index reference
+ * @Param std::uint64_t first line counted from 0
+ * @Param std::uint64_t line after the last one
+ * @Param std::uint64_t k
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto line_sample_flag(output::sink &output_stream, std::string_view text,
+                      const seek::line_index &index, std::uint64_t first,
+                      std::uint64_t last, std::uint64_t k) -> void {
+  output_stream << "Sampled lines: " << '\n';
+  last = std::min(last, index.lines);
+  std::uint64_t const available = first < last ? last - first : 0;
+  std::vector<std::uint64_t> chosen;
+  if (k >= available) {
+    chosen.resize(available);
+    std::iota(chosen.begin(), chosen.end(), first);
+  } else {
+    std::mt19937_64 random(std::random_device{}());
+    std::unordered_set<std::uint64_t> picked;
+    picked.reserve(k);
+    for (std::uint64_t j = available - k; j < available; ++j) {
+      std::uint64_t const candidate =
+          std::uniform_int_distribution<std::uint64_t>(0, j)(random);
+      picked.insert(picked.count(candidate) ? j : candidate);
+    }
+    chosen.assign(picked.begin(), picked.end());
+    std::sort(chosen.begin(), chosen.end());
+    for (auto &line : chosen) line += first;
+  }
+  for (const auto line : chosen) {
+    std::string_view const sampled = index.range(text, line, line + 1);
+    output_stream << sampled;
+    if (sampled.empty() || sampled.back() != '\n') output_stream << '\n';
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes count of every pattern before the pattern
+ *
+ * @Param output::sink reference
+ * @Param const pattern::pattern_set reference
+ * @Param const std::vector<std::uint64_t> reference
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto write_pattern_counts(output::sink &output_stream,
+                          const pattern::pattern_set &patterns,
+                          const std::vector<std::uint64_t> &counts) -> void {
+  output_stream << "Pattern counts: " << '\n';
+  for (std::size_t i = 0; i < counts.size(); ++i)
+    output_stream << counts[i] << ' ' << patterns.get_sources()[i] << '\n';
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief compiles the patterns after --count-pattern, the iterator is moved
+ * to the end
+ *
+ * @Param iterator reference to the --count-pattern flag
+ * @Param const iterator reference
+ *
+ * @Returns pattern::pattern_set
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto compile_patterns(It &pattern_iterator, const It &end_iterator)
+    -> pattern::pattern_set {
+  pattern_iterator++;
+  std::vector<std::string> const sources(pattern_iterator, end_iterator);
+  pattern_iterator = end_iterator;
+  return pattern::pattern_set(sources);
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief --count-pattern, every pattern after the flag is counted in the file
+ *
+ * @Param output::sink reference
+ * @Param const file::manage_file reference
+ * @Param iterator reference
+ * @Param const iterator reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto count_pattern_flag(output::sink &output_stream,
+                        const file::manage_file &file, It &pattern_iterator,
+                        const It &end_iterator,
+                        parallel::thread_pool *pool = nullptr) -> void {
+  pattern::pattern_set const patterns =
+      compile_patterns(pattern_iterator, end_iterator);
+  write_pattern_counts(output_stream, patterns,
+                       patterns.count(file.get_text(), pool));
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief builds matcher of the words for -a or -p at the end of the command
+ *
+ * @Param const command::command_options reference
+ * @Param const std::vector<std::string> reference
+ * @Param std::size_t reference set to the length of the longest query word
+ *
+ * @Returns std::function matcher, empty when there is no -a or -p
+ */
+/* ----------------------------------------------------------------------------*/
+auto stream_matcher(const command_options &options,
+                    const std::vector<std::string> &command_vector,
+                    std::size_t &longest_word)
+    -> std::function<std::size_t(std::string_view)> {
+  longest_word = 0;
+  auto queries_begin = command_vector.begin() + options.match_position + 1;
+  if (options.match_flag == flag_id::anagrams) {
+    auto anagrams = std::make_shared<helper::anagram_queries>(
+        queries_begin, command_vector.end());
+    longest_word = anagrams->get_longest();
+    return [anagrams](std::string_view word) { return (*anagrams)(word); };
+  }
+  if (options.match_flag == flag_id::palindroms) {
+    auto palindroms = std::make_shared<helper::string_set>(
+        helper::palindroms(queries_begin, command_vector.end()));
+    for (const auto &palindrom : *palindroms)
+      longest_word = std::max(longest_word, palindrom.size());
+    return [palindroms](std::string_view word) -> std::size_t {
+      return palindroms->contains(word);
+    };
+  }
+  if (options.match_flag == flag_id::fuzzy) {
+    auto flag_iterator = command_vector.begin() + options.match_position;
+    auto fuzzy = std::make_shared<helper::fuzzy_queries>(
+        parse_fuzzy(flag_iterator, command_vector.end()));
+    longest_word = fuzzy->get_longest();
+    return [fuzzy](std::string_view word) { return (*fuzzy)(word); };
+  }
+  return {};
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief reads the whole stream for the counting flags of the command, words
+ * matched by -a or -p at the end of the command are spilled to temporary file
+ * until the flag is reached
+ *
+ * @Param stream::stream_file reference
+ * @Param const command::command_options reference
+ * @Param const std::vector<std::string> reference
+ *
+ * @Returns std::FILE pointer to the spilled matches, nullptr without -a or -p
+ */
+/* ----------------------------------------------------------------------------*/
+auto consume_stream(stream::stream_file &stream,
+                    const command_options &options,
+                    const std::vector<std::string> &command_vector)
+    -> std::FILE * {
+  std::size_t longest_word;
+  auto const matcher = stream_matcher(options, command_vector, longest_word);
+  std::FILE *spilled = matcher ? std::tmpfile() : nullptr;
+  if (matcher && !spilled) throw sorting::spill_failed_exception();
+  try {
+    stream.consume(options.counters, matcher, longest_word,
+                   [spilled](std::string_view word) {
+                     if (std::fwrite(word.data(), 1, word.size(), spilled) !=
+                             word.size() ||
+                         std::fputc('\n', spilled) == EOF)
+                       throw sorting::spill_failed_exception();
+                   });
+    if (spilled && std::fflush(spilled) != 0)
+      throw sorting::spill_failed_exception();
+  } catch (...) {
+    if (spilled) std::fclose(spilled);
+    throw;
+  }
+  if (spilled) std::rewind(spilled);
+  return spilled;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief -a and -p for streamed file, matches are written to output_stream
+ * while the stream is read. When the stream was already read for counting
+ * flags the spilled matches are copied
+ *
+ * @Param output::sink reference
+ * @Param stream::stream_file reference
+ * @Param const command::command_options reference
+ * @Param const std::vector<std::string> reference
+ * @Param std::FILE pointer to spilled matches (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto stream_matches_flag(output::sink &output_stream,
+                         stream::stream_file &stream,
+                         const command_options &options,
+                         const std::vector<std::string> &command_vector,
+                         std::FILE *spilled) -> void {
+  output_stream << (options.match_flag == flag_id::anagrams   ? "Anagrams Found: "
+                    : options.match_flag == flag_id::palindroms ? "Palindroms found: "
+                                              : "Fuzzy matches: ")
+                << '\n';
+  if (spilled) {
+    char chunk[1 << 16];
+    std::size_t read_bytes;
+    while ((read_bytes = std::fread(chunk, 1, sizeof(chunk), spilled)) > 0)
+      output_stream << std::string_view(chunk, read_bytes);
+    if (std::ferror(spilled)) throw sorting::spill_failed_exception();
+    return;
+  }
+  std::size_t longest_word;
+  auto const matcher = stream_matcher(options, command_vector, longest_word);
+  stream.consume(options.counters, matcher, longest_word,
+                 [&output_stream](std::string_view word) {
+                   output_stream << word << '\n';
+                 });
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief takes the paths after -f until the next flag, every path can be a
+ * file, a directory that is walked recursively (indexes and checkpoints of
+ * this program are skipped) or a glob pattern. Files of a directory are in
+ * alphabetical order, glob that matches nothing is kept as it is so the error
+ * names it. Throws file::cannot_open_file_exception when only empty
+ * directories are given
+ *
+ * @Param iterator reference to the first path, moved to the last path
+ * @Param const iterator reference
+ *
+ * @Returns std::vector<std::string>
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto expand_paths(It &path_iterator, const It &end_iterator)
+    -> std::vector<std::string> {
+  std::vector<std::string> paths;
+  auto add_path = [&paths](const std::string &path) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) {
+      paths.push_back(path);
+      return;
+    }
+    std::vector<std::string> walked;
+    for (std::filesystem::recursive_directory_iterator it(path, error), end;
+         !error && it != end; it.increment(error)) {
+      std::string const name = it->path().string();
+      if (it->is_regular_file(error) && !name.ends_with(sidecar::suffix) &&
+          !name.ends_with(follow::suffix) && !name.ends_with(seek::suffix))
+        walked.push_back(name);
+    }
+    std::sort(walked.begin(), walked.end());
+    paths.insert(paths.end(), walked.begin(), walked.end());
+  };
+  while (true) {
+    const std::string &pattern = *path_iterator;
+    glob_t matched;
+    if (pattern.find_first_of("*?[") != std::string::npos &&
+        glob(pattern.c_str(), GLOB_NOCHECK, nullptr, &matched) == 0) {
+      for (std::size_t i = 0; i < matched.gl_pathc; ++i)
+        add_path(matched.gl_pathv[i]);
+      globfree(&matched);
+    } else {
+      add_path(pattern);
+    }
+    if (path_iterator + 1 == end_iterator || find_flag(*(path_iterator + 1)))
+      break;
+    ++path_iterator;
+  }
+  if (paths.empty()) throw file::cannot_open_file_exception();
+  return paths;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief flags of the command that are run on several files, --top has its K
+ */
+/* ----------------------------------------------------------------------------*/
+struct files_action {
+  flag_id id;
+  std::size_t k;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes the flag for one file or for the total of all files, the
+ * counters, distinct words with their counts and matches of the patterns are
+ * already collected
+ *
+ * @Param output::sink reference
+ * @Param const command::files_action reference
+ * @Param const scan::summary reference
+ * @Param const helper::word_counts reference
+ * @Param const pattern::pattern_set pointer (nullptr without -re)
+ * @Param const std::vector<std::uint64_t> reference counts of the patterns
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+auto write_files_action(output::sink &output_stream,
+                        const files_action &action,
+                        const scan::summary &summary,
+                        const helper::word_counts &counts,
+                        const pattern::pattern_set *patterns,
+                        const std::vector<std::uint64_t> &pattern_counts)
+    -> void {
+  auto visit_counts = [&counts](auto visit) { counts.for_each(visit); };
+  switch (action.id) {
+    case flag_id::newlines:
+      newline_flag(output_stream, summary);
+      break;
+    case flag_id::digits:
+      digits_flag(output_stream, summary);
+      break;
+    case flag_id::numbers:
+      numbers_flag(output_stream, summary);
+      break;
+    case flag_id::chars:
+      chars_flag(output_stream, summary);
+      break;
+    case flag_id::top:
+      output_stream << "Top " << action.k << " words: \n";
+      write_counts(output_stream, helper::most_frequent(visit_counts, action.k));
+      break;
+    case flag_id::freq:
+      output_stream << "Word frequencies: \n";
+      write_counts(output_stream, helper::most_frequent(visit_counts, action.k));
+      break;
+    case flag_id::sorted:
+    case flag_id::reverse_sorted: {
+      std::vector<std::pair<std::string_view, std::uint64_t>> words;
+      words.reserve(counts.size());
+      counts.for_each([&words](std::string_view word, std::uint64_t count) {
+        words.emplace_back(word, count);
+      });
+      std::sort(words.begin(), words.end());
+      if (action.id == flag_id::reverse_sorted)
+        std::reverse(words.begin(), words.end());
+      for (const auto &[word, count] : words)
+        for (std::uint64_t repeat = 0; repeat < count; ++repeat)
+          output_stream << word << '\n';
+      break;
+    }
+    case flag_id::count_pattern:
+      write_pattern_counts(output_stream, *patterns, pattern_counts);
+      break;
+    default:
+      break;
+  }
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief -f with several files: the flags after the paths are run on every
+ * file and then on all of them together. Files are scheduled on the pool
+ * biggest first so a few huge files don't end up at the end, each of them is
+ * split to ranges on the same pool and the threads that wait help with the
+ * queued ranges of the others. Only as many files as there are threads are
+ * queued at once, next file is queued when one is finished, so threads that
+ * help don't start all of the files. Files that will be taken next are read
+ * ahead.
+ * Results of every file are written in the order of the paths under
+ * "==> path <==" line, merged total follows under "==> total <==". Every
+ * file is added to the total as soon as its output is written and released,
+ * the total keeps its own copies of the words. Only
+ * counting flags, --top, --freq, -s, -rs and -re can be merged, patterns of
+ * -re are compiled once for all files
+ *
+ * @Param output::sink reference
+ * @Param const std::vector<std::string> reference paths of the files
+ * @Param iterator reference to the last path, moved to the end
+ * @Param const iterator reference
+ * @Param const command::command_options reference
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param cache::file_cache pointer (can be nullptr)
+ *
+ * @Returns scan::summary of all files
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto files_flag(output::sink &output_stream,
+                const std::vector<std::string> &paths, It &command_iterator,
+                const It &command_end, const command_options &options,
+                parallel::thread_pool *pool, cache::file_cache *files)
+    -> scan::summary {
+  if (options.stream || options.follow || options.build_index)
+    throw several_files_exception();
+  std::vector<files_action> actions;
+  std::optional<pattern::pattern_set> patterns;
+  bool needs_words = false;
+  for (++command_iterator; command_iterator != command_end;
+       ++command_iterator) {
+    const flag_info *flag = find_flag(*command_iterator);
+    if (!flag) throw parssing_error_exception();
+    files_action action{flag->id, std::numeric_limits<std::size_t>::max()};
+    switch (flag->id) {
+      case flag_id::top:
+        increment_iterator(command_iterator, command_end);
+        action.k = parse_count(*command_iterator);
+        [[fallthrough]];
+      case flag_id::freq:
+      case flag_id::sorted:
+      case flag_id::reverse_sorted:
+        needs_words = true;
+        [[fallthrough]];
+      case flag_id::newlines:
+      case flag_id::digits:
+      case flag_id::numbers:
+      case flag_id::chars:
+        actions.push_back(action);
+        break;
+      case flag_id::output:
+      case flag_id::threads:
+      case flag_id::sort_memory:
+      case flag_id::stats_file:
+        increment_iterator(command_iterator, command_end);
+        break;
+      case flag_id::stats:
+        break;
+      case flag_id::count_pattern:
+        patterns.emplace(compile_patterns(command_iterator, command_end));
+        actions.push_back(action);
+        --command_iterator;
+        break;
+      default:
+        throw several_files_exception();
+    }
+  }
+  --command_iterator;
+
+  struct file_result {
+    output::sink output;
+    std::exception_ptr error;
+    bool done = false;
+  };
+  std::vector<file_result> results(paths.size());
+  std::vector<std::size_t> order(paths.size());
+  for (std::size_t i = 0; i < paths.size(); ++i) order[i] = i;
+  if (pool) {
+    std::vector<std::uintmax_t> sizes(paths.size());
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      std::error_code error;
+      sizes[i] = std::filesystem::file_size(paths[i], error);
+      if (error) sizes[i] = 0;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&sizes](std::size_t left, std::size_t right) {
+                       return sizes[left] > sizes[right];
+                     });
+  }
+  std::size_t const ahead = pool ? pool->size() : 1;
+  for (std::size_t i = 0; i < std::min(ahead, order.size()); ++i)
+    file::read_ahead(paths[order[i]]);
+  scan::summary total;
+  helper::word_counts total_counts;
+  std::vector<std::uint64_t> total_pattern_counts(
+      patterns ? patterns->get_sources().size() : 0, 0);
+  std::mutex total_mutex;
+  std::mutex results_mutex;
+  std::condition_variable result_ready;
+  std::size_t submitted = 0;
+  std::function<void()> submit_next;
+  auto run = [&](std::size_t scheduled, output::sink &file_output) {
+    if (scheduled + ahead < order.size())
+      file::read_ahead(paths[order[scheduled + ahead]]);
+    std::string const &path = paths[order[scheduled]];
+    file_result &result = results[order[scheduled]];
+    try {
+      auto loaded_file = file_flag(path, pool, files);
+      const file::manage_file &loaded = loaded_file->file;
+      scan::summary const summary = loaded.get_summary(options.counters);
+      helper::word_counts counts;
+      std::vector<std::uint64_t> pattern_counts;
+      if (needs_words)
+        counts = helper::word_counts::count(loaded.get_all_words(), pool);
+      if (patterns) pattern_counts = patterns->count(loaded.get_text(), pool);
+      file_output << "==> " << path << " <==\n";
+      for (const auto &action : actions)
+        write_files_action(file_output, action, summary, counts,
+                           patterns ? &*patterns : nullptr, pattern_counts);
+      std::lock_guard<std::mutex> lock(total_mutex);
+      total.lines += summary.lines;
+      total.digits += summary.digits;
+      total.numbers += summary.numbers;
+      total.chars += summary.chars;
+      total.words += summary.words;
+      counts.for_each(
+          [&total_counts](std::string_view word, std::uint64_t count) {
+            total_counts.add_copy(word, count);
+          });
+      for (std::size_t i = 0; i < pattern_counts.size(); ++i)
+        total_pattern_counts[i] += pattern_counts[i];
+    } catch (...) {
+      result.error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(results_mutex);
+    result.done = true;
+    if (pool) submit_next();
+    result_ready.notify_all();
+  };
+  submit_next = [&] {
+    if (submitted == order.size()) return;
+    std::size_t const scheduled = submitted++;
+    pool->submit([&run, &results, &order, scheduled] {
+      run(scheduled, results[order[scheduled]].output);
+    });
+  };
+
+  std::exception_ptr error;
+  if (pool) {
+    std::lock_guard<std::mutex> lock(results_mutex);
+    for (std::size_t i = 0; i < ahead; ++i) submit_next();
+  }
+  for (std::size_t written = 0; written < results.size(); ++written) {
+    file_result &result = results[written];
+    if (!pool) {
+      if (error) break;
+      run(written, output_stream);
+    }
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(results_mutex);
+        if (result.done) break;
+      }
+      if (pool->run_one()) continue;
+      std::unique_lock<std::mutex> lock(results_mutex);
+      result_ready.wait_for(lock, std::chrono::milliseconds(1),
+                            [&result] { return result.done; });
+    }
+    if (!error) error = result.error;
+    if (error) continue;
+    output_stream << result.output.take();
+  }
+  if (error) std::rethrow_exception(error);
+  output_stream << "==> total <==\n";
+  for (const auto &action : actions)
+    write_files_action(output_stream, action, total, total_counts,
+                       patterns ? &*patterns : nullptr, total_pattern_counts);
+  return total;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief Command parser per say it manages the flow of the command flags
+ *
+ * @Param const std::vector<std::string> reference
+ * @Param bool true when the command is a line of -i input file
+ * @Param const command::command_context reference
+ *
+ * @Returns bool false when the command failed
+ */
+/* ----------------------------------------------------------------------------*/
+auto manage_command(const std::vector<std::string> &command_vector, bool input,
+                    const command_context &context) -> bool {
+  if (command_vector.size() == 0 || command_vector[0].at(0) != '-')
+    print_help(*context.console);
+  std::unique_ptr<parallel::thread_pool> pool;
+  std::shared_ptr<const cache::cached_file> my_file;
+  std::unique_ptr<sidecar::index_file> my_index;
+  std::unique_ptr<follow::result> my_follow;
+  std::optional<scan::summary> files_summary;
+  std::string file_name;
+  scan::summary index_summary;
+  std::unique_ptr<stream::stream_file> my_stream;
+  std::optional<seek::line_index> my_lines;
+  std::string_view whole_text;
+  std::unique_ptr<std::FILE, int (*)(std::FILE *)> spilled_matches(nullptr,
+                                                                   std::fclose);
+  std::unique_ptr<output::sink> output_file;
+  output::sink *out = context.console;
+  auto command_iterator = command_vector.begin();
+  auto command_end = command_vector.end();
+  command_options options;
+  bool failed = false;
+  auto opened_file = [&]() -> const file::manage_file & {
+    if (!my_file) throw file::file_not_opened_exception();
+    return my_file->file;
+  };
+  auto loaded_file = [&]() -> const file::manage_file & {
+    if (my_stream) throw stream::not_streamable_exception();
+    if (my_follow) throw follow::not_followable_exception();
+    if (file_name.empty()) throw file::file_not_opened_exception();
+    if (!my_file) my_file = file_flag(file_name, pool.get(), context.files);
+    return my_file->file;
+  };
+  auto known_summary = [&]() -> const scan::summary * {
+    if (my_index) return &index_summary;
+    if (my_follow) return &my_follow->summary;
+    if (files_summary) return &*files_summary;
+    return nullptr;
+  };
+  auto summary = [&]() -> const scan::summary & {
+    if (const auto *known = known_summary()) return *known;
+    if (!my_stream) return opened_file().get_summary(options.counters);
+    if (!my_stream->is_consumed())
+      spilled_matches.reset(
+          consume_stream(*my_stream, options, command_vector));
+    return my_stream->get_summary();
+  };
+  try {
+    options = scan_options(command_vector);
+    if (options.stats) stats::enable();
+    if (options.threads > 1 && !options.serve && context.own_threads)
+      pool = std::make_unique<parallel::thread_pool>(options.threads);
+    if (!options.output_file.empty()) {
+      output_file = output::sink::open_file(options.output_file);
+      out = output_file.get();
+    }
+    while (command_iterator != command_end) {
+      const flag_info *flag = find_flag(*command_iterator);
+      if (!flag) throw parssing_error_exception();
+      stats::scoped_phase const flag_phase(flag->phase);
+      switch (flag->id) {
+        case flag_id::help:
+          print_help(*context.console);
+          break;
+        case flag_id::file: {
+          increment_iterator(command_iterator, command_end);
+          auto const paths = expand_paths(command_iterator, command_end);
+          if (options.text != unicode::text_mode::bytes &&
+              (paths.size() > 1 || options.stream || options.follow ||
+               options.build_index))
+            throw utf8_exception();
+          if ((options.line_range || options.line_sample) &&
+              (paths.size() > 1 || options.stream || options.follow ||
+               options.build_index))
+            throw line_range_exception();
+          if (paths.size() > 1) {
+            files_summary = files_flag(*out, paths, command_iterator,
+                                       command_end, options, pool.get(),
+                                       context.files);
+            break;
+          }
+          file_name = paths.front();
+          if (options.follow) {
+            if (options.stream || options.build_index)
+              throw follow::not_followable_exception();
+            my_follow = std::make_unique<follow::result>(
+                follow::update(file_name, options.vocabulary));
+            break;
+          }
+          if (options.stream) {
+            my_stream = std::make_unique<stream::stream_file>(file_name);
+            break;
+          }
+          if (options.build_index &&
+              compressed::format_of(file_name) != compressed::format::plain)
+            throw sidecar::compressed_source_exception();
+          if (!options.build_index && !options.line_range &&
+              !options.line_sample &&
+              options.text == unicode::text_mode::bytes)
+            my_index = sidecar::index_file::open_for(file_name);
+          if (my_index) {
+            index_summary = my_index->get_summary();
+            break;
+          }
+          my_file = file_flag(file_name, pool.get(), context.files);
+          if (options.line_range || options.line_sample) {
+            whole_text = my_file->file.get_text();
+            my_lines = seek::open_for(file_name, whole_text, pool.get());
+          }
+          if (options.line_range)
+            my_file = std::make_shared<const cache::cached_file>(
+                my_file, my_lines->range(whole_text, options.first_line - 1,
+                                         options.last_line));
+          break;
+        }
+        case flag_id::input:
+          increment_iterator(command_iterator, command_end);
           if (command_vector.size() != 2) throw input_flag_exception();
-          input_flag(*command_iterator);
+          input_flag(*command_iterator, *context.console);
+          break;
+        case flag_id::newlines:
+          newline_flag(*out, summary());
+          break;
+        case flag_id::digits:
+          digits_flag(*out, summary());
+          break;
+        case flag_id::numbers:
+          numbers_flag(*out, summary());
+          break;
+        case flag_id::chars:
+          chars_flag(*out, summary());
+          break;
+        case flag_id::anagrams:
+        case flag_id::palindroms:
+        case flag_id::fuzzy:
+          if (my_follow) throw follow::not_followable_exception();
+          if (my_stream) {
+            stream_matches_flag(*out, *my_stream, options, command_vector,
+                                spilled_matches.get());
+            command_iterator = command_end;
+          } else if (my_index && flag->id == flag_id::fuzzy) {
+            fuzzy_flag(*out, *my_index, command_iterator, command_end,
+                       pool.get());
+          } else if (my_index && flag->id == flag_id::anagrams) {
+            anagrams_flag(*out, *my_index, command_iterator, command_end,
+                          pool.get());
+          } else if (my_index) {
+            palindroms_flag(*out, *my_index, command_iterator, command_end,
+                            pool.get());
+          } else if (flag->id == flag_id::fuzzy) {
+            fuzzy_flag(*out, opened_file(), command_iterator, command_end,
+                       pool.get(), options.text);
+          } else if (flag->id == flag_id::anagrams) {
+            anagrams_flag(*out, opened_file(), command_iterator, command_end,
+                          options.text);
+          } else {
+            palindroms_flag(*out, opened_file(), command_iterator, command_end,
+                            pool.get(), options.text);
+          }
+          break;
+        case flag_id::sorted:
+          if (my_stream) throw stream::not_streamable_exception();
+          if (my_follow) throw follow::not_followable_exception();
+          if (my_index) {
+            index_sorted_flag(*out, *my_index, false);
+            break;
+          }
+          opened_file();
+          sorted_flag(*out, my_file->file, options.sort_memory, pool.get(),
+                      my_file->get_sorted_keys(options.sort_memory, pool.get(),
+                                               options.text),
+                      options.text);
+          break;
+        case flag_id::reverse_sorted:
+          if (my_stream) throw stream::not_streamable_exception();
+          if (my_follow) throw follow::not_followable_exception();
+          if (my_index) {
+            index_sorted_flag(*out, *my_index, true);
+            break;
+          }
+          opened_file();
+          reverse_sorted_flag(
+              *out, my_file->file, options.sort_memory, pool.get(),
+              my_file->get_sorted_keys(options.sort_memory, pool.get(),
+                                       options.text),
+              options.text);
+          break;
+        case flag_id::output:
+          increment_iterator(command_iterator, command_end);
           break;
-        case 3:
-          newline_flag(flags_output, *my_file);
+        case flag_id::threads:
+        case flag_id::sort_memory:
+          increment_iterator(command_iterator, command_end);
+          break;
+        case flag_id::stream:
+        case flag_id::stats:
+          break;
+        case flag_id::stats_file:
+          increment_iterator(command_iterator, command_end);
           break;
-        case 4:
-          digits_flag(flags_output, *my_file);
+        case flag_id::palindromic_words:
+          if (my_index)
+            palindromic_words_flag(*out, *my_index, pool.get());
+          else
+            palindromic_words_flag(*out, loaded_file(), pool.get(),
+                                   options.text);
           break;
-        case 5:
-          numbers_flag(flags_output, *my_file);
+        case flag_id::longest_palindromes:
+          longest_palindromes_flag(*out, loaded_file(), pool.get(),
+                                   options.text);
           break;
-        case 6:
-          chars_flag(flags_output, *my_file);
+        case flag_id::count_palindromes:
+          count_palindromes_flag(*out, loaded_file(), pool.get(),
+                                 options.text);
           break;
-        case 7:
-          anagrams_flag(flags_output, *my_file, command_iterator, command_end);
+        case flag_id::top:
+        case flag_id::freq: {
+          std::size_t k = std::numeric_limits<std::size_t>::max();
+          if (flag->id == flag_id::top) {
+            increment_iterator(command_iterator, command_end);
+            k = parse_count(*command_iterator);
+            *out << "Top " << k << " words: \n";
+          } else {
+            *out << "Word frequencies: \n";
+          }
+          if (my_follow)
+            top_words_flag(*out, my_follow->vocabulary, k);
+          else if (my_index)
+            top_words_flag(*out, *my_index, k);
+          else
+            top_words_flag(*out, loaded_file(), k, pool.get(), options.text);
           break;
-        case 8:
-          palindroms_flag(flags_output, *my_file, command_iterator,
-                          command_end);
+        }
+        case flag_id::follow:
+        case flag_id::utf8:
+        case flag_id::ignore_case:
           break;
-        case 9:
-          sorted_flag(flags_output, *my_file);
+        case flag_id::lines:
+          increment_iterator(command_iterator, command_end);
+          if (!options.file_flags) lines_flag(*out, loaded_file());
           break;
-        case 10:
-          reverse_sorted_flag(flags_output, *my_file);
+        case flag_id::line_sample:
+          increment_iterator(command_iterator, command_end);
+          loaded_file();
+          if (!my_lines) throw line_range_exception();
+          line_sample_flag(*out, whole_text, *my_lines, options.first_line - 1,
+                           options.last_line, parse_count(*command_iterator));
           break;
-        case 11:
+        case flag_id::serve:
           increment_iterator(command_iterator, command_end);
-          output_flag(out, *command_iterator);
+          server::serve(*command_iterator, options.threads);
+          break;
+        case flag_id::build_index:
+          if (my_stream) throw stream::not_streamable_exception();
+          if (my_follow) throw follow::not_followable_exception();
+          build_index_flag(*out, file_name, opened_file(), pool.get());
+          break;
+        case flag_id::count_pattern:
+          count_pattern_flag(*out, loaded_file(), command_iterator, command_end,
+                             pool.get());
+          break;
+        case flag_id::bench:
+          bench::run_benchmarks(*out, command_iterator + 1, command_end,
+                                pool.get());
+          command_iterator = command_end;
           break;
         default:
           break;
@@ -602,15 +8264,889 @@ auto manage_command(const std::vector<std::string> &command_vector, bool input)
       if (command_end != command_iterator) ++command_iterator;
     }
   } catch (std::exception &e) {
-    std::cerr << e.what() << std::endl;
-    print_help();
-    if (input) throw e;
+    failed = true;
+    *context.errors << e.what() << std::endl;
+    print_help(*context.console);
+    if (input) {
+      if (options.stats)
+        write_stats(options, my_file ? &my_file->file : nullptr,
+                    my_stream.get(), known_summary(), *context.errors);
+      throw e;
+    }
   };
-  *out << flags_output.str();
+  bool written;
+  {
+    stats::scoped_phase const phase("output");
+    out->flush();
+    context.console->flush();
+    written = !out->failed() && !context.console->failed();
+  }
+  if (!written) {
+    failed = true;
+    *context.errors << output::output_write_exception().what() << std::endl;
+  }
+  if (options.stats)
+    write_stats(options, my_file ? &my_file->file : nullptr, my_stream.get(),
+                known_summary(), *context.errors);
+  if (!written && input) throw output::output_write_exception();
+  return !failed;
 }
 }  // namespace command
+namespace server {
+struct server_exception : public std::exception {
+  const char *what() const throw() {
+    return "Error while starting the server on the socket";
+  }
+};
+struct request_not_allowed_exception : public std::exception {
+  const char *what() const throw() {
+    return "-i, -f - and --serve can't be sent to the server";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief requests longer than this close the connection
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr std::size_t max_request_size = 1 << 20;
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief the server keeps at most this many files loaded, and at most a
+ * quarter of the memory of the machine of their text, least recently used
+ * files are dropped first
+ */
+/* ----------------------------------------------------------------------------*/
+constexpr std::size_t max_cached_files = 256;
+constexpr std::uint64_t listener_id = 0;
+constexpr std::uint64_t wakeup_id = 1;
+constexpr std::uint64_t signal_id = 2;
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief connection of one client, requests of the client are executed one
+ * after another so responses come in the order of the requests
+ */
+/* ----------------------------------------------------------------------------*/
+struct client {
+  int descriptor;
+  std::string input;
+  std::string output;
+  std::deque<std::vector<std::string>> requests;
+  std::uint32_t events = 0;
+  bool busy = false;
+  bool input_closed = false;
+  bool closing = false;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief response of a request that was executed on the pool
+ */
+/* ----------------------------------------------------------------------------*/
+struct completion {
+  std::uint64_t client_id;
+  std::string response;
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief executes one request and returns the response, "OK" or "ERROR"
+ * followed by byte sizes of the output and of the errors and the line end,
+ * then the output and the errors. Requests that read the standard input or
+ * run a batch are refused
+ *
+ * @Param const std::vector<std::string> reference
+ * @Param cache::file_cache reference
+ *
+ * @Returns std::string
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto execute(const std::vector<std::string> &request,
+                    cache::file_cache &files) -> std::string {
+  output::sink console;
+  std::stringstream errors;
+  bool failed = false;
+  try {
+    for (std::size_t i = 0; i < request.size(); ++i) {
+      const command::flag_info *flag = command::find_flag(request[i]);
+      if (!flag) continue;
+      if (flag->id == command::flag_id::input ||
+          flag->id == command::flag_id::serve ||
+          (flag->id == command::flag_id::file && i + 1 < request.size() &&
+           request[i + 1] == "-"))
+        throw request_not_allowed_exception();
+    }
+    failed = !command::manage_command(
+        request, true,
+        command::command_context{&console, &errors, &files, false});
+  } catch (request_not_allowed_exception &e) {
+    errors << e.what() << std::endl;
+    failed = true;
+  } catch (...) {
+    failed = true;
+  }
+  std::string output = console.take();
+  if (failed) output.clear();
+  std::string const error_output = errors.str();
+  std::string response = failed ? "ERROR " : "OK ";
+  response += std::to_string(output.size()) + " " +
+              std::to_string(error_output.size()) + "\n";
+  response += output;
+  response += error_output;
+  return response;
+}
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief daemon that answers commands sent over a local unix socket, one
+ * command per line in the same syntax as the command line. Files stay loaded
+ * in cache::file_cache between requests and are loaded again when they change
+ * on disk. Connections are served by one epoll loop, commands run on the pool
+ * and wake the loop through an eventfd when they finish. SIGINT and SIGTERM
+ * stop the server and remove the socket
+ */
+/* ----------------------------------------------------------------------------*/
+struct unix_server {
+ private:
+  std::string socket_path;
+  int listener;
+  int epoll_descriptor;
+  int wakeup;
+  int signals;
+  std::uint64_t next_client_id;
+  std::unordered_map<std::uint64_t, client> clients;
+  std::mutex completions_mutex;
+  std::vector<completion> completions;
+  cache::file_cache files;
+  parallel::thread_pool pool;
+
+  auto watch(int descriptor, std::uint64_t id, std::uint32_t events,
+             int operation = EPOLL_CTL_ADD) -> void {
+    struct epoll_event event {};
+    event.events = events;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll_descriptor, operation, descriptor, &event) != 0)
+      throw server_exception();
+  }
+  auto accept_clients() -> void {
+    while (true) {
+      int const descriptor =
+          accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (descriptor < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      std::uint64_t const id = next_client_id++;
+      clients[id].descriptor = descriptor;
+      clients[id].events = EPOLLIN;
+      watch(descriptor, id, EPOLLIN);
+    }
+  }
+  auto close_client(std::uint64_t id) -> void {
+    auto found = clients.find(id);
+    if (found == clients.end()) return;
+    if (found->second.busy) {
+      found->second.closing = true;
+      epoll_ctl(epoll_descriptor, EPOLL_CTL_DEL, found->second.descriptor,
+                nullptr);
+      return;
+    }
+    close(found->second.descriptor);
+    clients.erase(found);
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief reads everything the client sent and queues complete lines, when
+   * the client stops sending the connection stays open until all of its
+   * requests are answered
+   *
+   * @Returns bool false when the client has to be closed
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto read_requests(client &connection) -> bool {
+    char chunk[1 << 16];
+    while (true) {
+      ssize_t const read_bytes = read(connection.descriptor, chunk, sizeof(chunk));
+      if (read_bytes < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+      }
+      if (read_bytes == 0) {
+        connection.input_closed = true;
+        break;
+      }
+      connection.input.append(chunk, read_bytes);
+    }
+    std::size_t begin = 0;
+    for (std::size_t newline = connection.input.find('\n');
+         newline != std::string::npos;
+         newline = connection.input.find('\n', begin)) {
+      std::vector<std::string> request;
+      std::istringstream buffer(connection.input.substr(begin, newline - begin));
+      std::copy(std::istream_iterator<std::string>(buffer),
+                std::istream_iterator<std::string>(),
+                std::back_inserter(request));
+      if (!request.empty()) connection.requests.push_back(std::move(request));
+      begin = newline + 1;
+    }
+    connection.input.erase(0, begin);
+    return connection.input.size() <= max_request_size;
+  }
+  auto dispatch(std::uint64_t id, client &connection) -> void {
+    if (connection.busy || connection.requests.empty()) return;
+    connection.busy = true;
+    pool.submit([this, id, request = std::move(connection.requests.front())] {
+      std::string response = execute(request, files);
+      {
+        std::lock_guard<std::mutex> lock(completions_mutex);
+        completions.push_back({id, std::move(response)});
+      }
+      std::uint64_t const one = 1;
+      while (::write(wakeup, &one, sizeof(one)) < 0 && errno == EINTR) {
+      }
+    });
+    connection.requests.pop_front();
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief writes as much of the pending output as the socket takes, the rest
+   * is written when epoll says the socket is writable again
+   *
+   * @Returns bool false when the client has to be closed
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto flush(client &connection) -> bool {
+    std::size_t written = 0;
+    while (written < connection.output.size()) {
+      ssize_t const sent =
+          send(connection.descriptor, connection.output.data() + written,
+               connection.output.size() - written, MSG_NOSIGNAL);
+      if (sent < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+      }
+      written += sent;
+    }
+    connection.output.erase(0, written);
+    return true;
+  }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief starts the next request of the client, watches the socket for the
+   * events the connection waits for and closes it when the client stopped
+   * sending and everything was answered
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto update(std::uint64_t id, client &connection) -> void {
+    dispatch(id, connection);
+    if (connection.input_closed && !connection.busy &&
+        connection.requests.empty() && connection.output.empty()) {
+      close_client(id);
+      return;
+    }
+    std::uint32_t const events =
+        (connection.input_closed ? std::uint32_t(0) : std::uint32_t(EPOLLIN)) |
+        (connection.output.empty() ? std::uint32_t(0) : std::uint32_t(EPOLLOUT));
+    if (events == connection.events) return;
+    connection.events = events;
+    watch(connection.descriptor, id, events, EPOLL_CTL_MOD);
+  }
+  auto finish_requests() -> void {
+    std::uint64_t counter;
+    while (read(wakeup, &counter, sizeof(counter)) < 0 && errno == EINTR) {
+    }
+    std::vector<completion> finished;
+    {
+      std::lock_guard<std::mutex> lock(completions_mutex);
+      finished.swap(completions);
+    }
+    for (auto &done : finished) {
+      auto found = clients.find(done.client_id);
+      if (found == clients.end()) continue;
+      client &connection = found->second;
+      connection.busy = false;
+      if (connection.closing) {
+        close_client(done.client_id);
+        continue;
+      }
+      connection.output += done.response;
+      if (flush(connection))
+        update(done.client_id, connection);
+      else
+        close_client(done.client_id);
+    }
+  }
+
+ public:
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief binds the socket, old socket that is left at the path is replaced.
+   * The loop never runs commands itself so the pool gets one thread more than
+   * it would for a thread that helps with its tasks
+   *
+   * @Param const std::string reference path of the socket
+   * @Param unsigned number of threads that execute the commands
+   */
+  /* ----------------------------------------------------------------------------*/
+  unix_server(const std::string &socket_path, unsigned threads)
+      : socket_path(socket_path),
+        listener(-1),
+        epoll_descriptor(-1),
+        wakeup(-1),
+        signals(-1),
+        next_client_id(signal_id + 1),
+        files(threads, file::load_mode::buffered,
+              sorting::default_memory_budget() / 2, max_cached_files),
+        pool(threads + 1) {
+    struct sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+      throw server_exception();
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    struct stat socket_stat;
+    if (lstat(socket_path.c_str(), &socket_stat) == 0 &&
+        S_ISSOCK(socket_stat.st_mode))
+      unlink(socket_path.c_str());
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epoll_descriptor = epoll_create1(EPOLL_CLOEXEC);
+    wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    signals = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (listener < 0 || epoll_descriptor < 0 || wakeup < 0 || signals < 0 ||
+        bind(listener, reinterpret_cast<struct sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+      release();
+      throw server_exception();
+    }
+    watch(listener, listener_id, EPOLLIN);
+    watch(wakeup, wakeup_id, EPOLLIN);
+    watch(signals, signal_id, EPOLLIN);
+  }
+  unix_server(const unix_server &) = delete;
+  auto operator=(const unix_server &) -> unix_server & = delete;
+  ~unix_server() { release(); }
+  /* --------------------------------------------------------------------------*/
+  /**
+   * @brief serves clients until SIGINT or SIGTERM
+   */
+  /* ----------------------------------------------------------------------------*/
+  auto run() -> void {
+    std::vector<struct epoll_event> events(256);
+    while (true) {
+      int const ready =
+          epoll_wait(epoll_descriptor, events.data(), events.size(), -1);
+      if (ready < 0) {
+        if (errno == EINTR) continue;
+        throw server_exception();
+      }
+      for (int i = 0; i < ready; ++i) {
+        std::uint64_t const id = events[i].data.u64;
+        if (id == signal_id) {
+          struct signalfd_siginfo received;
+          while (read(signals, &received, sizeof(received)) < 0 &&
+                 errno == EINTR) {
+          }
+          return;
+        }
+        if (id == listener_id) {
+          accept_clients();
+          continue;
+        }
+        if (id == wakeup_id) {
+          finish_requests();
+          continue;
+        }
+        auto found = clients.find(id);
+        if (found == clients.end() || found->second.closing) continue;
+        client &connection = found->second;
+        bool open = true;
+        if (events[i].events & EPOLLIN) open = read_requests(connection);
+        if (open && (events[i].events & EPOLLOUT)) open = flush(connection);
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) open = false;
+        if (!open) {
+          close_client(id);
+          continue;
+        }
+        update(id, connection);
+      }
+    }
+  }
+
+ private:
+  auto release() -> void {
+    for (auto &[id, connection] : clients) close(connection.descriptor);
+    clients.clear();
+    if (listener >= 0) {
+      close(listener);
+      unlink(socket_path.c_str());
+      listener = -1;
+    }
+    for (int *descriptor : {&epoll_descriptor, &wakeup, &signals}) {
+      if (*descriptor >= 0) close(*descriptor);
+      *descriptor = -1;
+    }
+  }
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief runs the server on the socket until it is stopped, SIGINT and SIGTERM
+ * are blocked before any thread is started so they are only received by the
+ * signalfd of the server
+ *
+ * @Param const std::string reference path of the socket
+ * @Param unsigned number of threads, 0 uses all cores
+ */
+/* ----------------------------------------------------------------------------*/
+auto serve(const std::string &socket_path, unsigned threads) -> void {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  sigset_t previous;
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+  try {
+    unix_server server(socket_path, threads);
+    std::cerr << "Serving on " << socket_path << std::endl;
+    server.run();
+  } catch (...) {
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    throw;
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+}  // namespace server
+namespace bench {
+struct bench_option_exception : public std::exception {
+  const char *what() const throw() {
+    return "Wrong --bench option, options are key=value pairs";
+  }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parameters of the generated corpus and of the measurement, the same
+ * parameters always generate the same corpus
+ */
+/* ----------------------------------------------------------------------------*/
+struct bench_options {
+  std::uint64_t seed = 1;
+  std::size_t megabytes = 16;
+  std::size_t min_word_length = 1;
+  std::size_t max_word_length = 12;
+  double numbers = 0.1;
+  double palindromes = 0.05;
+  double anagrams = 0.05;
+  unsigned repeat = 3;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief corpus with the query words that are used for -a and -p, queries
+ * start with the flag because flags skip the first element of the range
+ */
+/* ----------------------------------------------------------------------------*/
+struct corpus {
+  std::string text;
+  std::vector<std::string> anagram_queries;
+  std::vector<std::string> palindrom_queries;
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief result of measurement of one flag path, seconds is the best of the
+ * repetitions
+ */
+/* ----------------------------------------------------------------------------*/
+struct measurement {
+  std::string name;
+  double seconds;
+  std::uint64_t allocations;
+};
+
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief parses key=value options that follow --bench: seed, size (MB),
+ * word-length (min:max), numbers, palindromes, anagrams (ratios of words) and
+ * repeat
+ *
+ * @Param iterator to the first option
+ * @Param const iterator to the end of options
+ *
+ * @Returns bench::bench_options
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto parse_options(It option_iterator, const It &end_iterator)
+    -> bench_options {
+  bench_options options;
+  try {
+    for (; option_iterator != end_iterator; ++option_iterator) {
+      std::string const &option = *option_iterator;
+      std::size_t const equals = option.find('=');
+      if (equals == std::string::npos) throw bench_option_exception();
+      std::string const key = option.substr(0, equals);
+      std::string const value = option.substr(equals + 1);
+      if (key == "seed") {
+        options.seed = std::stoull(value);
+      } else if (key == "size") {
+        options.megabytes = std::max<std::size_t>(1, std::stoull(value));
+      } else if (key == "word-length") {
+        std::size_t const colon = value.find(':');
+        if (colon == std::string::npos) throw bench_option_exception();
+        options.min_word_length =
+            std::max<std::size_t>(1, std::stoull(value.substr(0, colon)));
+        options.max_word_length = std::max<std::size_t>(
+            options.min_word_length, std::stoull(value.substr(colon + 1)));
+      } else if (key == "numbers") {
+        options.numbers = std::stod(value);
+      } else if (key == "palindromes") {
+        options.palindromes = std::stod(value);
+      } else if (key == "anagrams") {
+        options.anagrams = std::stod(value);
+      } else if (key == "repeat") {
+        options.repeat = std::max(1u, unsigned(std::stoul(value)));
+      } else {
+        throw bench_option_exception();
+      }
+    }
+  } catch (std::logic_error &) {
+    throw bench_option_exception();
+  }
+  return options;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief generates corpus of lines of 1 to 16 words. Words are numbers,
+ * palindroms from a pool of 16 palindroms, anagrams of 16 base words or random
+ * lowercase words in the given ratios, pools are used as queries of -p and -a
+ *
+ * @Param const bench::bench_options reference
+ *
+ * @Returns bench::corpus
+ */
+/* ----------------------------------------------------------------------------*/
+inline auto generate_corpus(const bench_options &options) -> corpus {
+  std::mt19937_64 random(options.seed);
+  std::uniform_int_distribution<std::size_t> word_length(
+      options.min_word_length, options.max_word_length);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::uniform_int_distribution<int> digit('0', '9');
+  std::uniform_int_distribution<std::size_t> line_words(1, 16);
+  std::uniform_int_distribution<std::size_t> pool_index(0, 15);
+  std::uniform_real_distribution<double> kind(0.0, 1.0);
+  auto random_word = [&](std::size_t length) {
+    std::string word;
+    for (std::size_t i = 0; i < length; ++i) word.push_back(letter(random));
+    return word;
+  };
+  corpus generated;
+  generated.anagram_queries.push_back("-a");
+  generated.palindrom_queries.push_back("-p");
+  for (std::size_t i = 0; i < 16; ++i) {
+    generated.anagram_queries.push_back(random_word(word_length(random)));
+    std::string half = random_word((word_length(random) + 1) / 2);
+    std::string palindrom = half;
+    palindrom.append(half.rbegin() + (word_length(random) % 2), half.rend());
+    generated.palindrom_queries.push_back(palindrom);
+  }
+  std::size_t const bytes = options.megabytes << 20;
+  generated.text.reserve(bytes + 256);
+  while (generated.text.size() < bytes) {
+    for (std::size_t words = line_words(random); words; --words) {
+      double const word_kind = kind(random);
+      if (word_kind < options.numbers) {
+        for (std::size_t length = word_length(random); length; --length)
+          generated.text.push_back(digit(random));
+      } else if (word_kind < options.numbers + options.palindromes) {
+        generated.text += generated.palindrom_queries[1 + pool_index(random)];
+      } else if (word_kind <
+                 options.numbers + options.palindromes + options.anagrams) {
+        std::string anagram =
+            generated.anagram_queries[1 + pool_index(random)];
+        std::shuffle(anagram.begin(), anagram.end(), random);
+        generated.text += anagram;
+      } else {
+        generated.text += random_word(word_length(random));
+      }
+      generated.text.push_back(words == 1 ? '\n' : ' ');
+    }
+  }
+  return generated;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief writes corpus to temporary file that is removed when the object is
+ * destroyed, flags work on files so the corpus has to be on the disk
+ */
+/* ----------------------------------------------------------------------------*/
+struct corpus_file {
+  std::string path;
+
+  explicit corpus_file(const std::string &text) {
+    path = (std::filesystem::temp_directory_path() / "console-bench-XXXXXX")
+               .string();
+    int const descriptor = mkstemp(path.data());
+    if (descriptor < 0) throw file::cannot_open_file_exception();
+    std::size_t written = 0;
+    while (written < text.size()) {
+      ssize_t const bytes =
+          write(descriptor, text.data() + written, text.size() - written);
+      if (bytes < 0 && errno == EINTR) continue;
+      if (bytes <= 0) {
+        close(descriptor);
+        unlink(path.c_str());
+        throw file::cannot_open_file_exception();
+      }
+      written += bytes;
+    }
+    close(descriptor);
+  }
+  corpus_file(const corpus_file &) = delete;
+  auto operator=(const corpus_file &) -> corpus_file & = delete;
+  ~corpus_file() { unlink(path.c_str()); }
+};
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief runs the flag path repeat times on freshly loaded file so nothing
+ * memoized by the previous run is reused, only the path itself is timed
+ *
+ * @Param const std::string reference name of the path
+ * @Param const bench::corpus_file reference
+ * @Param unsigned repeat
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ * @Param path callable with const file::manage_file and output::sink
+ *
+ * @Returns bench::measurement
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename Path>
+auto measure(const std::string &name, const corpus_file &corpus_on_disk,
+             unsigned repeat, parallel::thread_pool *pool, Path path)
+    -> measurement {
+  measurement result{name, std::numeric_limits<double>::max(), 0};
+  for (unsigned run = 0; run < repeat; ++run) {
+    file::manage_file const loaded(corpus_on_disk.path,
+                                   file::load_mode::mapped, pool);
+    output::sink output_stream;
+    std::uint64_t const allocations_before = allocations::count();
+    auto const start = std::chrono::steady_clock::now();
+    path(loaded, output_stream);
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    result.allocations = allocations::count() - allocations_before;
+    result.seconds = std::min(result.seconds, elapsed.count());
+  }
+  return result;
+}
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief generates corpus described by the options after --bench, times load
+ * of the file and every flag path on it and writes the results as JSON with
+ * throughput in MB/s and items (words of the corpus) per second
+ *
+ * @Param output::sink reference
+ * @Param iterator to the first option
+ * @Param const iterator to the end of options
+ * @Param parallel::thread_pool pointer (can be nullptr)
+ *
+ * @Returns
+ */
+/* ----------------------------------------------------------------------------*/
+template <typename It>
+auto run_benchmarks(output::sink &output_stream, It option_iterator,
+                    const It &end_iterator, parallel::thread_pool *pool)
+    -> void {
+  bench_options const options = parse_options(option_iterator, end_iterator);
+  allocations::start();
+  corpus const generated = generate_corpus(options);
+  corpus_file const corpus_on_disk(generated.text);
+  scan::summary const corpus_summary =
+      scan::count(generated.text, scan::all);
+  std::size_t const sort_memory = sorting::default_memory_budget();
+  std::vector<measurement> results;
+
+  std::uint64_t allocations_before = allocations::count();
+  double load_seconds = std::numeric_limits<double>::max();
+  std::uint64_t load_allocations = 0;
+  for (unsigned run = 0; run < options.repeat; ++run) {
+    allocations_before = allocations::count();
+    auto const start = std::chrono::steady_clock::now();
+    file::manage_file const loaded(corpus_on_disk.path,
+                                   file::load_mode::mapped, pool);
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    load_allocations = allocations::count() - allocations_before;
+    load_seconds = std::min(load_seconds, elapsed.count());
+  }
+  results.push_back({"load", load_seconds, load_allocations});
+
+  auto counting = [&](const std::string &name, unsigned counter,
+                      auto flag) {
+    results.push_back(measure(
+        name, corpus_on_disk, options.repeat, pool,
+        [counter, flag](const file::manage_file &loaded,
+                        output::sink &flag_output) {
+          flag(flag_output, loaded.get_summary(counter));
+        }));
+  };
+  counting("newline_flag", scan::lines, command::newline_flag);
+  counting("digits_flag", scan::digits, command::digits_flag);
+  counting("numbers_flag", scan::numbers, command::numbers_flag);
+  counting("chars_flag", scan::chars, command::chars_flag);
+  results.push_back(measure(
+      "fused_counting_flags", corpus_on_disk, options.repeat, pool,
+      [](const file::manage_file &loaded, output::sink &flag_output) {
+        unsigned const counters =
+            scan::lines | scan::digits | scan::numbers | scan::chars;
+        command::newline_flag(flag_output, loaded.get_summary(counters));
+        command::digits_flag(flag_output, loaded.get_summary(counters));
+        command::numbers_flag(flag_output, loaded.get_summary(counters));
+        command::chars_flag(flag_output, loaded.get_summary(counters));
+      }));
+  results.push_back(measure(
+      "anagrams_flag", corpus_on_disk, options.repeat, pool,
+      [&generated](const file::manage_file &loaded,
+                   output::sink &flag_output) {
+        auto query = generated.anagram_queries.begin();
+        command::anagrams_flag(flag_output, loaded, query,
+                               generated.anagram_queries.end());
+      }));
+  results.push_back(measure(
+      "palindroms_flag", corpus_on_disk, options.repeat, pool,
+      [&generated, pool](const file::manage_file &loaded,
+                         output::sink &flag_output) {
+        auto query = generated.palindrom_queries.begin();
+        command::palindroms_flag(flag_output, loaded, query,
+                                 generated.palindrom_queries.end(), pool);
+      }));
+  results.push_back(measure(
+      "sorted_flag", corpus_on_disk, options.repeat, pool,
+      [sort_memory, pool](const file::manage_file &loaded,
+                          output::sink &flag_output) {
+        command::sorted_flag(flag_output, loaded, sort_memory, pool);
+      }));
+  results.push_back(measure(
+      "reverse_sorted_flag", corpus_on_disk, options.repeat, pool,
+      [sort_memory, pool](const file::manage_file &loaded,
+                          output::sink &flag_output) {
+        command::reverse_sorted_flag(flag_output, loaded, sort_memory, pool);
+      }));
+  std::vector<std::string> const patterns{"count-pattern", "\\d+",
+                                          "[a-z]+ing", "(ab|ba)\\w*"};
+  results.push_back(measure(
+      "count_pattern_flag", corpus_on_disk, options.repeat, pool,
+      [&patterns, pool](const file::manage_file &loaded,
+                        output::sink &flag_output) {
+        auto pattern = patterns.begin();
+        command::count_pattern_flag(flag_output, loaded, pattern,
+                                    patterns.end(), pool);
+      }));
+  results.push_back(measure(
+      "std_regex_count", corpus_on_disk, options.repeat, pool,
+      [&patterns](const file::manage_file &loaded, output::sink &flag_output) {
+        for (auto pattern = patterns.begin() + 1; pattern != patterns.end();
+             ++pattern)
+          flag_output << helper::count_all(std::regex(*pattern),
+                                           loaded.get_text())
+                      << ' ' << *pattern << '\n';
+      }));
+
+  double const megabytes = generated.text.size() / 1e6;
+  std::ostringstream report;
+  report << std::fixed << std::setprecision(6) << "{\n"
+         << "  \"corpus\": {\"seed\": " << options.seed
+         << ", \"bytes\": " << generated.text.size()
+         << ", \"lines\": " << corpus_summary.lines
+         << ", \"words\": " << corpus_summary.words
+         << ", \"word_length\": [" << options.min_word_length << ", "
+         << options.max_word_length << "]"
+         << ", \"numbers\": " << options.numbers
+         << ", \"palindromes\": " << options.palindromes
+         << ", \"anagrams\": " << options.anagrams << "},\n"
+         << "  \"threads\": " << (pool ? pool->size() : 1) << ",\n"
+         << "  \"repeat\": " << options.repeat << ",\n"
+         << "  \"results\": [\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    double const seconds = std::max(results[i].seconds, 1e-9);
+    report << "    {\"path\": \"" << results[i].name
+           << "\", \"seconds\": " << seconds
+           << ", \"mb_per_second\": " << megabytes / seconds
+           << ", \"items_per_second\": "
+           << corpus_summary.words / seconds
+           << ", \"allocations\": " << results[i].allocations << "}"
+           << (i + 1 == results.size() ? "\n" : ",\n");
+  }
+  report << "  ]\n}\n";
+  output_stream << report.str();
+}
+}  // namespace bench
+/* --------------------------------------------------------------------------*/
+/**
+ * @brief replacements of the global allocation functions that count
+ * allocations for --stats and --bench once allocations::start was called,
+ * memory comes from malloc so it's released with free, the nothrow forms are
+ * replaced too so std::stable_sort buffers are freed by the same allocator
+ */
+/* ----------------------------------------------------------------------------*/
+auto operator new(std::size_t size) -> void * {
+  if (allocations::counting.load(std::memory_order_relaxed))
+    allocations::counter.fetch_add(1, std::memory_order_relaxed);
+  if (size == 0) size = 1;
+  while (true) {
+    if (void *pointer = std::malloc(size)) return pointer;
+    std::new_handler const handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc();
+    handler();
+  }
+}
+auto operator new(std::size_t size, std::align_val_t alignment) -> void * {
+  if (allocations::counting.load(std::memory_order_relaxed))
+    allocations::counter.fetch_add(1, std::memory_order_relaxed);
+  std::size_t const align = static_cast<std::size_t>(alignment);
+  size = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+  while (true) {
+    if (void *pointer = std::aligned_alloc(align, size)) return pointer;
+    std::new_handler const handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc();
+    handler();
+  }
+}
+auto operator new(std::size_t size, std::nothrow_t const &) noexcept
+    -> void * {
+  try {
+    return ::operator new(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+auto operator new(std::size_t size, std::align_val_t alignment,
+                  std::nothrow_t const &) noexcept -> void * {
+  try {
+    return ::operator new(size, alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+auto operator delete(void *pointer) noexcept -> void { std::free(pointer); }
+auto operator delete(void *pointer, std::size_t) noexcept -> void {
+  std::free(pointer);
+}
+auto operator delete(void *pointer, std::align_val_t) noexcept -> void {
+  std::free(pointer);
+}
+auto operator delete(void *pointer, std::size_t, std::align_val_t) noexcept
+    -> void {
+  std::free(pointer);
+}
+#pragma GCC diagnostic pop
 int main(int argc, char **argv) {
   std::vector<std::string> args(argv + 1, argv + argc);
 
-  command::manage_command(args);
+  return command::manage_command(args) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
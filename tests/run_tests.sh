@@ -0,0 +1,794 @@
+#!/usr/bin/env bash
+# Regression tests of the program, every test runs the compiled program on
+# small files in a temporary directory and compares what it writes.
+#
+# Usage: tests/run_tests.sh [program]
+# without the program main.cpp is compiled to a temporary directory first
+set -u
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+if [ $# -ge 1 ]; then
+  program=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+else
+  program=$work/main.out
+  ${CXX:-g++} -std=c++20 -O2 "$root/main.cpp" -o "$program" -lpthread -ldl ||
+    exit 1
+fi
+cd "$work" || exit 1
+
+passed=0
+failed=0
+pass() { passed=$((passed + 1)); }
+fail() {
+  failed=$((failed + 1))
+  echo "FAIL: $1"
+  [ $# -ge 2 ] && printf '%s\n' "$2" | sed 's/^/    /'
+}
+# expect_output "name" "expected standard output" program arguments...
+expect_output() {
+  local name=$1 expected=$2
+  shift 2
+  local actual
+  actual=$("$program" "$@" 2>/dev/null)
+  local status=$?
+  if [ $status -ge 128 ]; then
+    fail "$name" "killed by signal $((status - 128))"
+  elif [ "$actual" != "$expected" ]; then
+    fail "$name" "expected:
+$expected
+actual:
+$actual"
+  else
+    pass
+  fi
+}
+# expect_error "name" "message on the standard error" program arguments...
+expect_error() {
+  local name=$1 message=$2
+  shift 2
+  local errors
+  errors=$("$program" "$@" 2>&1 >/dev/null)
+  local status=$?
+  if [ $status -ge 128 ]; then
+    fail "$name" "killed by signal $((status - 128))"
+  elif [[ "$errors" != *"$message"* ]]; then
+    fail "$name" "expected error: $message
+actual:
+$errors"
+  else
+    pass
+  fi
+}
+# expect_status "name" status program arguments...
+expect_status() {
+  local name=$1 expected=$2
+  shift 2
+  "$program" "$@" >/dev/null 2>&1
+  local status=$?
+  if [ $status -ne "$expected" ]; then
+    fail "$name" "expected exit status $expected, got $status"
+  else
+    pass
+  fi
+}
+# check "name" command... passes when the command succeeds
+check() {
+  local name=$1
+  shift
+  if "$@"; then pass; else fail "$name"; fi
+}
+
+# sends the lines to the server on the socket and prints the responses
+server_request() {
+  python3 - "$@" <<'EOF'
+import socket, sys
+connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+connection.connect(sys.argv[1])
+connection.sendall("".join(line + "\n" for line in sys.argv[2:]).encode())
+connection.shutdown(socket.SHUT_WR)
+response = b""
+while True:
+    chunk = connection.recv(65536)
+    if not chunk:
+        break
+    response += chunk
+sys.stdout.write(response.decode())
+EOF
+}
+# starts the server on the socket with the extra arguments, its pid is saved
+# to server_pid
+start_server() {
+  local socket=$1
+  shift
+  "$program" "$@" --serve "$socket" >/dev/null 2>&1 &
+  server_pid=$!
+  for _ in $(seq 100); do
+    [ -S "$socket" ] && break
+    sleep 0.05
+  done
+}
+# stops the server with SIGINT, its exit status is saved to server_status
+stop_server() {
+  kill -INT "$server_pid"
+  wait "$server_pid"
+  server_status=$?
+}
+
+printf 'ala ma kota\nkot 12 a3\n' > small.txt
+
+# --------------------------------------------------------------------------
+# server
+if command -v python3 >/dev/null; then
+  start_server server.sock
+  response=$(server_request server.sock "-n" "-f small.txt -n")
+  expected=$'ERROR 0 17\nFile didn\'t open\nOK 17 0\nLines in file: 2'
+  if [ "$response" != "$expected" ]; then
+    fail "server answers a request without a file with ERROR" "$response"
+  else
+    pass
+  fi
+  check "server keeps running after a failed request" kill -0 "$server_pid"
+  nested=$(printf '(%.0s' $(seq 20000))a$(printf ')%.0s' $(seq 20000))
+  response=$(server_request server.sock "-f small.txt -re $nested")
+  check "server answers a deeply nested pattern with ERROR" \
+    [ "${response:0:6}" = "ERROR " ]
+  check "server keeps running after a deeply nested pattern" \
+    kill -0 "$server_pid"
+  stop_server
+  check "server stops on SIGINT" [ "$server_status" -eq 0 ]
+  check "server removes its socket" [ ! -e server.sock ]
+
+  start_server threads.sock -t 2
+  server_request threads.sock "-f small.txt -n" >/dev/null
+  stop_server
+  check "server with -t stops on SIGINT" [ "$server_status" -eq 0 ]
+  check "server with -t removes its socket" [ ! -e threads.sock ]
+else
+  echo "python3 not found, server tests skipped"
+fi
+
+# --------------------------------------------------------------------------
+# count patterns
+printf 'ERROR 12 timeout\nok 7 times\nERROR 3' > patterns.txt
+: > empty.txt
+expect_output "patterns are counted on a file without the last newline" \
+  $'Pattern counts: \n2 ERROR \\d+\n2 time(out)?s?\n4 \\d' \
+  -f patterns.txt -re 'ERROR \d+' 'time(out)?s?' '\d'
+expect_output "patterns are counted on an empty file" \
+  $'Pattern counts: \n0 a' -f empty.txt -re a
+nested=$(printf '(%.0s' $(seq 20000))a$(printf ')%.0s' $(seq 20000))
+expect_error "deeply nested groups are rejected" "--count-pattern takes" \
+  -f patterns.txt -re "$nested"
+repeated=a$(printf '*%.0s' $(seq 20000))
+expect_error "deeply nested repetitions are rejected" "--count-pattern takes" \
+  -f patterns.txt -re "$repeated"
+
+# --------------------------------------------------------------------------
+# several files
+mkdir -p files/empty files/words
+printf 'b a a\nc\n' > files/words/1.txt
+printf 'a z' > files/words/2.txt
+expected=$'==> files/words/1.txt <==\nLines in file: 2\nTop 2 words: \n2 a\n1 b
+==> files/words/2.txt <==\nLines in file: 1\nTop 2 words: \n1 a\n1 z
+==> total <==\nLines in file: 3\nTop 2 words: \n3 a\n1 b'
+expect_output "files of a directory are counted and merged" "$expected" \
+  -f files/words -n --top 2
+expect_output "files are merged the same with threads" "$expected" \
+  -f files/words -t 3 -n --top 2
+expect_error "empty directory is an error" "Error while trying to process file" \
+  -f files/empty -n
+expect_error "glob that matches nothing is an error" "Wrong file name" \
+  -f 'files/empty/*' -n
+expect_output "patterns are counted in several files" \
+  $'==> files/words/1.txt <==\nPattern counts: \n2 a
+==> files/words/2.txt <==\nPattern counts: \n1 a\n==> total <==
+Pattern counts: \n3 a' -f files/words -re a
+expect_error "flags that can't be merged list --count-pattern" \
+  "-rs and --count-pattern can be used" -f files/words -a a
+
+# --------------------------------------------------------------------------
+# compressed files
+printf 'ala ma kota\nkot 12\n' > compressed.txt
+if command -v gzip >/dev/null; then
+  gzip -c compressed.txt > compressed.gz
+  cat compressed.gz compressed.gz > members.gz
+  { cat compressed.gz; head -c 200000 /dev/zero; } > padded.gz
+  { cat compressed.gz; printf '\0\0x'; } > garbage.gz
+  head -c 20 compressed.gz > truncated.gz
+  expect_output "gzip file is decompressed" \
+    $'Lines in file: 2\nChars in file: 19' -f compressed.gz -n -c
+  expect_output "gzip members are read as one text" \
+    $'Lines in file: 4\nChars in file: 38' -f members.gz -n -c
+  expect_output "zero bytes after the last gzip member are skipped" \
+    $'Lines in file: 2\nChars in file: 19' -f padded.gz -n -c
+  expect_error "bytes after the zero padding are an error" \
+    "Compressed file is corrupted" -f garbage.gz -n
+  expect_error "truncated gzip file is an error" \
+    "Compressed file is corrupted" -f truncated.gz -n
+  expect_error "gzip file can't be indexed" "can't be used with gzip" \
+    -f compressed.gz --build-index
+  check "no index is written for a gzip file" [ ! -e compressed.gz.cidx ]
+fi
+if command -v zstd >/dev/null; then
+  zstd -q compressed.txt -o compressed.zst
+  expect_output "zstd file is decompressed" \
+    $'Lines in file: 2\nChars in file: 19' -f compressed.zst -n -c -t 2
+fi
+
+# --------------------------------------------------------------------------
+# exit status and build index output
+expect_status "successful command exits with 0" 0 -f small.txt -n
+expect_status "failed command exits with 1" 1 -f missing.txt -n
+mkdir -p blocked
+printf 'a b\n' > blocked/words.txt
+mkdir -p blocked/words.txt.cidx
+output=$("$program" -f blocked/words.txt --build-index 2>/dev/null)
+check "path of the index is not written when it can't be saved" \
+  [ "${output#*Index saved}" = "$output" ]
+expect_error "failed index write is reported" "Error while writing index file" \
+  -f blocked/words.txt --build-index
+expect_status "failed index write exits with 1" 1 \
+  -f blocked/words.txt --build-index
+
+# --------------------------------------------------------------------------
+# fuzzy matching
+printf 'kot kat kotek ala\nkto' > fuzzy.txt
+expect_output "words within the distance are matched" \
+  $'Fuzzy matches: \nkot\nkat' -f fuzzy.txt --fuzzy 1 kot
+expect_output "distance 0 matches equal words" \
+  $'Fuzzy matches: \nkot\nala' -f fuzzy.txt --fuzzy 0 kot ala
+expect_output "empty query word is skipped" \
+  $'Fuzzy matches: \nkot\nkat' -f fuzzy.txt --fuzzy 1 "" kot
+expect_output "only empty query word matches nothing" \
+  'Fuzzy matches: ' -f fuzzy.txt --fuzzy 2 ""
+expect_output "empty query word is skipped when streaming" \
+  $'Fuzzy matches: \nkot\nkat' -f fuzzy.txt --stream --fuzzy 1 "" kot
+long=$(printf 'a%.0s' $(seq 70))
+printf 'x %s %sb %sbb\n' "$long" "$long" "$long" > long.txt
+expect_output "query words longer than 64 bytes are matched" \
+  "$(printf 'Fuzzy matches: \n%s\n%sb' "$long" "$long")" \
+  -f long.txt --fuzzy 1 "$long"
+
+# --------------------------------------------------------------------------
+# index
+printf 'kot ala 12\ntok ala\nkajak' > indexed.txt
+expect_error "--build-index without a file is an error" "File didn't open" \
+  --build-index
+expect_error "--build-index before -f is an error" "File didn't open" \
+  --build-index -f indexed.txt
+expect_output "index is built" 'Index saved to: indexed.txt.cidx' \
+  -f indexed.txt --build-index
+counted=$'Lines in file: 3\nDigits in file: 2\nNumbers in file: 1\nChars in file: 25'
+expect_output "counters are read from the index" "$counted" \
+  -f indexed.txt -n -d -dd -c
+expect_output "words are sorted from the index" \
+  $'12\nala\nala\nkajak\nkot\ntok' -f indexed.txt -s
+expect_output "anagrams are found in the index" \
+  $'Anagrams Found: \nkot\ntok' -f indexed.txt -a otk
+printf 'kot ala 12\ntok ala\nkajak kajak' > indexed.txt
+expect_output "stale index is not used" \
+  $'Lines in file: 3\nChars in file: 31' -f indexed.txt -n -c
+: > empty.txt
+expect_output "index of an empty file is built" \
+  'Index saved to: empty.txt.cidx' -f empty.txt --build-index
+expect_output "empty file is counted from the index" \
+  $'Lines in file: 0\nChars in file: 0' -f empty.txt -n -c
+
+# --------------------------------------------------------------------------
+# streaming
+printf 'kot ala tok\nkajak 12 oko\nkto' > streamed.txt
+expect_output "matches after counters are spilled and copied" \
+  $'Lines in file: 3\nChars in file: 29\nAnagrams Found: \nkot\ntok\nkto' \
+  -f streamed.txt --stream -n -c -a otk
+expect_output "standard input is streamed" \
+  $'Lines in file: 3\nPalindroms found: \nkajak\noko' \
+  -f - -n -p kajak oko < streamed.txt
+expect_output "empty standard input is streamed" \
+  $'Lines in file: 0\nPalindroms found: ' -f - -n -p oko < /dev/null
+expect_error "sorting can't be streamed" "can't be used with --stream" \
+  -f streamed.txt --stream -s
+
+# --------------------------------------------------------------------------
+# sorting
+printf 'kot Ala 12\n\nala  kot' > sorted.txt
+expect_output "words are sorted by bytes" $'12\nAla\nala\nkot\nkot' \
+  -f sorted.txt -s
+expect_output "words are sorted in reverse" $'kot\nkot\nala\nAla\n12' \
+  -f sorted.txt -rs
+expect_output "empty file has no words to sort" '' -f empty.txt -s
+seq 200000 | awk '{ printf "w%d%s", ($1 * 7919) % 100003, NR % 9 ? " " : "\n" }' \
+  > spilled.txt
+expected=$(tr -s ' \n' '\n' < spilled.txt | LC_ALL=C sort)
+expect_output "words that don't fit the memory are sorted in runs" \
+  "$expected" -f spilled.txt -s -m 1
+expect_output "runs are sorted the same with threads" \
+  "$expected" -f spilled.txt -s -m 1 -t 4
+expect_output "words that don't fit the memory are sorted in reverse" \
+  "$(printf '%s\n' "$expected" | tac)" -f spilled.txt -rs -m 1
+seq 1000000 | awk '{ printf "w%d%s", ($1 * 7919) % 1000003, NR % 9 ? " " : "\n" }' \
+  > many_runs.txt
+expected=$(tr -s ' \n' '\n' < many_runs.txt | LC_ALL=C sort)
+sorted=$(ulimit -n 16 && "$program" -f many_runs.txt -s -m 1 2>&1)
+check "runs are merged in groups when open files are limited" \
+  [ "$sorted" = "$expected" ]
+sorted=$(ulimit -n 16 && "$program" -f many_runs.txt -rs -m 1 2>&1)
+check "runs are merged in groups in reverse" \
+  [ "$sorted" = "$(printf '%s\n' "$expected" | tac)" ]
+
+# --------------------------------------------------------------------------
+# stats and bench
+errors=$("$program" -f small.txt -n -s --stats 2>&1 >/dev/null)
+check "--stats counts allocations of the command" \
+  grep -Eq '^allocations: [1-9]' <<< "$errors"
+report=$("$program" --bench size=1 repeat=1 2>/dev/null)
+check "--bench writes allocations of the flags" \
+  grep -Eq '"path": "anagrams_flag".*"allocations": [1-9]' <<< "$report"
+check "--bench generates the same corpus for the same seed" \
+  [ "$(grep -o '"corpus".*' <<< "$report")" = \
+    "$("$program" --bench size=1 repeat=1 2>/dev/null | grep -o '"corpus".*')" ]
+
+# --------------------------------------------------------------------------
+# loading files
+printf 'ala\nkot' > unterminated.txt
+expect_output "file without the last newline is counted" \
+  $'Lines in file: 2\nChars in file: 8\nala\nkot' -f unterminated.txt -n -c -s
+expect_output "empty file is counted" \
+  $'Lines in file: 0\nDigits in file: 0\nNumbers in file: 0\nChars in file: 0' \
+  -f empty.txt -n -d -dd -c
+expect_output "words of an empty file are checked" 'Anagrams Found: ' \
+  -f empty.txt -a kot
+expect_error "missing file is an error" "Wrong file name was provided" \
+  -f missing.txt -n
+
+# --------------------------------------------------------------------------
+# counters
+separately() {
+  local flag
+  for flag in -n -d -dd -c; do "$program" -f "$1" "$flag"; done
+}
+for counted in small.txt patterns.txt unterminated.txt; do
+  expect_output "counters of $counted in one scan match separate commands" \
+    "$(separately "$counted")" -f "$counted" -n -d -dd -c
+done
+expect_output "counters are written in the order of the flags" \
+  $'Chars in file: 22\nLines in file: 2\nDigits in file: 3' \
+  -f small.txt -c -n -d
+
+# --------------------------------------------------------------------------
+# digits and numbers
+# digits are bytes 0-9, numbers are words made only of them
+reference_digits() {
+  printf 'Digits in file: %d\nNumbers in file: %d' \
+    "$(tr -cd '0-9' < "$1" | wc -c)" \
+    "$(tr -s ' \t\n\v\f\r' '\n' < "$1" | grep -cx '[0-9][0-9]*')"
+}
+LC_ALL=C awk 'BEGIN {
+  srand(7)
+  split("0 1 2 3 4 5 6 7 8 9 a z Q _ - . \303\251 \331\241 \342\202\254", piece, " ")
+  for (line = 0; line < 3000; ++line) {
+    for (word = int(rand() * 14); word > 0; --word) {
+      digits = rand() < 0.3
+      for (c = 1 + int(rand() * 12); c > 0; --c)
+        printf "%s", piece[1 + int(rand() * (digits ? 10 : 19))]
+      printf "%s", rand() < 0.1 ? "\t " : " "
+    }
+    printf "%s", rand() < 0.05 ? "\r\n" : "\n"
+  }
+  printf "123 tail 45"
+}' > mixed.txt
+expect_output "digits and numbers of mixed bytes are counted" \
+  "$(reference_digits mixed.txt)" -f mixed.txt -d -dd
+# numbers that cross 64 byte blocks, a digit next to a non ascii byte and a
+# number at the end of the file
+{ printf 'x%.0s' $(seq 62); printf ' 1234 '; printf 'y%.0s' $(seq 56)
+  printf '\n9876543210 \303\2516 \331\241\n7'; } > blocks.txt
+expect_output "numbers across blocks are counted" \
+  $'Digits in file: 16\nNumbers in file: 3' -f blocks.txt -d -dd
+expect_output "numbers across blocks are counted with threads" \
+  $'Digits in file: 16\nNumbers in file: 3' -f blocks.txt -d -dd -t 3
+
+# --------------------------------------------------------------------------
+# threads
+for flags in "-n -d -dd -c" "-s" "-rs" "-pw" "-lp" "-cp" "--top 5" "--freq" \
+  "-a kot 12" "-p aba 11" "--fuzzy 1 kot" "-re \d+ a."; do
+  # shellcheck disable=SC2086
+  expected=$("$program" -f mixed.txt $flags 2>&1)
+  for threads in 2 7 0; do
+    # shellcheck disable=SC2086
+    expect_output "$flags with -t $threads matches one thread" "$expected" \
+      -t "$threads" -f mixed.txt $flags
+  done
+done
+expect_output "more threads than lines" \
+  $'Lines in file: 2\nNumbers in file: 1' -t 8 -f small.txt -n -dd
+: > nothing.txt
+expect_output "threads on an empty file" 'Lines in file: 0' -t 4 -f nothing.txt -n
+
+# --------------------------------------------------------------------------
+# anagrams
+printf 'kot tok okt kto kot\nkota atok ko otk\n' > anagrams.txt
+expect_output "anagrams are written in the order of the file" \
+  $'Anagrams Found: \nkot\ntok\nokt\nkto\nkot\notk' -f anagrams.txt -a otk
+expect_output "anagrams of several words are merged" \
+  $'Anagrams Found: \nkot\ntok\nokt\nkto\nkot\nkota\natok\notk' \
+  -f anagrams.txt -a kot atko
+expect_output "words of other lengths are not anagrams" 'Anagrams Found: ' \
+  -f anagrams.txt -a xyz kotaa
+expect_output "anagrams are found with threads" \
+  $'Anagrams Found: \nkota\natok' -t 3 -f anagrams.txt -a taok
+
+# --------------------------------------------------------------------------
+# streaming larger than the buffer
+for _ in $(seq 20); do cat mixed.txt; done > large.txt
+for flags in "-n -d -dd -c" "-a kot 12" "-p aba 11" "--fuzzy 1 kot"; do
+  # shellcheck disable=SC2086
+  expected=$("$program" -f large.txt $flags 2>&1)
+  # shellcheck disable=SC2086
+  expect_output "$flags streamed matches the loaded file" "$expected" \
+    -f large.txt --stream $flags
+  # shellcheck disable=SC2086
+  expect_output "$flags from standard input matches the loaded file" \
+    "$expected" -f - $flags < large.txt
+done
+expect_error "flags that need the whole file can't be streamed" \
+  "can't be used with --stream" -f large.txt --stream --top 5
+
+# --------------------------------------------------------------------------
+# word and line tables
+# the tables are built once for the first flag that needs them and shared
+# by the next flags of the command
+each_flag() {
+  "$program" -f mixed.txt -s
+  "$program" -f mixed.txt -lp
+  "$program" -f mixed.txt -a kot 12
+}
+expect_output "flags of one command share the word and line tables" \
+  "$(each_flag)" -f mixed.txt -s -lp -a kot 12
+printf ' \n\t\n  ' > spaces.txt
+expect_output "tables of a file with only spaces are empty" \
+  $'Lines in file: 3\nPalindromic words: ' -f spaces.txt -n -pw -s
+
+# --------------------------------------------------------------------------
+# stats file
+"$program" -f small.txt -n --stats-file stats.json >/dev/null 2>&1
+check "--stats-file writes counters of the command" \
+  grep -q '"bytes_read": 22, "lines": 2, "words": 6' stats.json
+check "--stats-file writes the phases" \
+  grep -Eq '"phases": \[\{"name": "load".*\{"name": "output"' stats.json
+if command -v python3 >/dev/null; then
+  check "--stats-file writes valid JSON" \
+    python3 -c 'import json, sys; json.load(open(sys.argv[1]))' stats.json
+fi
+errors=$("$program" -f small.txt -n --stats 2>&1 >/dev/null)
+check "--stats writes the phases of every flag" \
+  grep -q '^newline_flag: ' <<< "$errors"
+expect_output "--stats doesn't change the output" 'Lines in file: 2' \
+  -f small.txt -n --stats
+
+# --------------------------------------------------------------------------
+# input files
+printf -- '-f small.txt -n\n-f anagrams.txt -a otk\n-f small.txt -c\n' > batch.txt
+expect_output "commands of the input file are written in order" \
+  $'Lines in file: 2\nAnagrams Found: \nkot\ntok\nokt\nkto\nkot\notk\nChars in file: 22' \
+  -i batch.txt
+for _ in $(seq 30); do
+  echo "-f mixed.txt -a kot 12"
+  echo "-f small.txt -s"
+done > repeated.txt
+expected=$(for _ in $(seq 30); do
+  "$program" -f mixed.txt -a kot 12
+  "$program" -f small.txt -s
+done)
+expect_output "commands on the same files share them and keep the order" \
+  "$expected" -i repeated.txt
+printf -- '-f small.txt -n\n-f missing.txt -n\n-f small.txt -c\n' > failing.txt
+output=$("$program" -i failing.txt 2>/dev/null)
+check "commands before a failed one are written" \
+  [ "${output%%$'\n'*}" = 'Lines in file: 2' ]
+check "commands after a failed one are not run" \
+  [ "${output#*Chars in file}" = "$output" ]
+expect_error "failed command of the input file is reported" \
+  "Error while using command from input file" -i failing.txt
+expect_error "-i with other flags is an error" "-i should be the only" \
+  -t 4 -i batch.txt
+# the commands of a batch run at the same time on every core, the library
+# reports 8 cores so that they overlap on any machine
+cat > cores.c <<'EOF'
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <unistd.h>
+int get_nprocs(void) { return 8; }
+int get_nprocs_conf(void) { return 8; }
+long sysconf(int name) {
+  static long (*real)(int);
+  if (!real) real = (long (*)(int))dlsym(RTLD_NEXT, "sysconf");
+  if (name == _SC_NPROCESSORS_ONLN || name == _SC_NPROCESSORS_CONF) return 8;
+  return real(name);
+}
+EOF
+cores=
+${CC:-cc} -shared -fPIC cores.c -o cores.so -ldl 2>/dev/null &&
+  cores=$work/cores.so
+seq 2000000 > numbers.txt
+printf -- '-f numbers.txt -s -o sorted_numbers.txt\n-f sorted_numbers.txt -n\n' \
+  > read_after_write.txt
+LD_PRELOAD=$cores expect_output "command reads the file an earlier one writes" \
+  'Lines in file: 2000000' -i read_after_write.txt
+seq 3000000 > victim.txt
+seq 10 > ten.txt
+printf -- '-f victim.txt -s -o victim_sorted.txt\n-f ten.txt -n -o victim.txt\n' \
+  > write_after_read.txt
+LD_PRELOAD=$cores expect_status "command writes the file an earlier one reads" \
+  0 -i write_after_read.txt
+check "file is read before a later command writes it" \
+  [ "$(wc -l < victim_sorted.txt)" -eq 3000000 ]
+check "later command writes the file after it was read" \
+  [ "$(cat victim.txt)" = 'Lines in file: 10' ]
+
+# --------------------------------------------------------------------------
+# server protocol
+if command -v python3 >/dev/null; then
+  start_server protocol.sock
+  response=$(server_request protocol.sock "-f small.txt -n" "-f small.txt -c" \
+    "-f anagrams.txt -a otk")
+  expected=$'OK 17 0\nLines in file: 2\nOK 18 0\nChars in file: 22
+OK 41 0\nAnagrams Found: \nkot\ntok\nokt\nkto\nkot\notk'
+  if [ "$response" != "$expected" ]; then
+    fail "pipelined requests are answered in order" "$response"
+  else
+    pass
+  fi
+  refused=$'ERROR 0 49\n-i, -f - and --serve can\'t be sent to the server'
+  response=$(server_request protocol.sock "-i batch.txt" "-f - -n" \
+    "--serve other.sock")
+  check "-i, -f - and --serve are refused" \
+    [ "$response" = "$refused"$'\n'"$refused"$'\n'"$refused" ]
+  response=$(server_request protocol.sock "-x")
+  check "unknown flag is answered with ERROR" \
+    [ "$response" = $'ERROR 0 29\nError while parsing commands' ]
+  printf 'a\n' > changed.txt
+  server_request protocol.sock "-f changed.txt -n" >/dev/null
+  printf 'a\nb\nc\n' > changed.txt
+  response=$(server_request protocol.sock "-f changed.txt -n")
+  check "changed file is loaded again" \
+    [ "$response" = $'OK 17 0\nLines in file: 3' ]
+  cp many_runs.txt rotated.txt
+  server_request protocol.sock "-f rotated.txt -s --top 3" >/dev/null &
+  request_pid=$!
+  sleep 0.2
+  : > rotated.txt
+  wait "$request_pid"
+  check "server keeps running when a served file is truncated" \
+    kill -0 "$server_pid"
+  response=$(server_request protocol.sock "-f rotated.txt -n")
+  check "truncated file is loaded again" \
+    [ "$response" = $'OK 17 0\nLines in file: 0' ]
+  if [ -r "/proc/$server_pid/status" ]; then
+    resident() { awk '/^VmRSS:/ { print $2 }' "/proc/$server_pid/status"; }
+    cp many_runs.txt removed.txt
+    server_request protocol.sock "-f removed.txt -s --top 1" >/dev/null
+    loaded=$(resident)
+    rm removed.txt
+    server_request protocol.sock "-f small.txt -n" >/dev/null
+    check "removed file is dropped from the server" \
+      [ "$(resident)" -lt $((loaded * 3 / 4)) ]
+    threads() { awk '/^Threads:/ { print $2 }' "/proc/$server_pid/status"; }
+    started=$(threads)
+    server_request protocol.sock "-t 64 -f many_runs.txt -s -cp" >/dev/null &
+    request_pid=$!
+    most=$started
+    while kill -0 "$request_pid" 2>/dev/null; do
+      current=$(threads)
+      [ "$current" -gt "$most" ] && most=$current
+      sleep 0.02
+    done
+    check "-t of a request doesn't start threads in the server" \
+      [ "$most" -le "$started" ]
+  fi
+  stop_server
+else
+  echo "python3 not found, server protocol tests skipped"
+fi
+
+# --------------------------------------------------------------------------
+# palindromes
+printf 'kajak oko abc\nxabbay\n\nzz a' > palindromes.txt
+expect_output "palindromic words are written in the order of the file" \
+  $'Palindromic words: \nkajak\noko\nzz\na' -f palindromes.txt -pw
+expect_output "longest palindrome of every line, empty for an empty line" \
+  $'Longest palindromes in lines: \nkajak\nabba\n\nzz' -f palindromes.txt -lp
+expect_output "palindromic substrings of all lines are counted" \
+  'Palindromic substrings in file: 30' -f palindromes.txt -cp
+expect_output "only palindromic words that are given are written" \
+  $'Palindroms found: \nkajak\noko' -f palindromes.txt -p oko abc kajak
+expect_output "empty file has no palindromes" \
+  $'Palindromic words: \nPalindromic substrings in file: 0' \
+  -f nothing.txt -pw -cp
+
+# --------------------------------------------------------------------------
+# word frequencies
+printf 'b a c a b a\nc' > frequencies.txt
+expect_output "most frequent words are written first" \
+  $'Top 2 words: \n3 a\n2 b' -f frequencies.txt --top 2
+expect_output "words with the same count are written by bytes" \
+  $'Word frequencies: \n3 a\n2 b\n2 c' -f frequencies.txt --freq
+expect_output "top K larger than the number of words writes all of them" \
+  $'Top 10 words: \n3 a\n2 b\n2 c' -f frequencies.txt --top 10
+expect_output "top 0 writes no words" 'Top 0 words: ' \
+  -f frequencies.txt --top 0
+expect_error "top K that is not a number is an error" \
+  "Error while parsing commands" -f frequencies.txt --top x
+expect_output "empty file has no frequent words" \
+  $'Word frequencies: \nTop 3 words: ' -f nothing.txt --freq --top 3
+
+# --------------------------------------------------------------------------
+# output file
+printf 'old old old old old old old old\n' > written.txt
+expect_output "nothing is written to the standard output with -o" '' \
+  -f small.txt -n -o written.txt -c
+check "output file is truncated and has the output of every flag" \
+  [ "$(cat written.txt)" = $'Lines in file: 2\nChars in file: 22' ]
+expect_error "output file that can't be opened is an error" \
+  "Can't open the output file" -f small.txt -n -o files
+expect_status "output file that can't be opened exits with 1" 1 \
+  -f small.txt -n -o files
+if [ -w /dev/full ]; then
+  expect_error "failed write of the output file is reported" \
+    "Error while writing the output" -f mixed.txt -s -o /dev/full
+  expect_status "failed write of the output file exits with 1" 1 \
+    -f mixed.txt -s -o /dev/full
+  errors=$("$program" -f small.txt -n 2>&1 >/dev/full)
+  check "failed write of the standard output is reported" \
+    grep -q "Error while writing the output" <<< "$errors"
+  "$program" -f small.txt -n >/dev/full 2>/dev/null
+  check "failed write of the standard output exits with 1" [ $? -eq 1 ]
+fi
+
+# --------------------------------------------------------------------------
+# flags
+expect_output "long names of the flags" \
+  $'Lines in file: 2\nChars in file: 22\nNumbers in file: 1' \
+  --file small.txt --newlines --chars --numbers
+expect_error "unknown flag is an error" "Error while parsing commands" \
+  -f small.txt -n --bogus
+expect_error "flag without its value is an error" "Error while parsing commands" \
+  -f small.txt --top
+expect_status "unknown flag exits with 1" 1 -f small.txt --bogus
+help=$("$program" --help 2>&1)
+check "--help lists every flag" grep -q -- '-re||--count-pattern' <<< "$help"
+
+# --------------------------------------------------------------------------
+# following appended files
+follow_counts() { "$program" -f followed.txt --follow -n -dd -c --top 2; }
+full_counts() { "$program" -f followed.txt -n -dd -c --top 2; }
+printf 'a 1\nb 22\n' > followed.txt
+expect_output "first run counts the whole file" "$(full_counts)" \
+  -f followed.txt --follow -n -dd -c --top 2
+check "first run saves the checkpoint" [ -f followed.txt.cfollow ]
+printf 'c 3' >> followed.txt
+check "appended line without the newline is counted" \
+  [ "$(follow_counts)" = "$(full_counts)" ]
+printf ' 4\nd\n' >> followed.txt
+check "line that was cut by the last run is counted once" \
+  [ "$(follow_counts)" = "$(full_counts)" ]
+printf 'x\n' > followed.txt
+check "truncated file is counted again" \
+  [ "$(follow_counts)" = "$(full_counts)" ]
+rm followed.txt
+printf 'y y 5\nz 6 7 8\n' > followed.txt
+check "replaced file is counted again" \
+  [ "$(follow_counts)" = "$(full_counts)" ]
+expect_error "--follow with other flags is an error" \
+  "--follow can be used only with" -f followed.txt --follow -s
+
+# --------------------------------------------------------------------------
+# utf-8 words
+# words separated by a no-break space and an e with a combining acute accent
+nbsp=$'\xc2\xa0' accented=$'e\xcc\x81'
+printf 'Żółw  żółw%sŻÓŁW kajak\nAla ala\n%s%s Kok\n' \
+  "$nbsp" "$accented" "$accented" > unicode.txt
+expect_output "bytes of utf-8 are not spaces without --utf8" \
+  "Ala
+Kok
+ala
+$accented$accented
+kajak
+Żółw
+żółw${nbsp}ŻÓŁW" -f unicode.txt -s
+expect_output "unicode spaces separate words with --utf8" \
+  $'Anagrams Found: \nŻÓŁW' -f unicode.txt --utf8 -a WÓŁŻ
+expect_output "letter with its combining mark is one character" \
+  $'Palindromic words: \nkajak\nala\n'"$accented$accented" \
+  -f unicode.txt --utf8 -pw
+expect_output "case of letters is ignored" \
+  $'Anagrams Found: \nŻółw\nżółw\nŻÓŁW' -f unicode.txt --ignore-case -a WÓŁŻ
+expect_output "case of ascii letters is ignored" \
+  $'Palindroms found: \nAla\nala\nKok' -f unicode.txt --ignore-case -p kok ala
+expect_output "counters don't change with --utf8" \
+  $'Lines in file: 3\nChars in file: 51' -f unicode.txt --utf8 -n -c
+printf 'ab\xff\xfeba \xc5\n\xe2\x82' > invalid.txt
+expect_status "invalid utf-8 is read byte by byte" 0 \
+  -f invalid.txt --ignore-case -pw -lp -cp -s -a ba
+
+# --------------------------------------------------------------------------
+# line ranges
+printf 'l1 a\nl2 bb 12\nl3\nl4 c\nl5' > ranged.txt
+expect_output "lines of the range are written" \
+  $'Lines of the range: \nl2 bb 12\nl3' -f ranged.txt --lines 2:3
+check "line index is saved" [ -f ranged.txt.clines ]
+expect_output "range to the end includes the line without the newline" \
+  $'Lines of the range: \nl4 c\nl5' -f ranged.txt --lines 4:
+expect_output "flags count only the range" \
+  $'Lines in file: 2\nNumbers in file: 1\nChars in file: 12' \
+  -f ranged.txt --lines 2:3 -n -dd -c
+expect_output "range after the end of the file is cut" \
+  $'Lines of the range: \nl5' -f ranged.txt --lines 5:9
+expect_output "range that starts after the end is empty" 'Lines of the range: ' \
+  -f ranged.txt --lines 7:
+for range in 3:2 0:2 x 2; do
+  expect_error "range $range is an error" "--lines takes" \
+    -f ranged.txt --lines "$range"
+done
+expect_error "--lines with --stream is an error" "--lines takes" \
+  -f ranged.txt --stream --lines 1:2
+# sampled lines are different lines of the range in the order of the file
+in_order() {
+  awk -v from="$2" -v to="$3" 'NR == FNR { line[$0] = FNR; next }
+    !($0 in line) || line[$0] <= last || line[$0] < from || line[$0] > to {
+      exit 1
+    }
+    { last = line[$0] }' "$1" -
+}
+sampled=$("$program" -f ranged.txt --line-sample 2 2>/dev/null)
+check "sampled lines are in the order of the file" \
+  in_order ranged.txt 1 5 <<< "${sampled#*$'\n'}"
+check "K lines are sampled" [ "$(wc -l <<< "$sampled")" -eq 3 ]
+sampled=$("$program" -f ranged.txt --lines 2:4 --line-sample 2 2>/dev/null)
+check "lines are sampled from the range" \
+  in_order ranged.txt 2 4 <<< "${sampled#*$'\n'}"
+expect_output "sample larger than the range writes every line" \
+  $'Sampled lines: \nl2 bb 12\nl3\nl4 c' -f ranged.txt --lines 2:4 --line-sample 9
+printf 'l1 a\nchanged\nl3\n' > ranged.txt
+expect_output "stale line index is built again" \
+  $'Lines of the range: \nchanged\nl3' -f ranged.txt --lines 2:
+expect_output "range of an empty file is empty" 'Lines of the range: ' \
+  -f nothing.txt --lines 1:
+mkdir -p indexed
+printf 'a\nb\nc\n' > indexed/lines.txt
+"$program" -f indexed/lines.txt --lines 2:3 >/dev/null 2>&1
+check "line index is saved in the directory" [ -f indexed/lines.txt.clines ]
+expect_output "line index in a directory is not counted as a file" \
+  'Lines in file: 3' -f indexed -n
+
+# --------------------------------------------------------------------------
+# patterns against grep
+# grep -o also finds leftmost-longest matches that don't overlap in a line
+for re in '[0-9]+' 'a.' '(ab|a)[0-9]{2,3}' '[^ ]+' '[a-z_]+[0-9]?' 'z|Q|_-'; do
+  expect_output "$re is counted as grep -o counts it" \
+    "$(printf 'Pattern counts: \n%d %s' \
+      "$(LC_ALL=C grep -oE "$re" mixed.txt | wc -l)" "$re")" \
+    -f mixed.txt -re "$re"
+done
+expect_error "unbalanced group is an error" "--count-pattern takes" \
+  -f small.txt -re '(a'
+
+# --------------------------------------------------------------------------
+# files of globs and trees
+expect_output "files of a glob are counted in the order of names" \
+  $'==> files/words/1.txt <==\nLines in file: 2\n==> files/words/2.txt <==
+Lines in file: 1\n==> total <==\nLines in file: 3' -f 'files/words/*.txt' -n
+expect_output "files given one by one keep their order" \
+  $'==> files/words/2.txt <==\nLines in file: 1\n==> files/words/1.txt <==
+Lines in file: 2\n==> total <==\nLines in file: 3' \
+  -f files/words/2.txt files/words/1.txt -n
+mkdir -p tree/sub
+printf 'q\n' > tree/sub/x.txt
+printf 'r\n' > tree/y.txt
+expect_output "files of subdirectories are counted" \
+  $'==> tree/sub/x.txt <==\nLines in file: 1\n==> tree/y.txt <==
+Lines in file: 1\n==> total <==\nLines in file: 2' -t 2 -f tree -n
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]